@@ -0,0 +1,265 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#include "ExportChaosBenchmarkCommandlet.h"
+#include "ExportChaosExporter.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Math/RandomStream.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Components/StaticMeshComponent.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "PhysicsEngine/PhysicsConstraintActor.h"
+#include "PhysicsEngine/PhysicsConstraintComponent.h"
+#include "Landscape.h"
+#include "LandscapeInfo.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectGlobals.h"
+
+UExportChaosBenchmarkCommandlet::UExportChaosBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+struct FExportChaosBenchmarkConfig
+{
+	int32 StaticMeshes = 1000;
+	int32 ISMs = 10;
+	int32 Instances = 0;
+	int32 Constraints = 100;
+	int32 Fields = 0;
+	int32 LandscapeComponents = 0;
+	float Extent = 100000.0f;	// bodies are scattered over [-Extent, Extent] in X and Y
+	int32 Seed = 1;
+	UClass* FieldClass = nullptr;
+};
+
+static void SpawnLandscape(UWorld* World, int32 NumComponents, FRandomStream& Random)
+{
+	const int32 QuadsPerComponent = 63;
+	const int32 Size = NumComponents * QuadsPerComponent + 1;
+
+	// gentle noise, so the heightfields are not all flat and the height data does not compress to nothing
+	TArray<uint16> Heights;
+	Heights.SetNumUninitialized(Size * Size);
+	for (int32 Y = 0; Y < Size; ++Y)
+	{
+		for (int32 X = 0; X < Size; ++X)
+		{
+			const float Wave = FMath::Sin(X * 0.05f) * FMath::Cos(Y * 0.05f) * 2000.0f;
+			Heights[Y * Size + X] = static_cast<uint16>(FMath::Clamp(32768.0f + Wave + Random.FRandRange(-50.0f, 50.0f), 0.0f, 65535.0f));
+		}
+	}
+
+	TMap<FGuid, TArray<uint16>> HeightDataPerLayers;
+	HeightDataPerLayers.Add(FGuid(), MoveTemp(Heights));
+	TMap<FGuid, TArray<FLandscapeImportLayerInfo>> MaterialLayerDataPerLayers;
+	MaterialLayerDataPerLayers.Add(FGuid());
+
+	ALandscape* Landscape = World->SpawnActor<ALandscape>(FVector(-0.5 * (Size - 1) * 100.0, -0.5 * (Size - 1) * 100.0, 0.0), FRotator::ZeroRotator);
+	Landscape->SetActorScale3D(FVector(100.0, 100.0, 100.0));
+	Landscape->Import(FGuid::NewGuid(), 0, 0, Size - 1, Size - 1, 1, QuadsPerComponent, HeightDataPerLayers, nullptr,
+		MaterialLayerDataPerLayers, ELandscapeImportAlphamapType::Additive);
+	ULandscapeInfo::RecreateLandscapeInfo(World, true);
+}
+
+// Static meshes, ISMs, constraints between the static meshes, field actors and a landscape, all with the engine cube.
+static bool BuildSyntheticWorld(UWorld* World, const FExportChaosBenchmarkConfig& Config)
+{
+	UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (Cube == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("ExportChaosBenchmark: failed to load /Engine/BasicShapes/Cube"));
+		return false;
+	}
+
+	FRandomStream Random(Config.Seed);
+	auto RandomLocation = [&Random, &Config]()
+	{
+		return FVector(Random.FRandRange(-Config.Extent, Config.Extent), Random.FRandRange(-Config.Extent, Config.Extent), Random.FRandRange(0.0f, 5000.0f));
+	};
+
+	TArray<AStaticMeshActor*> StaticMeshActors;
+	StaticMeshActors.Reserve(Config.StaticMeshes);
+	for (int32 i = 0; i < Config.StaticMeshes; ++i)
+	{
+		AStaticMeshActor* Actor = World->SpawnActor<AStaticMeshActor>(RandomLocation(), FRotator(0.0f, Random.FRandRange(0.0f, 360.0f), 0.0f));
+		Actor->GetStaticMeshComponent()->SetStaticMesh(Cube);
+		StaticMeshActors.Add(Actor);
+	}
+
+	const int32 NumISMs = Config.Instances > 0 ? FMath::Max(Config.ISMs, 1) : 0;
+	for (int32 i = 0; i < NumISMs; ++i)
+	{
+		AActor* Actor = World->SpawnActor<AActor>();
+		UInstancedStaticMeshComponent* Component = NewObject<UInstancedStaticMeshComponent>(Actor);
+		Component->SetStaticMesh(Cube);
+		Actor->SetRootComponent(Component);
+		Actor->AddInstanceComponent(Component);
+		Component->RegisterComponent();
+
+		const int32 NumInstances = Config.Instances / NumISMs + (i < Config.Instances % NumISMs ? 1 : 0);
+		TArray<FTransform> Transforms;
+		Transforms.Reserve(NumInstances);
+		for (int32 j = 0; j < NumInstances; ++j)
+		{
+			Transforms.Emplace(FRotator(0.0f, Random.FRandRange(0.0f, 360.0f), 0.0f), RandomLocation(), FVector(Random.FRandRange(0.5f, 2.0f)));
+		}
+		Component->AddInstances(Transforms, false);
+	}
+
+	for (int32 i = 0; i < Config.Constraints && StaticMeshActors.Num() >= 2; ++i)
+	{
+		AStaticMeshActor* Actor1 = StaticMeshActors[Random.RandHelper(StaticMeshActors.Num())];
+		AStaticMeshActor* Actor2 = StaticMeshActors[Random.RandHelper(StaticMeshActors.Num())];
+		APhysicsConstraintActor* Constraint = World->SpawnActor<APhysicsConstraintActor>(0.5 * (Actor1->GetActorLocation() + Actor2->GetActorLocation()), FRotator::ZeroRotator);
+		Constraint->GetConstraintComp()->ConstraintActor1 = Actor1;
+		Constraint->GetConstraintComp()->ConstraintActor2 = Actor2;
+	}
+
+	if (Config.Fields > 0 && Config.FieldClass == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ExportChaosBenchmark: -Fields needs -FieldClass=<DirectionalForce_C class path>, no fields spawned"));
+	}
+	for (int32 i = 0; i < Config.Fields && Config.FieldClass != nullptr; ++i)
+	{
+		World->SpawnActor<AActor>(Config.FieldClass, RandomLocation(), FRotator::ZeroRotator);
+	}
+
+	if (Config.LandscapeComponents > 0)
+	{
+		SpawnLandscape(World, Config.LandscapeComponents, Random);
+	}
+
+	World->UpdateWorldComponents(true, false);
+	return true;
+}
+
+// Everything the export wrote for MapName: the scene files, the grid cells and the landscape files.
+static int64 GetExportOutputSize(const FString& MapName)
+{
+	TArray<FString> Files;
+	const FString SceneFilePath = GetPhysicSceneFilePath(MapName);
+	IFileManager::Get().FindFiles(Files, *(FPaths::GetPath(SceneFilePath) / MapName + TEXT(".*")), true, false);
+	for (FString& File : Files)
+	{
+		File = FPaths::GetPath(SceneFilePath) / File;
+	}
+	IFileManager::Get().FindFilesRecursive(Files, *(FPaths::GetPath(SceneFilePath) / MapName), TEXT("*"), true, false, false);
+	IFileManager::Get().FindFilesRecursive(Files, *(GetCookedContentDir() / "Landscape" / MapName), TEXT("*"), true, false, false);
+
+	int64 Size = 0;
+	for (const FString& File : Files)
+	{
+		Size += FMath::Max<int64>(IFileManager::Get().FileSize(*File), 0);
+	}
+	return Size;
+}
+
+static TArray<int32> ParseIntList(const FString& Params, const TCHAR* Name)
+{
+	TArray<int32> Values;
+	FString Value;
+	if (FParse::Value(*Params, Name, Value))
+	{
+		TArray<FString> Items;
+		Value.ParseIntoArray(Items, TEXT("+"));
+		for (const FString& Item : Items)
+		{
+			Values.Add(FCString::Atoi(*Item));
+		}
+	}
+	return Values;
+}
+
+int32 UExportChaosBenchmarkCommandlet::Main(const FString& Params)
+{
+	FExportChaosBenchmarkConfig Config;
+	FParse::Value(*Params, TEXT("-StaticMeshes="), Config.StaticMeshes);
+	FParse::Value(*Params, TEXT("-ISMs="), Config.ISMs);
+	FParse::Value(*Params, TEXT("-Constraints="), Config.Constraints);
+	FParse::Value(*Params, TEXT("-Fields="), Config.Fields);
+	FParse::Value(*Params, TEXT("-LandscapeComponents="), Config.LandscapeComponents);
+	FParse::Value(*Params, TEXT("-Extent="), Config.Extent);
+	FParse::Value(*Params, TEXT("-Seed="), Config.Seed);
+
+	FString FieldClassPath;
+	if (FParse::Value(*Params, TEXT("-FieldClass="), FieldClassPath))
+	{
+		Config.FieldClass = LoadClass<AActor>(nullptr, *FieldClassPath);
+		if (Config.FieldClass == nullptr || Config.FieldClass->GetName() != TEXT("DirectionalForce_C"))
+		{
+			UE_LOG(LogTemp, Error, TEXT("ExportChaosBenchmark: %s is not a DirectionalForce_C class"), *FieldClassPath);
+			return 1;
+		}
+	}
+
+	TArray<int32> InstanceCounts = ParseIntList(Params, TEXT("-Instances="));
+	if (InstanceCounts.Num() == 0)
+	{
+		InstanceCounts.Add(10000);
+	}
+
+	// a benchmark measures the full export, not how little changed since the previous run
+	if (!FParse::Param(*Params, TEXT("Incremental")))
+	{
+		if (IConsoleVariable* Incremental = IConsoleManager::Get().FindConsoleVariable(TEXT("ExportChaos.Incremental")))
+		{
+			Incremental->Set(0, ECVF_SetByCommandline);
+		}
+	}
+
+	FString OutputFile = FPaths::ProjectSavedDir() / "ExportChaos" / "Benchmark.csv";
+	FParse::Value(*Params, TEXT("-Output="), OutputFile);
+	if (!IFileManager::Get().FileExists(*OutputFile))
+	{
+		FFileHelper::SaveStringToFile(TEXT("Map,StaticMeshes,ISMs,Instances,Constraints,Fields,LandscapeComponents,Result,SetupSeconds,ExportSeconds,PeakUsedPhysicalMB,OutputBytes\n"), *OutputFile);
+	}
+
+	int32 NumFailed = 0;
+	for (int32 Instances : InstanceCounts)
+	{
+		Config.Instances = Instances;
+		const FString MapName = FString::Printf(TEXT("ExportChaosBenchmark_%d"), Instances);
+
+		const double SetupStartTime = FPlatformTime::Seconds();
+		UPackage* Package = CreatePackage(*(TEXT("/Temp/") + MapName));
+		UWorld* World = UWorld::CreateWorld(EWorldType::Editor, false, FName(*MapName), Package);
+		const bool bBuilt = BuildSyntheticWorld(World, Config);
+		const double SetupSeconds = FPlatformTime::Seconds() - SetupStartTime;
+
+		const double ExportStartTime = FPlatformTime::Seconds();
+		const bool bExported = bBuilt && ExportChaosPhysicScene(World);
+		const double ExportSeconds = FPlatformTime::Seconds() - ExportStartTime;
+
+		// the peak is over the life of the process, run one size per process for an exact per-size peak
+		const double PeakUsedPhysicalMB = FPlatformMemory::GetStats().PeakUsedPhysical / (1024.0 * 1024.0);
+		const int64 OutputBytes = bExported ? GetExportOutputSize(World->GetMapName()) : 0;
+		if (!bExported)
+		{
+			NumFailed++;
+		}
+
+		UE_LOG(LogTemp, Display, TEXT("ExportChaosBenchmark: %d instances %s, setup %.2fs, export %.2fs, peak %.0f MB, output %lld bytes"),
+			Instances, bExported ? TEXT("exported") : TEXT("FAILED"), SetupSeconds, ExportSeconds, PeakUsedPhysicalMB, OutputBytes);
+
+		const FString Row = FString::Printf(TEXT("%s,%d,%d,%d,%d,%d,%d,%s,%.3f,%.3f,%.1f,%lld\n"), *World->GetMapName(), Config.StaticMeshes, Config.ISMs, Instances,
+			Config.Constraints, Config.FieldClass ? Config.Fields : 0, Config.LandscapeComponents, bExported ? TEXT("Exported") : TEXT("Failed"),
+			SetupSeconds, ExportSeconds, PeakUsedPhysicalMB, OutputBytes);
+		FFileHelper::SaveStringToFile(Row, *OutputFile, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+
+		World->DestroyWorld(false);
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("ExportChaosBenchmark: %d runs, %d failed, results in %s"), InstanceCounts.Num(), NumFailed, *OutputFile);
+	return NumFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,29 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "ExportChaosBenchmarkCommandlet.generated.h"
+
+/**
+ * Builds synthetic worlds and exports them, to see how the exporter scales with the size of the content.
+ *
+ *   UnrealEditor-Cmd <Project>.uproject -run=ExportChaosBenchmark -Instances=10000+100000+1000000
+ *       [-StaticMeshes=1000] [-ISMs=10] [-Constraints=100] [-Fields=10 -FieldClass=/Game/.../DirectionalForce.DirectionalForce_C]
+ *       [-LandscapeComponents=4] [-Extent=100000] [-Seed=1] [-Incremental] [-Output=<file.csv>]
+ *
+ * Every value of -Instances is one run, its instances are spread over the ISMs. Field actors are only spawned
+ * when -FieldClass names the DirectionalForce blueprint, -LandscapeComponents is the side of a square landscape.
+ * Each run appends export time, peak memory and output size to -Output (Saved/ExportChaos/Benchmark.csv).
+ * Exports are full unless -Incremental is given. Returns 0 when every run exported, 1 otherwise.
+ */
+UCLASS()
+class UExportChaosBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UExportChaosBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,193 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#include "ExportChaosCommandlet.h"
+#include "ExportChaosExporter.h"
+
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/App.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Engine/World.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectGlobals.h"
+
+UExportChaosCommandlet::UExportChaosCommandlet()
+{
+	IsClient = false;
+	IsEditor = true;
+	IsServer = false;
+	LogToConsole = true;
+}
+
+static TArray<FString> ParseMapList(const FString& Params)
+{
+	TArray<FString> Maps;
+
+	FString MapsValue;
+	if (FParse::Value(*Params, TEXT("-Maps="), MapsValue))
+	{
+		MapsValue.ParseIntoArray(Maps, TEXT("+"));
+	}
+
+	FString MapListFile;
+	if (FParse::Value(*Params, TEXT("-MapList="), MapListFile))
+	{
+		TArray<FString> Lines;
+		if (!FFileHelper::LoadFileToStringArray(Lines, *MapListFile))
+		{
+			UE_LOG(LogTemp, Error, TEXT("ExportChaos: failed to read map list %s"), *MapListFile);
+		}
+		for (FString& Line : Lines)
+		{
+			Line.TrimStartAndEndInline();
+			if (Line.IsEmpty() || Line.StartsWith(TEXT("#")))
+				continue;
+			Maps.Add(Line);
+		}
+	}
+	return Maps;
+}
+
+int32 UExportChaosCommandlet::Main(const FString& Params)
+{
+	const TArray<FString> Maps = ParseMapList(Params);
+	if (Maps.Num() == 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("ExportChaos: no maps given, use -Maps=/Game/Maps/A+/Game/Maps/B or -MapList=<file>"));
+		return 1;
+	}
+
+	int32 NumWorkers = 1;
+	FParse::Value(*Params, TEXT("-Workers="), NumWorkers);
+	if (NumWorkers > 1 && Maps.Num() > 1)
+	{
+		return RunWorkers(Maps, NumWorkers, Params);
+	}
+
+	// set by RunWorkers
+	FString DeferredCookList;
+	FParse::Value(*Params, TEXT("-DeferredCookList="), DeferredCookList);
+
+	int32 NumFailed = 0;
+	for (const FString& MapName : Maps)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		const bool bExported = ExportMap(MapName, DeferredCookList);
+		if (!bExported)
+		{
+			NumFailed++;
+		}
+		UE_LOG(LogTemp, Display, TEXT("ExportChaos: %s %s in %.2fs"), *MapName, bExported ? TEXT("exported") : TEXT("FAILED"), FPlatformTime::Seconds() - StartTime);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("ExportChaos: %d maps, %d failed"), Maps.Num(), NumFailed);
+	return NumFailed == 0 ? 0 : 1;
+}
+
+bool UExportChaosCommandlet::ExportMap(const FString& MapName, const FString& DeferredCookList)
+{
+	UPackage* Package = LoadPackage(nullptr, *MapName, LOAD_None);
+	UWorld* World = Package ? UWorld::FindWorldInPackage(Package) : nullptr;
+	if (World == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("ExportChaos: failed to load map %s"), *MapName);
+		return false;
+	}
+
+	// the export reads body transforms and ISM instance bodies, so the world needs its components and physics state
+	World->WorldType = EWorldType::Editor;
+	World->AddToRoot();
+	if (!World->bIsWorldInitialized)
+	{
+		World->InitWorld(UWorld::InitializationValues()
+			.CreatePhysicsScene(true)
+			.ShouldSimulatePhysics(false)
+			.AllowAudioPlayback(false)
+			.RequiresHitProxies(false)
+			.CreateNavigation(false)
+			.CreateAISystem(false)
+			.SetTransactional(false));
+	}
+	World->LoadSecondaryLevels();
+	World->UpdateWorldComponents(true, false);
+
+	const bool bExported = ExportChaosPhysicScene(World, DeferredCookList);
+
+	World->CleanupWorld();
+	World->RemoveFromRoot();
+	CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	return bExported;
+}
+
+// Splits the maps over NumWorkers child commandlets and waits for all of them. Maps share meshes, so the
+// workers do not cook: each lists the packages it saved and the parent runs one sharded cook over all of them,
+// instead of several cooks writing the same cooked files and deleting the .uassets another worker still needs.
+int32 UExportChaosCommandlet::RunWorkers(const TArray<FString>& Maps, int32 NumWorkers, const FString& Params)
+{
+	NumWorkers = FMath::Clamp(NumWorkers, 1, Maps.Num());
+	TArray<TArray<FString>> WorkerMaps;
+	WorkerMaps.SetNum(NumWorkers);
+	for (int32 i = 0; i < Maps.Num(); ++i)
+	{
+		WorkerMaps[i % NumWorkers].Add(Maps[i]);
+	}
+
+	FString ForwardedArgs;
+	FString DPCVars;
+	if (FParse::Value(*Params, TEXT("-dpcvars="), DPCVars, false))
+	{
+		ForwardedArgs += TEXT(" -dpcvars=\"") + DPCVars + TEXT("\"");
+	}
+
+	const FString EditorBinary = FPlatformProcess::ExecutablePath();
+	const FString Project = FPaths::SetExtension(FPaths::Combine(FPaths::ProjectDir(), FApp::GetProjectName()), ".uproject");
+
+	TArray<FString> CookLists;
+	TArray<FProcHandle> Handles;
+	for (int32 i = 0; i < NumWorkers; ++i)
+	{
+		const FString CookList = FPaths::ConvertRelativePathToFull(FPaths::ProjectSavedDir() / TEXT("ExportChaos") / FString::Printf(TEXT("CookList_%d.txt"), i));
+		IFileManager::Get().Delete(*CookList);
+		CookLists.Add(CookList);
+
+		const FString CmdParams = "\"" + Project + "\"" + " -run=ExportChaos -Workers=1 -Maps=" + FString::Join(WorkerMaps[i], TEXT("+")) + " -DeferredCookList=\"" + CookList + "\""
+			+ " -unattended -stdout -NoLogTimes -UTF8Output" + ForwardedArgs;
+		UE_LOG(LogTemp, Display, TEXT("RUN CMD(worker %d):%s %s"), i, *EditorBinary, *CmdParams);
+		Handles.Add(FPlatformProcess::CreateProc(*EditorBinary, *CmdParams, false, false, false, nullptr, 0, nullptr, nullptr, nullptr));
+	}
+
+	int32 NumFailed = 0;
+	for (int32 i = 0; i < NumWorkers; ++i)
+	{
+		FProcHandle& Handle = Handles[i];
+		if (!Handle.IsValid())
+		{
+			UE_LOG(LogTemp, Error, TEXT("ExportChaos: worker %d failed to launch"), i);
+			NumFailed++;
+			continue;
+		}
+
+		FPlatformProcess::WaitForProc(Handle);
+		int32 ExitCode = 1;
+		FPlatformProcess::GetProcReturnCode(Handle, &ExitCode);
+		FPlatformProcess::CloseProc(Handle);
+		if (ExitCode != 0)
+		{
+			UE_LOG(LogTemp, Error, TEXT("ExportChaos: worker %d (%s) exit code: %d"), i, *FString::Join(WorkerMaps[i], TEXT(", ")), ExitCode);
+			NumFailed++;
+		}
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("ExportChaos: %d maps over %d workers, %d workers failed"), Maps.Num(), NumWorkers, NumFailed);
+
+	// the packages of failed workers too, whatever they saved and recorded in their manifests
+	const double CookStartTime = FPlatformTime::Seconds();
+	const bool bCooked = CookDeferredPhysicPackages(CookLists);
+	UE_LOG(LogTemp, Display, TEXT("ExportChaos: cook of the workers' packages %s in %.2fs"), bCooked ? TEXT("done") : TEXT("FAILED"), FPlatformTime::Seconds() - CookStartTime);
+	for (const FString& CookList : CookLists)
+	{
+		IFileManager::Get().Delete(*CookList);
+	}
+	return NumFailed == 0 && bCooked ? 0 : 1;
+}
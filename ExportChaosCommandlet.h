@@ -0,0 +1,32 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "ExportChaosCommandlet.generated.h"
+
+/**
+ * Exports the PhysicScene of one or more maps without the editor UI.
+ *
+ *   UnrealEditor-Cmd <Project>.uproject -run=ExportChaos -Maps=/Game/Maps/A+/Game/Maps/B [-MapList=<file>] [-Workers=<N>]
+ *
+ * -MapList names a text file with one map per line, lines starting with # are skipped.
+ * With -Workers greater than 1 the maps are split over that many child commandlets running side by side.
+ * The workers only save the BodySetup packages, the parent cooks the packages of all of them at once afterwards.
+ * The ExportChaos.* console variables can be set with -dpcvars, which is forwarded to the workers.
+ * Returns 0 when every map was exported, 1 otherwise.
+ */
+UCLASS()
+class UExportChaosCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UExportChaosCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	bool ExportMap(const FString& MapName, const FString& DeferredCookList);
+	int32 RunWorkers(const TArray<FString>& Maps, int32 NumWorkers, const FString& Params);
+};
@@ -0,0 +1,24 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UWorld;
+
+// Exports the PhysicScene of World and cooks its BodySetups, blocking until everything is written.
+// Game thread only. This is the headless entry point used by UExportChaosCommandlet; the toolbar button runs
+// the same export with the writing and the cook on a background thread.
+// With a DeferredCookList the BodySetup packages are only saved: "<Package>\t<Manifest>" lines are appended
+// to that file and CookDeferredPhysicPackages cooks them later, for the workers of a parallel commandlet.
+bool ExportChaosPhysicScene(UWorld* World, const FString& DeferredCookList = FString());
+
+// One sharded cook of all the packages the deferred cook lists name. The failed ones are dropped from the
+// manifests that recorded them, so the next export retries them.
+bool CookDeferredPhysicPackages(const TArray<FString>& CookListFiles);
+
+// Saved/Cooked/LinuxServer/<Project>/Content, the root of everything the export writes for the server.
+FString GetCookedContentDir();
+
+// <CookedContentDir>/PhysicScene/<MapName>.json, the manifest and report sit next to it.
+FString GetPhysicSceneFilePath(const FString& MapName);
@@ -0,0 +1,912 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#pragma once
+
+// Binary PhysicScene layout (<Map>.pscene), written next to the PhysicScene json.
+// Shared by the editor exporter and the server readers, so keep it free of Unreal includes.
+//
+// File layout (little endian):
+//   SceneHeader
+//   SectionEntry[SectionCount]          at SceneHeader::SectionTableOffset
+//   section payloads                    each at SectionEntry::Offset, aligned to SectionAlignment
+// Every section is a flat array of fixed-size records, so a reader can mmap the file and
+// index it directly. Strings are stored as byte offsets into the Strings section (utf8, null terminated),
+// offset 0 is always the empty string.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace ChaosScene
+{
+	constexpr uint32_t Magic = 0x53504843; // "CHPS"
+	constexpr uint32_t Version = 8;
+	constexpr uint32_t MinVersion = 7;	// BodyRecord::Overrides and ConstraintRecord::Profile were json strings before
+	constexpr uint32_t SectionAlignment = 16;
+	constexpr uint32_t InvalidIndex = 0xffffffffu;
+
+	enum class ESection : uint32_t
+	{
+		Strings,
+		BodySetups,
+		StaticMeshBodies,
+		InstancedBodies,
+		InstanceTransforms,
+		Constraints,
+		PhysicFields,
+		Landscapes,
+		LandscapeCollisions,
+		StaticBVHNodes,
+		StaticBVHPrims,
+		QuantizedInstanceChunks,
+		QuantizedInstanceData,
+		StaticAggregates,
+		AggregateShapes,
+		CollisionLODs,
+		CollisionLODVertices,
+		BodyOverrides,
+		ConstraintProfiles,	// uint32_t string offsets, condensed json of FConstraintProfileProperties
+		ConstraintIslands,
+		IslandBodies,		// uint32_t ActorIDs
+		IslandConstraints,	// uint32_t indices into Constraints
+		Count
+	};
+
+	enum EBodyFlags : uint32_t
+	{
+		BodyFlag_SimulatePhysics = 1 << 0,
+		BodyFlag_EnableGravity = 1 << 1,
+		BodyFlag_StartAwake = 1 << 2,
+		BodyFlag_Movable = 1 << 3,
+	};
+
+	struct SceneHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t SectionCount;
+		uint32_t SectionTableOffset;
+		uint64_t FileSize;
+	};
+
+	struct SectionEntry
+	{
+		uint32_t Type;		// ESection
+		uint32_t Stride;	// record size in bytes, 1 for Strings
+		uint64_t Offset;	// from the start of the file
+		uint64_t Count;		// number of records
+		uint64_t Size;		// payload size in bytes
+	};
+
+	// Translation / rotation quat (x,y,z,w) / scale, stored as float.
+	struct PackedTransform
+	{
+		float Translation[3];
+		float Rotation[4];
+		float Scale3D[3];
+	};
+
+	struct BodySetupRecord
+	{
+		uint32_t Package;		// string
+		uint32_t Name;			// string
+		uint32_t Path;			// string
+		uint32_t Guid[4];
+		uint32_t FirstStaticMesh;	// index into StaticMeshBodies
+		uint32_t NumStaticMesh;
+		uint32_t FirstInstanced;	// index into InstancedBodies
+		uint32_t NumInstanced;
+	};
+
+	enum class ECollisionLOD : uint8_t
+	{
+		Box,
+		Sphere,
+		Hull,
+	};
+
+	// Coarse proxy of a BodySetup picked by the ExportChaos.CollisionLOD rules, exported next to its full geometry
+	// for regions or shards that do not need it. In BodySetup space:
+	//   Box     axis aligned, half size in Extent
+	//   Sphere  radius in Extent[0]
+	//   Hull    convex hull of CollisionLODVertices[FirstVertex, FirstVertex + NumVertices), Center / Extent are its bounds
+	struct CollisionLODRecord
+	{
+		uint32_t BodySetup;		// index into BodySetups
+		uint8_t Type;			// ECollisionLOD
+		uint8_t Pad[3];
+		float Center[3];
+		float Extent[3];
+		uint32_t FirstVertex;
+		uint32_t NumVertices;
+	};
+
+	struct CollisionLODVertex
+	{
+		float Position[3];
+	};
+
+	enum class EBodyOverrideType : uint8_t
+	{
+		Bool,
+		Enum,		// uint32_t
+		Float,
+		Vector,		// float[3]
+	};
+
+	struct BodyOverrideField
+	{
+		const char* Name;
+		EBodyOverrideType Type;
+	};
+
+	// FBodyInstance members a body can override against the DefaultInstance of its BodySetup, field i is bit i.
+	// An override set is a run of uint32_t words:
+	//   Mask       bit i set when field i is overridden
+	//   BoolBits   value of the overridden Bool fields, at their bit
+	//   values     of the other overridden fields in table order, see EBodyOverrideType
+	// The BodyOverrides section is made of such sets, the one at offset 0 is empty.
+	constexpr BodyOverrideField BodyOverrideFields[] = {
+		{ "SleepFamily", EBodyOverrideType::Enum },
+		{ "bUseCCD", EBodyOverrideType::Bool },
+		{ "bIgnoreAnalyticCollisions", EBodyOverrideType::Bool },
+		{ "bNotifyRigidBodyCollision", EBodyOverrideType::Bool },
+		{ "bSmoothEdgeCollisions", EBodyOverrideType::Bool },
+		{ "bLockTranslation", EBodyOverrideType::Bool },
+		{ "bLockRotation", EBodyOverrideType::Bool },
+		{ "bLockXTranslation", EBodyOverrideType::Bool },
+		{ "bLockYTranslation", EBodyOverrideType::Bool },
+		{ "bLockZTranslation", EBodyOverrideType::Bool },
+		{ "bLockXRotation", EBodyOverrideType::Bool },
+		{ "bLockYRotation", EBodyOverrideType::Bool },
+		{ "bLockZRotation", EBodyOverrideType::Bool },
+		{ "bOverrideMaxAngularVelocity", EBodyOverrideType::Bool },
+		{ "MassOverride", EBodyOverrideType::Float },
+		{ "LinearDamping", EBodyOverrideType::Float },
+		{ "AngularDamping", EBodyOverrideType::Float },
+		{ "CustomDOFPlaneNormal", EBodyOverrideType::Vector },
+		{ "COMNudge", EBodyOverrideType::Vector },
+		{ "MassScale", EBodyOverrideType::Float },
+		{ "InertiaTensorScale", EBodyOverrideType::Vector },
+		{ "MaxAngularVelocity", EBodyOverrideType::Float },
+		{ "CustomSleepThresholdMultiplier", EBodyOverrideType::Float },
+		{ "StabilizationThresholdMultiplier", EBodyOverrideType::Float },
+	};
+	constexpr uint32_t BodyOverrideFieldCount = sizeof(BodyOverrideFields) / sizeof(BodyOverrideFields[0]);
+	static_assert(BodyOverrideFieldCount <= 32, "the override mask is one uint32_t");
+
+	// Value words of a field after Mask and BoolBits, 0 for a Bool.
+	constexpr uint32_t BodyOverrideValueWords(EBodyOverrideType Type)
+	{
+		return Type == EBodyOverrideType::Bool ? 0 : (Type == EBodyOverrideType::Vector ? 3 : 1);
+	}
+
+	// Words of the whole override set with this Mask.
+	constexpr uint32_t BodyOverrideWords(uint32_t Mask)
+	{
+		uint32_t Words = 2;
+		for (uint32_t i = 0; i < BodyOverrideFieldCount; ++i)
+		{
+			if (Mask & (1u << i))
+				Words += BodyOverrideValueWords(BodyOverrideFields[i].Type);
+		}
+		return Words;
+	}
+
+	// Calls Func(Field, Words) for each field overridden by the set at Set, in table order. Words holds the
+	// BodyOverrideValueWords of the field, a Bool gets one word set to 0 or 1.
+	template<typename FuncType>
+	void ForEachBodyOverride(const uint32_t* Set, FuncType&& Func)
+	{
+		const uint32_t Mask = Set[0];
+		const uint32_t BoolBits = Set[1];
+		const uint32_t* Values = Set + 2;
+		for (uint32_t i = 0; i < BodyOverrideFieldCount; ++i)
+		{
+			if ((Mask & (1u << i)) == 0)
+				continue;
+			const EBodyOverrideType Type = BodyOverrideFields[i].Type;
+			if (Type == EBodyOverrideType::Bool)
+			{
+				const uint32_t Value = (BoolBits >> i) & 1u;
+				Func(i, &Value);
+			}
+			else
+			{
+				Func(i, Values);
+				Values += BodyOverrideValueWords(Type);
+			}
+		}
+	}
+
+	struct BodyRecord
+	{
+		uint32_t ActorID;
+		uint32_t CompID;
+		uint32_t Name;			// string
+		uint32_t BodySetup;		// index into BodySetups
+		PackedTransform Transform;
+		uint32_t Flags;			// EBodyFlags
+		uint32_t Overrides;		// word offset of its override set in BodyOverrides, 0 when none
+	};
+
+	struct InstancedBodyRecord
+	{
+		BodyRecord Body;
+		uint32_t FirstInstance;		// index into InstanceTransforms, or into the instances of QuantizedInstanceChunks
+		uint32_t NumInstances;
+	};
+
+	// Static bodies merged per cell when ExportChaos.StaticAggregateCellSize is set, one server particle each.
+	// Its shapes are AggregateShapes[FirstShape, FirstShape + NumShapes), regular BodyRecords whose Transform is
+	// relative to the aggregate. Those bodies are not in StaticMeshBodies.
+	struct StaticAggregateRecord
+	{
+		int32_t Cell[3];		// floor(location / cell size) of the bodies
+		PackedTransform Transform;	// center of the cell, identity rotation and scale
+		uint32_t FirstShape;		// index into AggregateShapes
+		uint32_t NumShapes;
+	};
+
+	struct ConstraintRecord
+	{
+		uint32_t OwnerID;
+		uint32_t CompID;
+		uint32_t ActorID1;
+		uint32_t ActorID2;
+		PackedTransform Transform;
+		uint32_t Profile;		// index into ConstraintProfiles, shared by all constraints with that profile, InvalidIndex when none
+	};
+
+	// Constraints connected through the simulating bodies they share. Static bodies and the world anchor constraints
+	// without joining islands, like in the solver. The anchored constraints come first, then the others in the breadth
+	// first order of their bodies from the anchored ones (from the first body of the island when none is), so solving
+	// them in order goes from the anchors outwards. Bodies are in that same order. The cells of a grid export have
+	// none, an island may span several cells; <Map>.cells.json lists them with the cell of each constraint.
+	struct ConstraintIslandRecord
+	{
+		uint32_t FirstBody;		// index into IslandBodies
+		uint32_t NumBodies;
+		uint32_t FirstConstraint;	// index into IslandConstraints
+		uint32_t NumConstraints;
+	};
+
+	struct PhysicFieldRecord
+	{
+		uint32_t OwnerID;
+		uint32_t CompID;
+		PackedTransform Transform;
+		float Direction[3];
+		float Magnitude;
+		uint8_t Enable;
+		uint8_t FieldType;
+		uint8_t Pad[2];
+	};
+
+	struct LandscapeRecord
+	{
+		uint32_t LandID;
+		uint32_t LandGuid[4];
+		int32_t LandscapeSectionOffsetX;
+		int32_t LandscapeSectionOffsetY;
+		PackedTransform ActorToWorld;
+		PackedTransform LandscapeActorToWorld;
+		uint32_t FirstCollision;	// index into LandscapeCollisions
+		uint32_t NumCollisions;
+	};
+
+	struct LandscapeCollisionRecord
+	{
+		uint32_t OwnerID;
+		uint32_t CompID;
+		uint32_t Package;		// string, <Package>.data under Content/Landscape/<Map>
+		int32_t SectionBaseX;
+		int32_t SectionBaseY;
+		int32_t SimpleCollisionSizeQuads;
+		int32_t CollisionSizeQuads;
+		float CollisionScale;
+		uint32_t HeightfieldGuid[4];
+		PackedTransform Transform;
+	};
+
+	// BVH over the world bounds of every static body (not simulating, not movable), of each of their
+	// instances and of each static aggregate. Nodes are stored depth first: the left child of an inner node is the next node,
+	// First is the index of the right child. Leaves have Count > 0 and reference StaticBVHPrims[First, First + Count).
+	struct BVHNode
+	{
+		float Min[3];
+		float Max[3];
+		uint32_t First;
+		uint32_t Count;
+	};
+
+	struct StaticBVHPrim
+	{
+		uint32_t Body;		// index into StaticMeshBodies, InstancedBodies when Instance is set, StaticAggregates for AggregatePrim
+		uint32_t Instance;	// instance index like InstancedBodyRecord::FirstInstance, InvalidIndex for a StaticMeshBodies entry
+	};
+
+	constexpr uint32_t AggregatePrim = 0xfffffffeu;	// StaticBVHPrim::Instance of a StaticAggregates entry
+
+	// Quantized instances, written instead of InstanceTransforms when ExportChaos.InstanceEncoding is 3.
+	// The instances are cut into chunks of consecutive instances (never spanning two components), the chunk
+	// table covers [0, instance count) in order. Each chunk payload in QuantizedInstanceData, aligned to
+	// SectionAlignment, decompresses to RawSize bytes:
+	//   position  uint16_t or uint32_t [NumInstances][3]   (P - Origin) / Step rounded, PositionBits wide
+	//   scale     float [NumInstances] for Uniform, float [NumInstances][3] for Full, nothing for Constant
+	//   rotation  uint16_t [NumInstances][3]               smallest three, see EncodeSmallestThree
+	// Maximum error against the float PackedTransform:
+	//   position  Step / 2 per axis (the decode is done in double, then rounded to float like PackedTransform)
+	//   rotation  below 0.01 degrees (0.0077 measured over 1M random rotations), each stored component is off
+	//             by at most 1 / (sqrt(2) * 32767)
+	//   scale     exact, Uniform is only picked when X == Y == Z
+	enum class EQuantizedScale : uint8_t
+	{
+		Constant,	// every instance of the chunk has ConstantScale
+		Uniform,
+		Full,
+	};
+
+	enum class ECodec : uint8_t
+	{
+		None,
+		Zlib,		// zlib stream (RFC 1950), as written by FCompression NAME_Zlib and read by zlib uncompress()
+	};
+
+	struct QuantizedInstanceChunk
+	{
+		uint32_t FirstInstance;
+		uint32_t NumInstances;
+		float Origin[3];
+		float Step;		// cm
+		uint8_t PositionBits;	// 16 or 32
+		uint8_t ScaleMode;	// EQuantizedScale
+		uint8_t Codec;		// ECodec
+		uint8_t Pad;
+		float ConstantScale[3];
+		uint64_t DataOffset;	// from the start of QuantizedInstanceData
+		uint32_t DataSize;	// stored bytes, RawSize when Codec is None
+		uint32_t RawSize;
+	};
+
+	inline uint64_t QuantizedChunkRawSize(uint32_t NumInstances, uint8_t PositionBits, uint8_t ScaleMode)
+	{
+		const uint64_t ScaleFloats = ScaleMode == uint8_t(EQuantizedScale::Full) ? 3 : (ScaleMode == uint8_t(EQuantizedScale::Uniform) ? 1 : 0);
+		return uint64_t(NumInstances) * (3 * (PositionBits / 8) + ScaleFloats * sizeof(float) + 3 * sizeof(uint16_t));
+	}
+
+	// Drops the largest quaternion component (rebuilt from the unit length) and stores the other three,
+	// each in [-1/sqrt(2), 1/sqrt(2)], as 15 bits. The index of the dropped one goes to the top bits of Out[0] and Out[1].
+	inline void EncodeSmallestThree(const float InQuat[4], uint16_t Out[3])
+	{
+		double Q[4] = { InQuat[0], InQuat[1], InQuat[2], InQuat[3] };
+		const double Length = std::sqrt(Q[0] * Q[0] + Q[1] * Q[1] + Q[2] * Q[2] + Q[3] * Q[3]);
+		uint32_t Largest = 0;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			Q[i] = Length > 0.0 ? Q[i] / Length : (i == 3 ? 1.0 : 0.0);
+			if (std::fabs(Q[i]) > std::fabs(Q[Largest]))
+				Largest = i;
+		}
+		// q and -q are the same rotation, keep the dropped component positive
+		const double Sign = Q[Largest] < 0.0 ? -1.0 : 1.0;
+		uint32_t Slot = 0;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			if (i == Largest)
+				continue;
+			const double Unit = (Sign * Q[i] * 1.4142135623730951 + 1.0) * 0.5;
+			const double Clamped = Unit < 0.0 ? 0.0 : (Unit > 1.0 ? 1.0 : Unit);
+			Out[Slot++] = static_cast<uint16_t>(std::lround(Clamped * 32767.0));
+		}
+		Out[0] |= static_cast<uint16_t>((Largest & 1) << 15);
+		Out[1] |= static_cast<uint16_t>((Largest >> 1) << 15);
+	}
+
+	inline void DecodeSmallestThree(const uint16_t In[3], float OutQuat[4])
+	{
+		const uint32_t Largest = (In[0] >> 15) | ((In[1] >> 15) << 1);
+		double Q[4];
+		double SumSq = 0.0;
+		uint32_t Slot = 0;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			if (i == Largest)
+				continue;
+			Q[i] = ((In[Slot++] & 0x7fff) / 32767.0 * 2.0 - 1.0) * 0.7071067811865476;
+			SumSq += Q[i] * Q[i];
+		}
+		Q[Largest] = SumSq < 1.0 ? std::sqrt(1.0 - SumSq) : 0.0;
+		for (uint32_t i = 0; i < 4; ++i)
+			OutQuat[i] = static_cast<float>(Q[i]);
+	}
+
+	// Fills the quantization parameters of a chunk for Transforms[0, Count): origin at the bounds minimum,
+	// 16 bit positions when the bounds fit in 65535 steps, and the cheapest exact scale mode.
+	// FirstInstance, Codec and the data fields are left to the caller.
+	inline void PrepareQuantizedChunk(const PackedTransform* Transforms, uint32_t Count, float Step, QuantizedInstanceChunk& Out)
+	{
+		std::memset(&Out, 0, sizeof(Out));
+		Out.NumInstances = Count;
+		Out.Step = Step;
+		float Max[3] = { 0.0f, 0.0f, 0.0f };
+		bool bConstant = true;
+		bool bUniform = true;
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			const PackedTransform& Transform = Transforms[i];
+			for (int Axis = 0; Axis < 3; ++Axis)
+			{
+				const float P = Transform.Translation[Axis];
+				Out.Origin[Axis] = i == 0 || P < Out.Origin[Axis] ? P : Out.Origin[Axis];
+				Max[Axis] = i == 0 || P > Max[Axis] ? P : Max[Axis];
+				bConstant &= Transform.Scale3D[Axis] == Transforms[0].Scale3D[Axis];
+			}
+			bUniform &= Transform.Scale3D[0] == Transform.Scale3D[1] && Transform.Scale3D[0] == Transform.Scale3D[2];
+		}
+
+		double MaxSteps = 0.0;
+		for (int Axis = 0; Axis < 3; ++Axis)
+		{
+			const double Steps = (double(Max[Axis]) - Out.Origin[Axis]) / Step;
+			MaxSteps = Steps > MaxSteps ? Steps : MaxSteps;
+		}
+		Out.PositionBits = MaxSteps + 0.5 < 65535.0 ? 16 : 32;
+		Out.ScaleMode = uint8_t(bConstant ? EQuantizedScale::Constant : (bUniform ? EQuantizedScale::Uniform : EQuantizedScale::Full));
+		if (bConstant && Count > 0)
+			std::memcpy(Out.ConstantScale, Transforms[0].Scale3D, sizeof(Out.ConstantScale));
+		Out.RawSize = static_cast<uint32_t>(QuantizedChunkRawSize(Count, Out.PositionBits, Out.ScaleMode));
+	}
+
+	// Writes the raw payload of a prepared chunk, OutRaw holds Chunk.RawSize bytes.
+	inline void QuantizeChunk(const PackedTransform* Transforms, const QuantizedInstanceChunk& Chunk, uint8_t* OutRaw)
+	{
+		const uint32_t Count = Chunk.NumInstances;
+		uint8_t* Cursor = OutRaw;
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			for (int Axis = 0; Axis < 3; ++Axis)
+			{
+				// steps beyond 32 bits only happen with a Step far below the cvar minimum, they clamp
+				const double Steps = std::floor((double(Transforms[i].Translation[Axis]) - Chunk.Origin[Axis]) / Chunk.Step + 0.5);
+				const double Clamped = Steps < 0.0 ? 0.0 : (Steps > 4294967295.0 ? 4294967295.0 : Steps);
+				if (Chunk.PositionBits == 16)
+				{
+					const uint16_t Value = static_cast<uint16_t>(Clamped);
+					std::memcpy(Cursor, &Value, sizeof(Value));
+					Cursor += sizeof(Value);
+				}
+				else
+				{
+					const uint32_t Value = static_cast<uint32_t>(Clamped);
+					std::memcpy(Cursor, &Value, sizeof(Value));
+					Cursor += sizeof(Value);
+				}
+			}
+		}
+		if (Chunk.ScaleMode != uint8_t(EQuantizedScale::Constant))
+		{
+			const size_t ScaleBytes = Chunk.ScaleMode == uint8_t(EQuantizedScale::Full) ? 3 * sizeof(float) : sizeof(float);
+			for (uint32_t i = 0; i < Count; ++i)
+			{
+				std::memcpy(Cursor, Transforms[i].Scale3D, ScaleBytes);
+				Cursor += ScaleBytes;
+			}
+		}
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			uint16_t Rotation[3];
+			EncodeSmallestThree(Transforms[i].Rotation, Rotation);
+			std::memcpy(Cursor, Rotation, sizeof(Rotation));
+			Cursor += sizeof(Rotation);
+		}
+	}
+
+	// Inverse of QuantizeChunk, Raw holds Chunk.RawSize decompressed bytes, Out Chunk.NumInstances transforms.
+	inline void DequantizeChunk(const QuantizedInstanceChunk& Chunk, const uint8_t* Raw, PackedTransform* Out)
+	{
+		const uint32_t Count = Chunk.NumInstances;
+		const uint8_t* Cursor = Raw;
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			for (int Axis = 0; Axis < 3; ++Axis)
+			{
+				double Steps;
+				if (Chunk.PositionBits == 16)
+				{
+					uint16_t Value;
+					std::memcpy(&Value, Cursor, sizeof(Value));
+					Cursor += sizeof(Value);
+					Steps = Value;
+				}
+				else
+				{
+					uint32_t Value;
+					std::memcpy(&Value, Cursor, sizeof(Value));
+					Cursor += sizeof(Value);
+					Steps = Value;
+				}
+				Out[i].Translation[Axis] = static_cast<float>(Chunk.Origin[Axis] + Steps * Chunk.Step);
+			}
+		}
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			if (Chunk.ScaleMode == uint8_t(EQuantizedScale::Constant))
+			{
+				std::memcpy(Out[i].Scale3D, Chunk.ConstantScale, sizeof(Out[i].Scale3D));
+			}
+			else if (Chunk.ScaleMode == uint8_t(EQuantizedScale::Uniform))
+			{
+				float Scale;
+				std::memcpy(&Scale, Cursor, sizeof(Scale));
+				Cursor += sizeof(Scale);
+				Out[i].Scale3D[0] = Out[i].Scale3D[1] = Out[i].Scale3D[2] = Scale;
+			}
+			else
+			{
+				std::memcpy(Out[i].Scale3D, Cursor, sizeof(Out[i].Scale3D));
+				Cursor += sizeof(Out[i].Scale3D);
+			}
+		}
+		for (uint32_t i = 0; i < Count; ++i)
+		{
+			uint16_t Rotation[3];
+			std::memcpy(Rotation, Cursor, sizeof(Rotation));
+			Cursor += sizeof(Rotation);
+			DecodeSmallestThree(Rotation, Out[i].Rotation);
+		}
+	}
+
+	// Cooked BodySetup (Content/Physic/<Package>.pbody), written straight from the editor instead of a cooked
+	// package when ExportChaos.DirectBodySetups is on.
+	//   BodySetupFileHeader
+	//   BodyShapeRecord[ShapeCount]         at BodySetupFileHeader::ShapeTableOffset, AggGeom order: spheres, boxes, sphyls, tapered capsules, convexes
+	//   cooked geometry                     at CookedOffset, aligned to SectionAlignment: the cooked format data of the BodySetup
+	//                                       (convex and trimesh implicit objects), the bytes a cooked package holds as its bulk data
+	//   strings                             at StringsOffset, utf8, null terminated, offset 0 is the empty string
+	// The cooked geometry is engine serialized, only the EngineVersion that wrote it can load it.
+	constexpr uint32_t BodySetupFileMagic = 0x42504843; // "CHPB"
+	constexpr uint32_t BodySetupFileVersion = 1;
+
+	enum class EBodyShapeType : uint8_t
+	{
+		Sphere,
+		Box,
+		Sphyl,
+		TaperedCapsule,
+		Convex,
+	};
+
+	struct BodySetupFileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t ShapeCount;
+		uint32_t ShapeTableOffset;
+		uint64_t FileSize;
+		uint64_t CookedOffset;		// from the start of the file
+		uint64_t CookedSize;		// 0 when the BodySetup has no cooked geometry
+		uint32_t StringsOffset;
+		uint32_t StringsSize;
+		uint32_t CookedFormat;		// string, physics format name of the cooked geometry
+		uint32_t EngineVersion;		// string
+		uint32_t DefaultInstance;	// string, json of the FBodyInstance defaults
+		uint32_t PhysMaterial;		// string, object path, 0 when none
+		uint8_t CollisionTraceFlag;	// ECollisionTraceFlag
+		uint8_t PhysicsType;		// EPhysicsType
+		uint8_t DoubleSidedGeometry;
+		uint8_t Pad[5];
+	};
+
+	struct BodyShapeRecord
+	{
+		uint8_t Type;			// EBodyShapeType
+		uint8_t Pad[3];
+		uint32_t Index;			// index among the shapes of its type, for convexes also into the cooked convexes
+		float Center[3];
+		float Rotation[4];		// quat x,y,z,w
+		float Size[3];			// Sphere: radius / Box: X, Y, Z extents / Sphyl: radius, length / TaperedCapsule: radius0, radius1, length / Convex: scale
+	};
+
+	// Packed landscape collision (Content/Landscape/<Map>/<LandGuid>.ldata), written instead of one .data
+	// per collision component when ExportChaos.LandscapeArchive is on.
+	//   LandscapeArchiveHeader
+	//   LandscapeTileEntry[TileCount]       at LandscapeArchiveHeader::TileTableOffset, sorted by (SectionBaseY, SectionBaseX)
+	//   tile payloads                       raw CookedCollisionData, each at LandscapeTileEntry::Offset, aligned to SectionAlignment
+	constexpr uint32_t LandscapeArchiveMagic = 0x4C504843; // "CHPL"
+	constexpr uint32_t LandscapeArchiveVersion = 1;
+
+	struct LandscapeArchiveHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t TileCount;
+		uint32_t TileTableOffset;
+		uint64_t FileSize;
+	};
+
+	struct LandscapeTileEntry
+	{
+		int32_t SectionBaseX;
+		int32_t SectionBaseY;
+		uint32_t CompID;
+		uint32_t Pad;
+		uint64_t Offset;	// from the start of the file
+		uint64_t Size;		// payload size in bytes
+	};
+
+	// Order of the tile tables of .ldata and .lheight, for anything with SectionBaseX / SectionBaseY
+	// (LandscapeTileEntry, HeightTileEntry, the collision components the exporter sorts).
+	template<typename TileType>
+	bool LandscapeTileLess(const TileType& Tile, int32_t SectionBaseX, int32_t SectionBaseY)
+	{
+		return Tile.SectionBaseY < SectionBaseY || (Tile.SectionBaseY == SectionBaseY && Tile.SectionBaseX < SectionBaseX);
+	}
+
+	// Binary search of the sorted tile table, nullptr when the landscape has no collision at that section.
+	template<typename TileType>
+	const TileType* FindLandscapeTile(const TileType* Tiles, uint64_t TileCount, int32_t SectionBaseX, int32_t SectionBaseY)
+	{
+		uint64_t First = 0;
+		uint64_t Count = TileCount;
+		while (Count > 0)
+		{
+			const uint64_t Step = Count / 2;
+			if (LandscapeTileLess(Tiles[First + Step], SectionBaseX, SectionBaseY))
+			{
+				First += Step + 1;
+				Count -= Step + 1;
+			}
+			else
+			{
+				Count = Step;
+			}
+		}
+		if (First < TileCount && Tiles[First].SectionBaseX == SectionBaseX && Tiles[First].SectionBaseY == SectionBaseY)
+			return &Tiles[First];
+		return nullptr;
+	}
+
+	// Raw landscape collision heights (Content/Landscape/<Map>/<LandGuid>.lheight), written when
+	// ExportChaos.LandscapeHeights is on, for point height and ray queries without a physics heightfield.
+	//   LandscapeHeightsHeader
+	//   HeightTileEntry[TileCount]          at LandscapeHeightsHeader::TileTableOffset, sorted like LandscapeTileEntry
+	//   per tile, each aligned to SectionAlignment:
+	//     uint16_t Samples[(SizeQuads + 1)^2]                row major, x fastest
+	//     uint16_t SimpleSamples[(SimpleSizeQuads + 1)^2]    only when SimpleSizeQuads > 0
+	//     HeightMinMax Pyramid[]                              mip 0 is one cell per quad, every next mip halves the size (rounded up) down to 1x1
+	// A sample (x, y, h) is at (x * CollisionScale, y * CollisionScale, (h - LandscapeHeightZero) * LandscapeHeightScale)
+	// in component space, HeightTileEntry::Transform takes it to world space.
+	constexpr uint32_t LandscapeHeightsMagic = 0x48504843; // "CHPH"
+	constexpr uint32_t LandscapeHeightsVersion = 1;
+	constexpr uint16_t LandscapeHeightZero = 32768;
+	constexpr float LandscapeHeightScale = 1.0f / 128.0f;	// LANDSCAPE_ZSCALE
+
+	struct LandscapeHeightsHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t TileCount;
+		uint32_t TileTableOffset;
+		uint64_t FileSize;
+	};
+
+	struct HeightTileEntry
+	{
+		int32_t SectionBaseX;
+		int32_t SectionBaseY;
+		uint32_t CompID;
+		uint32_t SizeQuads;
+		uint32_t SimpleSizeQuads;	// 0 when the component has no simple collision
+		float CollisionScale;
+		uint32_t NumMips;
+		uint32_t Pad;
+		PackedTransform Transform;	// component to world
+		uint64_t SamplesOffset;		// from the start of the file
+		uint64_t SimpleSamplesOffset;	// 0 when SimpleSizeQuads is 0
+		uint64_t PyramidOffset;
+	};
+
+	struct HeightMinMax
+	{
+		uint16_t Min;
+		uint16_t Max;
+	};
+
+	inline uint32_t HeightPyramidMipSize(uint32_t SizeQuads, uint32_t Mip)
+	{
+		uint32_t Size = SizeQuads;
+		for (uint32_t i = 0; i < Mip; ++i)
+			Size = (Size + 1) / 2;
+		return Size;
+	}
+
+	inline uint32_t HeightPyramidNumMips(uint32_t SizeQuads)
+	{
+		uint32_t NumMips = 1;
+		for (uint32_t Size = SizeQuads; Size > 1; Size = (Size + 1) / 2)
+			NumMips++;
+		return NumMips;
+	}
+
+	// Index of the first cell of Mip in the pyramid.
+	inline uint64_t HeightPyramidMipOffset(uint32_t SizeQuads, uint32_t Mip)
+	{
+		uint64_t Offset = 0;
+		uint32_t Size = SizeQuads;
+		for (uint32_t i = 0; i < Mip; ++i)
+		{
+			Offset += uint64_t(Size) * Size;
+			Size = (Size + 1) / 2;
+		}
+		return Offset;
+	}
+
+	inline uint64_t HeightPyramidCellCount(uint32_t SizeQuads)
+	{
+		return HeightPyramidMipOffset(SizeQuads, HeightPyramidNumMips(SizeQuads));
+	}
+
+	// Surface height at tile sample coordinates (x, y in quads), in raw sample units.
+	// Each quad is split along its (x, y) - (x + 1, y + 1) diagonal like the landscape collision.
+	inline float SampleTileHeight(const uint16_t* Samples, uint32_t SizeQuads, float X, float Y)
+	{
+		const float Max = static_cast<float>(SizeQuads);
+		X = X < 0.0f ? 0.0f : (X > Max ? Max : X);
+		Y = Y < 0.0f ? 0.0f : (Y > Max ? Max : Y);
+		uint32_t X0 = static_cast<uint32_t>(X);
+		uint32_t Y0 = static_cast<uint32_t>(Y);
+		X0 = X0 >= SizeQuads ? SizeQuads - 1 : X0;
+		Y0 = Y0 >= SizeQuads ? SizeQuads - 1 : Y0;
+		const float FX = X - X0;
+		const float FY = Y - Y0;
+
+		const uint32_t Stride = SizeQuads + 1;
+		const float H00 = Samples[Y0 * Stride + X0];
+		const float H10 = Samples[Y0 * Stride + X0 + 1];
+		const float H01 = Samples[(Y0 + 1) * Stride + X0];
+		const float H11 = Samples[(Y0 + 1) * Stride + X0 + 1];
+		if (FX >= FY)
+			return H00 + FX * (H10 - H00) + FY * (H11 - H10);
+		return H00 + FY * (H01 - H00) + FX * (H11 - H01);
+	}
+
+	namespace Detail
+	{
+		inline bool RayTriangle(const float Start[3], const float Dir[3], const float A[3], const float B[3], const float C[3], float& InOutT)
+		{
+			const float E1[3] = { B[0] - A[0], B[1] - A[1], B[2] - A[2] };
+			const float E2[3] = { C[0] - A[0], C[1] - A[1], C[2] - A[2] };
+			const float P[3] = { Dir[1] * E2[2] - Dir[2] * E2[1], Dir[2] * E2[0] - Dir[0] * E2[2], Dir[0] * E2[1] - Dir[1] * E2[0] };
+			const float Det = E1[0] * P[0] + E1[1] * P[1] + E1[2] * P[2];
+			if (Det > -1e-12f && Det < 1e-12f)
+				return false;
+			const float InvDet = 1.0f / Det;
+			const float S[3] = { Start[0] - A[0], Start[1] - A[1], Start[2] - A[2] };
+			const float U = (S[0] * P[0] + S[1] * P[1] + S[2] * P[2]) * InvDet;
+			if (U < 0.0f || U > 1.0f)
+				return false;
+			const float Q[3] = { S[1] * E1[2] - S[2] * E1[1], S[2] * E1[0] - S[0] * E1[2], S[0] * E1[1] - S[1] * E1[0] };
+			const float V = (Dir[0] * Q[0] + Dir[1] * Q[1] + Dir[2] * Q[2]) * InvDet;
+			if (V < 0.0f || U + V > 1.0f)
+				return false;
+			const float T = (E2[0] * Q[0] + E2[1] * Q[1] + E2[2] * Q[2]) * InvDet;
+			if (T < 0.0f || T > InOutT)
+				return false;
+			InOutT = T;
+			return true;
+		}
+
+		// Segment Start + t * Dir against an axis aligned box, clips [T0, T1].
+		inline bool ClipSegmentToBox(const float Start[3], const float Dir[3], const float Min[3], const float Max[3], float& T0, float& T1)
+		{
+			for (int Axis = 0; Axis < 3; ++Axis)
+			{
+				if (Dir[Axis] == 0.0f)
+				{
+					if (Start[Axis] < Min[Axis] || Start[Axis] > Max[Axis])
+						return false;
+					continue;
+				}
+				const float Inv = 1.0f / Dir[Axis];
+				float Near = (Min[Axis] - Start[Axis]) * Inv;
+				float Far = (Max[Axis] - Start[Axis]) * Inv;
+				if (Near > Far)
+				{
+					const float Tmp = Near;
+					Near = Far;
+					Far = Tmp;
+				}
+				T0 = Near > T0 ? Near : T0;
+				T1 = Far < T1 ? Far : T1;
+				if (T0 > T1)
+					return false;
+			}
+			return true;
+		}
+	}
+
+	// First hit of the segment Start + t * Dir, t in [0, 1], with the tile surface, in tile sample space
+	// (x, y in quads, z in raw sample units). Walks the min/max pyramid down from its 1x1 top mip and only
+	// opens the cells whose box the segment crosses, so a query costs about O(log SizeQuads) cells.
+	inline bool RaycastTileHeights(const uint16_t* Samples, const HeightMinMax* Pyramid, uint32_t SizeQuads, const float Start[3], const float Dir[3], float& OutT)
+	{
+		struct FCell
+		{
+			uint32_t Mip;
+			uint32_t X;
+			uint32_t Y;
+		};
+		FCell Stack[128];
+		uint32_t StackSize = 0;
+		Stack[StackSize++] = { HeightPyramidNumMips(SizeQuads) - 1, 0, 0 };
+
+		const uint32_t Stride = SizeQuads + 1;
+		float BestT = 1.0f;
+		bool bHit = false;
+		while (StackSize > 0)
+		{
+			const FCell Cell = Stack[--StackSize];
+			const HeightMinMax& Range = Pyramid[HeightPyramidMipOffset(SizeQuads, Cell.Mip) + uint64_t(Cell.Y) * HeightPyramidMipSize(SizeQuads, Cell.Mip) + Cell.X];
+			const uint32_t CellQuads = 1u << Cell.Mip;
+			const uint32_t X0 = Cell.X * CellQuads;
+			const uint32_t Y0 = Cell.Y * CellQuads;
+			const uint32_t X1 = X0 + CellQuads < SizeQuads ? X0 + CellQuads : SizeQuads;
+			const uint32_t Y1 = Y0 + CellQuads < SizeQuads ? Y0 + CellQuads : SizeQuads;
+			const float BoxMin[3] = { float(X0), float(Y0), float(Range.Min) };
+			const float BoxMax[3] = { float(X1), float(Y1), float(Range.Max) };
+			float T0 = 0.0f;
+			float T1 = BestT;
+			if (!Detail::ClipSegmentToBox(Start, Dir, BoxMin, BoxMax, T0, T1))
+				continue;
+
+			if (Cell.Mip == 0)
+			{
+				const float P00[3] = { float(X0), float(Y0), float(Samples[Y0 * Stride + X0]) };
+				const float P10[3] = { float(X1), float(Y0), float(Samples[Y0 * Stride + X1]) };
+				const float P01[3] = { float(X0), float(Y1), float(Samples[Y1 * Stride + X0]) };
+				const float P11[3] = { float(X1), float(Y1), float(Samples[Y1 * Stride + X1]) };
+				bHit |= Detail::RayTriangle(Start, Dir, P00, P10, P11, BestT);
+				bHit |= Detail::RayTriangle(Start, Dir, P00, P11, P01, BestT);
+				continue;
+			}
+
+			const uint32_t ChildSize = HeightPyramidMipSize(SizeQuads, Cell.Mip - 1);
+			for (uint32_t Child = 0; Child < 4; ++Child)
+			{
+				const uint32_t ChildX = Cell.X * 2 + (Child & 1);
+				const uint32_t ChildY = Cell.Y * 2 + (Child >> 1);
+				if (ChildX < ChildSize && ChildY < ChildSize)
+					Stack[StackSize++] = { Cell.Mip - 1, ChildX, ChildY };
+			}
+		}
+		if (bHit)
+			OutT = BestT;
+		return bHit;
+	}
+
+	static_assert(sizeof(SceneHeader) == 24, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(SectionEntry) == 32, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(PackedTransform) == 40, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(BodySetupRecord) == 44, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(BodyRecord) == 64, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(CollisionLODRecord) == 40, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(CollisionLODVertex) == 12, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(InstancedBodyRecord) == 72, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(StaticAggregateRecord) == 60, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(ConstraintRecord) == 60, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(ConstraintIslandRecord) == 16, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(PhysicFieldRecord) == 68, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(LandscapeRecord) == 116, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(LandscapeCollisionRecord) == 88, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(BVHNode) == 32, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(StaticBVHPrim) == 8, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(QuantizedInstanceChunk) == 56, "ChaosScene layout changed, bump Version");
+	static_assert(sizeof(BodySetupFileHeader) == 72, "BodySetup file layout changed, bump BodySetupFileVersion");
+	static_assert(sizeof(BodyShapeRecord) == 48, "BodySetup file layout changed, bump BodySetupFileVersion");
+	static_assert(sizeof(LandscapeArchiveHeader) == 24, "landscape archive layout changed, bump LandscapeArchiveVersion");
+	static_assert(sizeof(LandscapeTileEntry) == 32, "landscape archive layout changed, bump LandscapeArchiveVersion");
+	static_assert(sizeof(LandscapeHeightsHeader) == 24, "landscape heights layout changed, bump LandscapeHeightsVersion");
+	static_assert(sizeof(HeightTileEntry) == 96, "landscape heights layout changed, bump LandscapeHeightsVersion");
+	static_assert(sizeof(HeightMinMax) == 4, "landscape heights layout changed, bump LandscapeHeightsVersion");
+}
@@ -0,0 +1,181 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+// Load benchmark of the server side scene reader, no Unreal dependency, Linux only:
+//
+//   g++ -O2 -std=c++17 SceneReader/ChaosSceneBench.cpp -o chaos_scene_bench -lz
+//   ./chaos_scene_bench [-iterations=N] Map.pscene [<Package>.pbody ...] [<LandGuid>.ldata ...] [<LandGuid>.lheight ...]
+//
+// Every file is opened (mapped and validated) and swept N times; a .pscene is also converted with
+// BuildSceneSoA. Prints the best and average time per file and the memory the process needed.
+
+#include "ChaosSceneReader.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	// VmRSS / VmHWM of this process in KiB
+	uint64_t ReadProcStatus(const char* Key)
+	{
+		std::ifstream Status("/proc/self/status");
+		std::string Line;
+		const size_t KeyLen = std::strlen(Key);
+		while (std::getline(Status, Line))
+		{
+			if (Line.compare(0, KeyLen, Key) == 0 && Line.size() > KeyLen && Line[KeyLen] == ':')
+				return std::strtoull(Line.c_str() + KeyLen + 1, nullptr, 10);
+		}
+		return 0;
+	}
+
+	bool EndsWith(const std::string& Str, const char* Suffix)
+	{
+		const size_t Len = std::strlen(Suffix);
+		return Str.size() >= Len && Str.compare(Str.size() - Len, Len, Suffix) == 0;
+	}
+
+	// Something every record contributes to, so the sweep is not optimized away.
+	struct FChecksum
+	{
+		double Sum = 0.0;
+		void Add(const ChaosScene::PackedTransform& Transform) { Sum += Transform.Translation[0] + Transform.Translation[1] + Transform.Translation[2]; }
+	};
+
+	bool LoadScene(const char* Path, FChecksum& Checksum, uint64_t& OutBytes, uint64_t& OutSoABytes, std::string& OutError)
+	{
+		ChaosScene::SceneFile Scene;
+		if (!Scene.Open(Path, OutError))
+			return false;
+
+		for (const ChaosScene::BodySetupRecord& BodySetup : Scene.BodySetups())
+			Checksum.Sum += std::strlen(Scene.String(BodySetup.Package));
+		for (const ChaosScene::ConstraintRecord& Constraint : Scene.Constraints())
+			Checksum.Add(Constraint.Transform);
+		for (const ChaosScene::BodyRecord& Shape : Scene.AggregateShapes())
+			Checksum.Add(Shape.Transform);
+		for (const ChaosScene::LandscapeCollisionRecord& Collision : Scene.LandscapeCollisions())
+			Checksum.Add(Collision.Transform);
+
+		ChaosScene::SceneSoA SoA;
+		if (!ChaosScene::BuildSceneSoA(Scene, SoA, OutError))
+			return false;
+		for (size_t i = 0; i < SoA.Instances.Size(); ++i)
+			Checksum.Sum += SoA.Instances.TZ[i];
+		for (size_t i = 0; i < SoA.Bodies.Size(); ++i)
+			Checksum.Sum += SoA.Bodies.TZ[i];
+
+		OutBytes = Scene.Mapping().Size();
+		OutSoABytes = SoA.MemorySize();
+		return true;
+	}
+
+	bool LoadBodySetup(const char* Path, FChecksum& Checksum, uint64_t& OutBytes, std::string& OutError)
+	{
+		ChaosScene::BodySetupFile BodySetup;
+		if (!BodySetup.Open(Path, OutError))
+			return false;
+		for (const ChaosScene::BodyShapeRecord& Shape : BodySetup.Shapes())
+			Checksum.Sum += Shape.Center[0] + Shape.Size[0];
+		Checksum.Sum += BodySetup.CookedData().Count + std::strlen(BodySetup.CookedFormat());
+		OutBytes = BodySetup.Mapping().Size();
+		return true;
+	}
+
+	bool LoadArchive(const char* Path, FChecksum& Checksum, uint64_t& OutBytes, std::string& OutError)
+	{
+		ChaosScene::LandscapeArchiveFile Archive;
+		if (!Archive.Open(Path, OutError))
+			return false;
+		for (const ChaosScene::LandscapeTileEntry& Tile : Archive.Tiles())
+		{
+			// the server hands each payload to its heightfield, reading the first and last byte stands in for that
+			if (Tile.Size > 0)
+				Checksum.Sum += Archive.TileData(Tile)[0] + Archive.TileData(Tile)[Tile.Size - 1];
+			Checksum.Sum += Archive.FindTile(Tile.SectionBaseX, Tile.SectionBaseY) == &Tile;
+		}
+		OutBytes = Archive.Mapping().Size();
+		return true;
+	}
+
+	bool LoadHeights(const char* Path, FChecksum& Checksum, uint64_t& OutBytes, std::string& OutError)
+	{
+		ChaosScene::LandscapeHeightsFile Heights;
+		if (!Heights.Open(Path, OutError))
+			return false;
+		for (const ChaosScene::HeightTileEntry& Tile : Heights.Tiles())
+		{
+			const float Center = Tile.SizeQuads * 0.5f;
+			Checksum.Sum += ChaosScene::SampleTileHeight(Heights.Samples(Tile), Tile.SizeQuads, Center, Center);
+			Checksum.Sum += Heights.Pyramid(Tile)[ChaosScene::HeightPyramidCellCount(Tile.SizeQuads) - 1].Max;
+		}
+		OutBytes = Heights.Mapping().Size();
+		return true;
+	}
+}
+
+int main(int Argc, char** Argv)
+{
+	int Iterations = 10;
+	std::vector<std::string> Files;
+	for (int i = 1; i < Argc; ++i)
+	{
+		if (std::strncmp(Argv[i], "-iterations=", 12) == 0)
+			Iterations = std::max(1, std::atoi(Argv[i] + 12));
+		else
+			Files.emplace_back(Argv[i]);
+	}
+	if (Files.empty())
+	{
+		std::fprintf(stderr, "usage: %s [-iterations=N] <Map.pscene | .pbody | .ldata | .lheight>...\n", Argv[0]);
+		return 1;
+	}
+
+	FChecksum Checksum;
+	int NumFailed = 0;
+	for (const std::string& File : Files)
+	{
+		const uint64_t RssBefore = ReadProcStatus("VmRSS");
+		double BestMs = 1e30;
+		double TotalMs = 0.0;
+		uint64_t Bytes = 0;
+		uint64_t SoABytes = 0;
+		std::string Error;
+		bool bLoaded = true;
+		for (int Iteration = 0; Iteration < Iterations && bLoaded; ++Iteration)
+		{
+			const Clock::time_point Start = Clock::now();
+			if (EndsWith(File, ".pscene"))
+				bLoaded = LoadScene(File.c_str(), Checksum, Bytes, SoABytes, Error);
+			else if (EndsWith(File, ".pbody"))
+				bLoaded = LoadBodySetup(File.c_str(), Checksum, Bytes, Error);
+			else if (EndsWith(File, ".ldata"))
+				bLoaded = LoadArchive(File.c_str(), Checksum, Bytes, Error);
+			else if (EndsWith(File, ".lheight"))
+				bLoaded = LoadHeights(File.c_str(), Checksum, Bytes, Error);
+			else
+				bLoaded = ChaosScene::Detail::Fail(Error, File + ": unknown file type");
+			const double Ms = std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+			BestMs = std::min(BestMs, Ms);
+			TotalMs += Ms;
+		}
+		if (!bLoaded)
+		{
+			std::fprintf(stderr, "%s\n", Error.c_str());
+			NumFailed++;
+			continue;
+		}
+
+		// the first iteration pays the page faults of a cold mapping, the best one shows the warm cost
+		std::printf("%s: %.2f MB, best %.3f ms, avg %.3f ms over %d, SoA %.2f MB, rss +%.2f MB\n", File.c_str(), Bytes / 1048576.0, BestMs, TotalMs / Iterations,
+			Iterations, SoABytes / 1048576.0, (ReadProcStatus("VmRSS") - RssBefore) / 1024.0);
+	}
+
+	std::printf("peak rss %.2f MB (checksum %g)\n", ReadProcStatus("VmHWM") / 1024.0, Checksum.Sum);
+	return NumFailed == 0 ? 0 : 1;
+}
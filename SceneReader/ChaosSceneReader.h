@@ -0,0 +1,698 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+#pragma once
+
+// Reader for the exported physics scene on the server side, no Unreal dependency, Linux only (mmap),
+// needs zlib (-lz) for compressed quantized instances. Header only, so it is not part of the editor module build:
+//
+//   #include "SceneReader/ChaosSceneReader.h"
+//
+//   ChaosScene::SceneFile Scene;
+//   std::string Error;
+//   if (!Scene.Open("PhysicScene/Map.pscene", Error)) ...
+//   for (const ChaosScene::BodyRecord& Body : Scene.StaticMeshBodies()) ...
+//
+// SceneFile, BodySetupFile, LandscapeArchiveFile and LandscapeHeightsFile map the file read only and hand out spans into
+// the mapping, nothing is copied or parsed; Open validates the whole layout once so the spans can be indexed
+// without further checks. BuildSceneSoA copies the body and instance transforms into struct of arrays form
+// for code that sweeps over all of them, DecodeInstances gives the instances of either encoding as PackedTransforms.
+// The .pscene is written when ExportChaos.BinaryScene (or ExportChaos.StaticBVH) is on and holds the same
+// records as the PhysicScene json, so readers of the json can move over without losing anything.
+// ChaosSceneTest.cpp round trips every file type through this reader, run it after changing the format.
+
+#include "../ExportChaosSceneFormat.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace ChaosScene
+{
+	template<typename T>
+	struct Span
+	{
+		const T* Data = nullptr;
+		uint64_t Count = 0;
+
+		const T& operator[](uint64_t Index) const { return Data[Index]; }
+		const T* begin() const { return Data; }
+		const T* end() const { return Data + Count; }
+		bool empty() const { return Count == 0; }
+	};
+
+	// Read only mapping of a whole file.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() { Close(); }
+
+		bool Open(const char* Path, std::string& OutError)
+		{
+			Close();
+			const int Fd = ::open(Path, O_RDONLY | O_CLOEXEC);
+			if (Fd < 0)
+			{
+				OutError = std::string("cannot open ") + Path;
+				return false;
+			}
+			struct stat Stat;
+			if (::fstat(Fd, &Stat) != 0 || Stat.st_size <= 0)
+			{
+				::close(Fd);
+				OutError = std::string("cannot stat or empty file ") + Path;
+				return false;
+			}
+			void* Mapping = ::mmap(nullptr, static_cast<size_t>(Stat.st_size), PROT_READ, MAP_PRIVATE, Fd, 0);
+			::close(Fd);
+			if (Mapping == MAP_FAILED)
+			{
+				OutError = std::string("cannot map ") + Path;
+				return false;
+			}
+			Bytes = static_cast<const uint8_t*>(Mapping);
+			NumBytes = static_cast<uint64_t>(Stat.st_size);
+			return true;
+		}
+
+		void Close()
+		{
+			if (Bytes != nullptr)
+				::munmap(const_cast<uint8_t*>(Bytes), static_cast<size_t>(NumBytes));
+			Bytes = nullptr;
+			NumBytes = 0;
+		}
+
+		// Tells the kernel the whole file is read soon, the first sweep then does not fault page by page.
+		void WillNeed() const
+		{
+			if (Bytes != nullptr)
+				::madvise(const_cast<uint8_t*>(Bytes), static_cast<size_t>(NumBytes), MADV_WILLNEED);
+		}
+
+		const uint8_t* Data() const { return Bytes; }
+		uint64_t Size() const { return NumBytes; }
+
+	private:
+		const uint8_t* Bytes = nullptr;
+		uint64_t NumBytes = 0;
+	};
+
+	namespace Detail
+	{
+		inline bool Fail(std::string& OutError, std::string Message)
+		{
+			OutError = std::move(Message);
+			return false;
+		}
+
+		inline bool InFile(uint64_t Offset, uint64_t Size, uint64_t FileSize)
+		{
+			return Offset <= FileSize && Size <= FileSize - Offset;
+		}
+
+		inline bool InRange(uint32_t First, uint32_t Num, uint64_t Count)
+		{
+			return uint64_t(First) + Num <= Count;
+		}
+	}
+
+	// <Map>.pscene
+	class SceneFile
+	{
+	public:
+		bool Open(const char* Path, std::string& OutError)
+		{
+			std::fill(std::begin(SectionTable), std::end(SectionTable), nullptr);
+			if (!File.Open(Path, OutError))
+				return false;
+			if (!Validate(OutError))
+			{
+				OutError = std::string(Path) + ": " + OutError;
+				File.Close();
+				return false;
+			}
+			return true;
+		}
+
+		const SceneHeader& Header() const { return *reinterpret_cast<const SceneHeader*>(File.Data()); }
+		const MappedFile& Mapping() const { return File; }
+
+		// Offsets stored in the records, 0 is the empty string.
+		const char* String(uint32_t Offset) const
+		{
+			const Span<char> Strings = Section<char>(ESection::Strings);
+			return Offset < Strings.Count ? Strings.Data + Offset : "";
+		}
+
+		Span<BodySetupRecord> BodySetups() const { return Section<BodySetupRecord>(ESection::BodySetups); }
+		Span<BodyRecord> StaticMeshBodies() const { return Section<BodyRecord>(ESection::StaticMeshBodies); }
+		Span<InstancedBodyRecord> InstancedBodies() const { return Section<InstancedBodyRecord>(ESection::InstancedBodies); }
+		Span<PackedTransform> InstanceTransforms() const { return Section<PackedTransform>(ESection::InstanceTransforms); }
+		Span<ConstraintRecord> Constraints() const { return Section<ConstraintRecord>(ESection::Constraints); }
+		Span<PhysicFieldRecord> PhysicFields() const { return Section<PhysicFieldRecord>(ESection::PhysicFields); }
+		Span<LandscapeRecord> Landscapes() const { return Section<LandscapeRecord>(ESection::Landscapes); }
+		Span<LandscapeCollisionRecord> LandscapeCollisions() const { return Section<LandscapeCollisionRecord>(ESection::LandscapeCollisions); }
+		Span<BVHNode> StaticBVHNodes() const { return Section<BVHNode>(ESection::StaticBVHNodes); }
+		Span<StaticBVHPrim> StaticBVHPrims() const { return Section<StaticBVHPrim>(ESection::StaticBVHPrims); }
+		Span<QuantizedInstanceChunk> QuantizedInstanceChunks() const { return Section<QuantizedInstanceChunk>(ESection::QuantizedInstanceChunks); }
+		Span<StaticAggregateRecord> StaticAggregates() const { return Section<StaticAggregateRecord>(ESection::StaticAggregates); }
+		Span<BodyRecord> AggregateShapes() const { return Section<BodyRecord>(ESection::AggregateShapes); }
+		Span<CollisionLODRecord> CollisionLODs() const { return Section<CollisionLODRecord>(ESection::CollisionLODs); }
+		Span<CollisionLODVertex> CollisionLODVertices() const { return Section<CollisionLODVertex>(ESection::CollisionLODVertices); }
+
+		Span<ConstraintIslandRecord> ConstraintIslands() const { return Section<ConstraintIslandRecord>(ESection::ConstraintIslands); }
+		Span<uint32_t> IslandBodies() const { return Section<uint32_t>(ESection::IslandBodies); }
+		Span<uint32_t> IslandConstraints() const { return Section<uint32_t>(ESection::IslandConstraints); }
+
+		// Condensed json of FConstraintProfileProperties, "" when the constraint has none.
+		const char* ConstraintProfile(const ConstraintRecord& Constraint) const
+		{
+			const Span<uint32_t> Profiles = Section<uint32_t>(ESection::ConstraintProfiles);
+			return Constraint.Profile < Profiles.Count ? String(Profiles[Constraint.Profile]) : "";
+		}
+
+		// Override set of a body, decoded with ForEachBodyOverride.
+		const uint32_t* BodyOverrides(const BodyRecord& Body) const
+		{
+			static const uint32_t Empty[2] = {};
+			const Span<uint32_t> Words = Section<uint32_t>(ESection::BodyOverrides);
+			return Words.empty() ? Empty : Words.Data + Body.Overrides;
+		}
+
+		// Instances of the InstanceTransforms section, or of the quantized chunks when the scene was exported with those.
+		uint64_t NumInstances() const
+		{
+			const Span<QuantizedInstanceChunk> Chunks = QuantizedInstanceChunks();
+			return Chunks.empty() ? InstanceTransforms().Count : uint64_t(Chunks[Chunks.Count - 1].FirstInstance) + Chunks[Chunks.Count - 1].NumInstances;
+		}
+
+		// Stored payload of a chunk, Chunk.DataSize bytes.
+		const uint8_t* ChunkData(const QuantizedInstanceChunk& Chunk) const
+		{
+			return Section<uint8_t>(ESection::QuantizedInstanceData).Data + Chunk.DataOffset;
+		}
+
+		// All instances as PackedTransforms, copied or dequantized. Fails only on a corrupt compressed chunk.
+		bool DecodeInstances(std::vector<PackedTransform>& Out, std::string& OutError) const
+		{
+			const Span<QuantizedInstanceChunk> Chunks = QuantizedInstanceChunks();
+			if (Chunks.empty())
+			{
+				Out.assign(InstanceTransforms().begin(), InstanceTransforms().end());
+				return true;
+			}
+			Out.resize(NumInstances());
+			std::vector<uint8_t> Raw;
+			for (const QuantizedInstanceChunk& Chunk : Chunks)
+			{
+				const uint8_t* Data = ChunkData(Chunk);
+				if (Chunk.Codec == uint8_t(ECodec::Zlib))
+				{
+					Raw.resize(Chunk.RawSize);
+					uLongf RawSize = Chunk.RawSize;
+					if (::uncompress(Raw.data(), &RawSize, Data, Chunk.DataSize) != Z_OK || RawSize != Chunk.RawSize)
+						return Detail::Fail(OutError, "corrupt quantized chunk at instance " + std::to_string(Chunk.FirstInstance));
+					Data = Raw.data();
+				}
+				DequantizeChunk(Chunk, Data, Out.data() + Chunk.FirstInstance);
+			}
+			return true;
+		}
+
+	private:
+		static constexpr uint32_t NumSections = static_cast<uint32_t>(ESection::Count);
+
+		template<typename T>
+		Span<T> Section(ESection Type) const
+		{
+			const SectionEntry* Entry = SectionTable[static_cast<uint32_t>(Type)];
+			if (Entry == nullptr)
+				return {};
+			return { reinterpret_cast<const T*>(File.Data() + Entry->Offset), Entry->Count };
+		}
+
+		static uint32_t ExpectedStride(uint32_t Type)
+		{
+			static const uint32_t Strides[NumSections] = {
+				1,
+				sizeof(BodySetupRecord),
+				sizeof(BodyRecord),
+				sizeof(InstancedBodyRecord),
+				sizeof(PackedTransform),
+				sizeof(ConstraintRecord),
+				sizeof(PhysicFieldRecord),
+				sizeof(LandscapeRecord),
+				sizeof(LandscapeCollisionRecord),
+				sizeof(BVHNode),
+				sizeof(StaticBVHPrim),
+				sizeof(QuantizedInstanceChunk),
+				1,
+				sizeof(StaticAggregateRecord),
+				sizeof(BodyRecord),
+				sizeof(CollisionLODRecord),
+				sizeof(CollisionLODVertex),
+				sizeof(uint32_t),
+				sizeof(uint32_t),
+				sizeof(ConstraintIslandRecord),
+				sizeof(uint32_t),
+				sizeof(uint32_t),
+			};
+			return Strides[Type];
+		}
+
+		bool Validate(std::string& OutError)
+		{
+			const uint64_t FileSize = File.Size();
+			if (FileSize < sizeof(SceneHeader))
+				return Detail::Fail(OutError, "truncated header");
+			const SceneHeader& H = Header();
+			if (H.Magic != Magic)
+				return Detail::Fail(OutError, "not a PhysicScene binary");
+			// older files lack the sections added since, those read as empty
+			if (H.Version < MinVersion || H.Version > Version)
+				return Detail::Fail(OutError, "unsupported version " + std::to_string(H.Version));
+			if (H.FileSize != FileSize)
+				return Detail::Fail(OutError, "file size does not match the header");
+			if (!Detail::InFile(H.SectionTableOffset, uint64_t(H.SectionCount) * sizeof(SectionEntry), FileSize) || H.SectionTableOffset % alignof(SectionEntry) != 0)
+				return Detail::Fail(OutError, "section table out of the file");
+
+			const SectionEntry* Entries = reinterpret_cast<const SectionEntry*>(File.Data() + H.SectionTableOffset);
+			for (uint32_t i = 0; i < H.SectionCount; ++i)
+			{
+				const SectionEntry& Entry = Entries[i];
+				// sections of a newer writer this reader does not know about are skipped
+				if (Entry.Type >= NumSections)
+					continue;
+				if (!Detail::InFile(Entry.Offset, Entry.Size, FileSize) || Entry.Offset % SectionAlignment != 0)
+					return Detail::Fail(OutError, "section " + std::to_string(Entry.Type) + " out of the file");
+				// Count <= Size <= FileSize, the product can not overflow
+				if (Entry.Stride != ExpectedStride(Entry.Type) || Entry.Count > Entry.Size || Entry.Count * Entry.Stride != Entry.Size)
+					return Detail::Fail(OutError, "bad record size in section " + std::to_string(Entry.Type));
+				SectionTable[Entry.Type] = &Entry;
+			}
+
+			const Span<char> Strings = Section<char>(ESection::Strings);
+			if (Strings.Count > 0 && Strings[Strings.Count - 1] != 0)
+				return Detail::Fail(OutError, "unterminated string table");
+
+			// the chunks cover the instances in order, each payload decodes to exactly its instances
+			uint64_t NextInstance = 0;
+			const uint64_t DataSize = Section<uint8_t>(ESection::QuantizedInstanceData).Count;
+			for (const QuantizedInstanceChunk& Chunk : QuantizedInstanceChunks())
+			{
+				const bool bValid = Chunk.FirstInstance == NextInstance && (Chunk.PositionBits == 16 || Chunk.PositionBits == 32)
+					&& Chunk.ScaleMode <= uint8_t(EQuantizedScale::Full) && Chunk.Codec <= uint8_t(ECodec::Zlib) && Chunk.Step > 0.0f
+					&& Chunk.RawSize == QuantizedChunkRawSize(Chunk.NumInstances, Chunk.PositionBits, Chunk.ScaleMode)
+					&& (Chunk.Codec != uint8_t(ECodec::None) || Chunk.DataSize == Chunk.RawSize)
+					&& Detail::InFile(Chunk.DataOffset, Chunk.DataSize, DataSize);
+				if (!bValid)
+					return Detail::Fail(OutError, "bad quantized chunk at instance " + std::to_string(NextInstance));
+				NextInstance += Chunk.NumInstances;
+			}
+			if (!QuantizedInstanceChunks().empty() && !InstanceTransforms().empty())
+				return Detail::Fail(OutError, "both InstanceTransforms and quantized instances");
+
+			// cross references, so callers can index without checks
+			for (const BodySetupRecord& BodySetup : BodySetups())
+			{
+				if (!Detail::InRange(BodySetup.FirstStaticMesh, BodySetup.NumStaticMesh, StaticMeshBodies().Count) || !Detail::InRange(BodySetup.FirstInstanced, BodySetup.NumInstanced, InstancedBodies().Count))
+					return Detail::Fail(OutError, "BodySetup body range out of the file");
+			}
+			for (const BodyRecord& Body : StaticMeshBodies())
+			{
+				if (Body.BodySetup >= BodySetups().Count || !ValidOverrides(Body))
+					return Detail::Fail(OutError, "StaticMesh body out of the file");
+			}
+			for (const InstancedBodyRecord& Body : InstancedBodies())
+			{
+				if (Body.Body.BodySetup >= BodySetups().Count || !ValidOverrides(Body.Body) || !Detail::InRange(Body.FirstInstance, Body.NumInstances, NumInstances()))
+					return Detail::Fail(OutError, "instanced body out of the file");
+			}
+			for (const ConstraintRecord& Constraint : Constraints())
+			{
+				if (Constraint.Profile != InvalidIndex && Constraint.Profile >= Section<uint32_t>(ESection::ConstraintProfiles).Count)
+					return Detail::Fail(OutError, "constraint profile out of the file");
+			}
+			for (const ConstraintIslandRecord& Island : ConstraintIslands())
+			{
+				if (!Detail::InRange(Island.FirstBody, Island.NumBodies, IslandBodies().Count) || !Detail::InRange(Island.FirstConstraint, Island.NumConstraints, IslandConstraints().Count))
+					return Detail::Fail(OutError, "constraint island out of the file");
+			}
+			for (const uint32_t Constraint : IslandConstraints())
+			{
+				if (Constraint >= Constraints().Count)
+					return Detail::Fail(OutError, "island constraint out of the file");
+			}
+			for (const StaticAggregateRecord& Aggregate : StaticAggregates())
+			{
+				if (!Detail::InRange(Aggregate.FirstShape, Aggregate.NumShapes, AggregateShapes().Count))
+					return Detail::Fail(OutError, "aggregate shape range out of the file");
+			}
+			for (const BodyRecord& Shape : AggregateShapes())
+			{
+				if (Shape.BodySetup >= BodySetups().Count || !ValidOverrides(Shape))
+					return Detail::Fail(OutError, "aggregate shape out of the file");
+			}
+			for (const CollisionLODRecord& LOD : CollisionLODs())
+			{
+				if (LOD.BodySetup >= BodySetups().Count || LOD.Type > uint8_t(ECollisionLOD::Hull) || !Detail::InRange(LOD.FirstVertex, LOD.NumVertices, CollisionLODVertices().Count))
+					return Detail::Fail(OutError, "collision LOD out of the file");
+			}
+			for (const LandscapeRecord& Landscape : Landscapes())
+			{
+				if (!Detail::InRange(Landscape.FirstCollision, Landscape.NumCollisions, LandscapeCollisions().Count))
+					return Detail::Fail(OutError, "landscape collision range out of the file");
+			}
+			const uint64_t NumNodes = StaticBVHNodes().Count;
+			for (const BVHNode& Node : StaticBVHNodes())
+			{
+				if (Node.Count > 0 ? !Detail::InRange(Node.First, Node.Count, StaticBVHPrims().Count) : Node.First >= NumNodes)
+					return Detail::Fail(OutError, "BVH node out of the file");
+			}
+			for (const StaticBVHPrim& Prim : StaticBVHPrims())
+			{
+				const bool bValid = Prim.Instance == InvalidIndex ? Prim.Body < StaticMeshBodies().Count
+					: Prim.Instance == AggregatePrim ? Prim.Body < StaticAggregates().Count
+					: Prim.Body < InstancedBodies().Count && Prim.Instance < NumInstances();
+				if (!bValid)
+					return Detail::Fail(OutError, "BVH prim out of the file");
+			}
+			return true;
+		}
+
+		// the whole set lies in the section and only uses known fields
+		bool ValidOverrides(const BodyRecord& Body) const
+		{
+			const Span<uint32_t> Words = Section<uint32_t>(ESection::BodyOverrides);
+			if (Words.empty())
+				return Body.Overrides == 0;
+			if (!Detail::InRange(Body.Overrides, 2, Words.Count))
+				return false;
+			const uint32_t Mask = Words[Body.Overrides];
+			return (BodyOverrideFieldCount == 32 || (Mask >> BodyOverrideFieldCount) == 0) && Detail::InRange(Body.Overrides, BodyOverrideWords(Mask), Words.Count);
+		}
+
+		MappedFile File;
+		const SectionEntry* SectionTable[NumSections] = {};
+	};
+
+	// Transforms as one array per component, for sweeps that only touch a few of them.
+	struct TransformSoA
+	{
+		std::vector<float> TX, TY, TZ;
+		std::vector<float> QX, QY, QZ, QW;
+		std::vector<float> SX, SY, SZ;
+
+		void Resize(size_t Count)
+		{
+			for (std::vector<float>* Array : { &TX, &TY, &TZ, &QX, &QY, &QZ, &QW, &SX, &SY, &SZ })
+				Array->resize(Count);
+		}
+
+		void Set(size_t Index, const PackedTransform& Transform)
+		{
+			TX[Index] = Transform.Translation[0];
+			TY[Index] = Transform.Translation[1];
+			TZ[Index] = Transform.Translation[2];
+			QX[Index] = Transform.Rotation[0];
+			QY[Index] = Transform.Rotation[1];
+			QZ[Index] = Transform.Rotation[2];
+			QW[Index] = Transform.Rotation[3];
+			SX[Index] = Transform.Scale3D[0];
+			SY[Index] = Transform.Scale3D[1];
+			SZ[Index] = Transform.Scale3D[2];
+		}
+
+		size_t Size() const { return TX.size(); }
+		uint64_t MemorySize() const { return uint64_t(TX.capacity()) * 10 * sizeof(float); }
+	};
+
+	// StaticMeshBodies and the instances in struct of arrays form, in record order.
+	struct SceneSoA
+	{
+		TransformSoA Bodies;
+		std::vector<uint32_t> BodyBodySetup;
+		std::vector<uint32_t> BodyFlags;
+
+		TransformSoA Instances;			// instance to world
+		std::vector<uint32_t> InstanceOwner;	// index into InstancedBodies
+
+		uint64_t MemorySize() const
+		{
+			return Bodies.MemorySize() + Instances.MemorySize()
+				+ (uint64_t(BodyBodySetup.capacity()) + BodyFlags.capacity() + InstanceOwner.capacity()) * sizeof(uint32_t);
+		}
+	};
+
+	// Fails like SceneFile::DecodeInstances.
+	inline bool BuildSceneSoA(const SceneFile& Scene, SceneSoA& Out, std::string& OutError)
+	{
+		const Span<BodyRecord> StaticBodies = Scene.StaticMeshBodies();
+		Out.Bodies.Resize(StaticBodies.Count);
+		Out.BodyBodySetup.resize(StaticBodies.Count);
+		Out.BodyFlags.resize(StaticBodies.Count);
+		for (uint64_t i = 0; i < StaticBodies.Count; ++i)
+		{
+			Out.Bodies.Set(i, StaticBodies[i].Transform);
+			Out.BodyBodySetup[i] = StaticBodies[i].BodySetup;
+			Out.BodyFlags[i] = StaticBodies[i].Flags;
+		}
+
+		// the raw section is read in place, quantized chunks are decoded first
+		std::vector<PackedTransform> Decoded;
+		Span<PackedTransform> Transforms = Scene.InstanceTransforms();
+		if (!Scene.QuantizedInstanceChunks().empty())
+		{
+			if (!Scene.DecodeInstances(Decoded, OutError))
+				return false;
+			Transforms = { Decoded.data(), Decoded.size() };
+		}
+		Out.Instances.Resize(Transforms.Count);
+		for (uint64_t i = 0; i < Transforms.Count; ++i)
+		{
+			Out.Instances.Set(i, Transforms[i]);
+		}
+		// instances not claimed by any instanced body keep InvalidIndex
+		Out.InstanceOwner.assign(Transforms.Count, InvalidIndex);
+		const Span<InstancedBodyRecord> InstancedBodies = Scene.InstancedBodies();
+		for (uint64_t i = 0; i < InstancedBodies.Count; ++i)
+		{
+			const InstancedBodyRecord& Body = InstancedBodies[i];
+			std::fill_n(Out.InstanceOwner.begin() + Body.FirstInstance, Body.NumInstances, static_cast<uint32_t>(i));
+		}
+		return true;
+	}
+
+	// Content/Physic/<Package>.pbody
+	class BodySetupFile
+	{
+	public:
+		bool Open(const char* Path, std::string& OutError)
+		{
+			if (!File.Open(Path, OutError))
+				return false;
+			if (!Validate(OutError))
+			{
+				OutError = std::string(Path) + ": " + OutError;
+				File.Close();
+				return false;
+			}
+			return true;
+		}
+
+		const BodySetupFileHeader& Header() const { return *reinterpret_cast<const BodySetupFileHeader*>(File.Data()); }
+		const MappedFile& Mapping() const { return File; }
+
+		Span<BodyShapeRecord> Shapes() const
+		{
+			return { reinterpret_cast<const BodyShapeRecord*>(File.Data() + Header().ShapeTableOffset), Header().ShapeCount };
+		}
+
+		// Engine serialized, for the physics format CookedFormat() of EngineVersion().
+		Span<uint8_t> CookedData() const { return { File.Data() + Header().CookedOffset, Header().CookedSize }; }
+
+		const char* String(uint32_t Offset) const
+		{
+			return Offset < Header().StringsSize ? reinterpret_cast<const char*>(File.Data() + Header().StringsOffset + Offset) : "";
+		}
+		const char* CookedFormat() const { return String(Header().CookedFormat); }
+		const char* EngineVersion() const { return String(Header().EngineVersion); }
+		const char* DefaultInstance() const { return String(Header().DefaultInstance); }
+		const char* PhysMaterial() const { return String(Header().PhysMaterial); }
+
+	private:
+		bool Validate(std::string& OutError)
+		{
+			const uint64_t FileSize = File.Size();
+			if (FileSize < sizeof(BodySetupFileHeader))
+				return Detail::Fail(OutError, "truncated header");
+			const BodySetupFileHeader& H = Header();
+			if (H.Magic != BodySetupFileMagic)
+				return Detail::Fail(OutError, "not a BodySetup file");
+			if (H.Version != BodySetupFileVersion)
+				return Detail::Fail(OutError, "unsupported version " + std::to_string(H.Version));
+			if (H.FileSize != FileSize)
+				return Detail::Fail(OutError, "file size does not match the header");
+			if (!Detail::InFile(H.ShapeTableOffset, uint64_t(H.ShapeCount) * sizeof(BodyShapeRecord), FileSize) || H.ShapeTableOffset % alignof(BodyShapeRecord) != 0)
+				return Detail::Fail(OutError, "shape table out of the file");
+			if (!Detail::InFile(H.CookedOffset, H.CookedSize, FileSize))
+				return Detail::Fail(OutError, "cooked data out of the file");
+			if (!Detail::InFile(H.StringsOffset, H.StringsSize, FileSize) || (H.StringsSize > 0 && File.Data()[H.StringsOffset + H.StringsSize - 1] != 0))
+				return Detail::Fail(OutError, "bad string table");
+			for (const BodyShapeRecord& Shape : Shapes())
+			{
+				if (Shape.Type > uint8_t(EBodyShapeType::Convex))
+					return Detail::Fail(OutError, "unknown shape type " + std::to_string(Shape.Type));
+			}
+			return true;
+		}
+
+		MappedFile File;
+	};
+
+	// Content/Landscape/<Map>/<LandGuid>.ldata
+	class LandscapeArchiveFile
+	{
+	public:
+		bool Open(const char* Path, std::string& OutError)
+		{
+			if (!File.Open(Path, OutError))
+				return false;
+			if (!Validate(OutError))
+			{
+				OutError = std::string(Path) + ": " + OutError;
+				File.Close();
+				return false;
+			}
+			return true;
+		}
+
+		const LandscapeArchiveHeader& Header() const { return *reinterpret_cast<const LandscapeArchiveHeader*>(File.Data()); }
+		const MappedFile& Mapping() const { return File; }
+
+		Span<LandscapeTileEntry> Tiles() const
+		{
+			return { reinterpret_cast<const LandscapeTileEntry*>(File.Data() + Header().TileTableOffset), Header().TileCount };
+		}
+
+		const LandscapeTileEntry* FindTile(int32_t SectionBaseX, int32_t SectionBaseY) const
+		{
+			return FindLandscapeTile(Tiles().Data, Tiles().Count, SectionBaseX, SectionBaseY);
+		}
+
+		// CookedCollisionData of the tile, Tile.Size bytes.
+		const uint8_t* TileData(const LandscapeTileEntry& Tile) const { return File.Data() + Tile.Offset; }
+
+	private:
+		bool Validate(std::string& OutError)
+		{
+			const uint64_t FileSize = File.Size();
+			if (FileSize < sizeof(LandscapeArchiveHeader))
+				return Detail::Fail(OutError, "truncated header");
+			const LandscapeArchiveHeader& H = Header();
+			if (H.Magic != LandscapeArchiveMagic)
+				return Detail::Fail(OutError, "not a landscape archive");
+			if (H.Version != LandscapeArchiveVersion)
+				return Detail::Fail(OutError, "unsupported version " + std::to_string(H.Version));
+			if (H.FileSize != FileSize)
+				return Detail::Fail(OutError, "file size does not match the header");
+			if (!Detail::InFile(H.TileTableOffset, uint64_t(H.TileCount) * sizeof(LandscapeTileEntry), FileSize) || H.TileTableOffset % alignof(LandscapeTileEntry) != 0)
+				return Detail::Fail(OutError, "tile table out of the file");
+			for (const LandscapeTileEntry& Tile : Tiles())
+			{
+				if (!Detail::InFile(Tile.Offset, Tile.Size, FileSize))
+					return Detail::Fail(OutError, "tile out of the file");
+			}
+			return true;
+		}
+
+		MappedFile File;
+	};
+
+	// Content/Landscape/<Map>/<LandGuid>.lheight
+	class LandscapeHeightsFile
+	{
+	public:
+		bool Open(const char* Path, std::string& OutError)
+		{
+			if (!File.Open(Path, OutError))
+				return false;
+			if (!Validate(OutError))
+			{
+				OutError = std::string(Path) + ": " + OutError;
+				File.Close();
+				return false;
+			}
+			return true;
+		}
+
+		const LandscapeHeightsHeader& Header() const { return *reinterpret_cast<const LandscapeHeightsHeader*>(File.Data()); }
+		const MappedFile& Mapping() const { return File; }
+
+		Span<HeightTileEntry> Tiles() const
+		{
+			return { reinterpret_cast<const HeightTileEntry*>(File.Data() + Header().TileTableOffset), Header().TileCount };
+		}
+
+		const HeightTileEntry* FindTile(int32_t SectionBaseX, int32_t SectionBaseY) const
+		{
+			return FindLandscapeTile(Tiles().Data, Tiles().Count, SectionBaseX, SectionBaseY);
+		}
+
+		const uint16_t* Samples(const HeightTileEntry& Tile) const { return reinterpret_cast<const uint16_t*>(File.Data() + Tile.SamplesOffset); }
+		const uint16_t* SimpleSamples(const HeightTileEntry& Tile) const { return Tile.SimpleSizeQuads > 0 ? reinterpret_cast<const uint16_t*>(File.Data() + Tile.SimpleSamplesOffset) : nullptr; }
+		const HeightMinMax* Pyramid(const HeightTileEntry& Tile) const { return reinterpret_cast<const HeightMinMax*>(File.Data() + Tile.PyramidOffset); }
+
+	private:
+		// far above any landscape component, keeps the size computations below from overflowing
+		static constexpr uint32_t MaxTileQuads = 65535;
+
+		static uint64_t SampleBytes(uint32_t SizeQuads)
+		{
+			return (uint64_t(SizeQuads) + 1) * (uint64_t(SizeQuads) + 1) * sizeof(uint16_t);
+		}
+
+		bool Validate(std::string& OutError)
+		{
+			const uint64_t FileSize = File.Size();
+			if (FileSize < sizeof(LandscapeHeightsHeader))
+				return Detail::Fail(OutError, "truncated header");
+			const LandscapeHeightsHeader& H = Header();
+			if (H.Magic != LandscapeHeightsMagic)
+				return Detail::Fail(OutError, "not a landscape heights file");
+			if (H.Version != LandscapeHeightsVersion)
+				return Detail::Fail(OutError, "unsupported version " + std::to_string(H.Version));
+			if (H.FileSize != FileSize)
+				return Detail::Fail(OutError, "file size does not match the header");
+			if (!Detail::InFile(H.TileTableOffset, uint64_t(H.TileCount) * sizeof(HeightTileEntry), FileSize) || H.TileTableOffset % alignof(HeightTileEntry) != 0)
+				return Detail::Fail(OutError, "tile table out of the file");
+			for (const HeightTileEntry& Tile : Tiles())
+			{
+				if (Tile.SizeQuads == 0 || Tile.SizeQuads > MaxTileQuads || Tile.SimpleSizeQuads > MaxTileQuads || Tile.NumMips != HeightPyramidNumMips(Tile.SizeQuads))
+					return Detail::Fail(OutError, "bad tile size");
+				const bool bValid = Detail::InFile(Tile.SamplesOffset, SampleBytes(Tile.SizeQuads), FileSize)
+					&& (Tile.SimpleSizeQuads == 0 || Detail::InFile(Tile.SimpleSamplesOffset, SampleBytes(Tile.SimpleSizeQuads), FileSize))
+					&& Detail::InFile(Tile.PyramidOffset, HeightPyramidCellCount(Tile.SizeQuads) * sizeof(HeightMinMax), FileSize)
+					&& Tile.SamplesOffset % alignof(uint16_t) == 0 && Tile.SimpleSamplesOffset % alignof(uint16_t) == 0 && Tile.PyramidOffset % alignof(HeightMinMax) == 0;
+				if (!bValid)
+					return Detail::Fail(OutError, "tile out of the file");
+			}
+			return true;
+		}
+
+		MappedFile File;
+	};
+}
@@ -0,0 +1,717 @@
+// Copyright 2019 Lipeng Zha, Inc. All Rights Reserved.
+
+// Round trip test of ExportChaosSceneFormat.h and the server side scene reader, no Unreal dependency, Linux only:
+//
+//   g++ -std=c++17 SceneReader/ChaosSceneTest.cpp -o chaos_scene_test -lz
+//   ./chaos_scene_test
+//
+// Writes small synthetic .pscene / .ldata / .lheight / .pbody files with the format structs into a temporary
+// directory and reads them back with the reader, checks the quantized instance error bounds and the body
+// override decoding, then corrupts the files (truncated, wrong version, indices out of range) and checks that
+// Open rejects every one of them. Prints the failed checks and returns 1 when there is any.
+
+#include "ChaosSceneReader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+namespace
+{
+	using namespace ChaosScene;
+
+	int NumChecks = 0;
+	int NumFailed = 0;
+	std::string TestDir;
+
+	bool Check(bool bCondition, const char* Expression, int Line)
+	{
+		NumChecks++;
+		if (!bCondition)
+		{
+			std::fprintf(stderr, "line %d: check failed: %s\n", Line, Expression);
+			NumFailed++;
+		}
+		return bCondition;
+	}
+
+#define CHECK(Expression) Check((Expression), #Expression, __LINE__)
+
+	std::string TestPath(const char* Name)
+	{
+		return TestDir + "/" + Name;
+	}
+
+	void WriteFile(const std::string& Path, const std::vector<uint8_t>& Bytes)
+	{
+		FILE* File = std::fopen(Path.c_str(), "wb");
+		if (File == nullptr || std::fwrite(Bytes.data(), 1, Bytes.size(), File) != Bytes.size())
+		{
+			std::fprintf(stderr, "cannot write %s\n", Path.c_str());
+			std::exit(1);
+		}
+		std::fclose(File);
+	}
+
+	// Pads Bytes to SectionAlignment and appends Count records, returns their offset.
+	template<typename T>
+	uint64_t AppendAligned(std::vector<uint8_t>& Bytes, const T* Records, uint64_t Count)
+	{
+		Bytes.resize((Bytes.size() + SectionAlignment - 1) / SectionAlignment * SectionAlignment);
+		const uint64_t Offset = Bytes.size();
+		const uint8_t* Data = reinterpret_cast<const uint8_t*>(Records);
+		Bytes.insert(Bytes.end(), Data, Data + Count * sizeof(T));
+		return Offset;
+	}
+
+	template<typename T>
+	T& At(std::vector<uint8_t>& Bytes, uint64_t Offset)
+	{
+		return *reinterpret_cast<T*>(Bytes.data() + Offset);
+	}
+
+	// Open fails on the file, for the expected reason.
+	template<typename FileType>
+	void CheckRejected(const char* Name, const std::vector<uint8_t>& Bytes, const char* ExpectedError, int Line)
+	{
+		const std::string Path = TestPath(Name);
+		WriteFile(Path, Bytes);
+		FileType File;
+		std::string Error;
+		const bool bOpened = File.Open(Path.c_str(), Error);
+		if (!Check(!bOpened && Error.find(ExpectedError) != std::string::npos, ExpectedError, Line))
+			std::fprintf(stderr, "  %s: %s\n", Name, bOpened ? "opened" : Error.c_str());
+	}
+
+#define CHECK_REJECTED(FileType, Name, Bytes, ExpectedError) CheckRejected<FileType>(Name, Bytes, ExpectedError, __LINE__)
+
+	PackedTransform MakeTransform(std::mt19937& Random, float Spread, int ScaleMode)
+	{
+		std::uniform_real_distribution<float> Position(-Spread, Spread);
+		std::normal_distribution<float> Axis(0.0f, 1.0f);
+		std::uniform_real_distribution<float> Scale(0.5f, 2.0f);
+		PackedTransform Transform;
+		float Length = 0.0f;
+		for (int i = 0; i < 4; ++i)
+		{
+			Transform.Rotation[i] = Axis(Random);
+			Length += Transform.Rotation[i] * Transform.Rotation[i];
+		}
+		for (int i = 0; i < 4; ++i)
+			Transform.Rotation[i] /= std::sqrt(Length);
+		const float Uniform = Scale(Random);
+		for (int i = 0; i < 3; ++i)
+		{
+			Transform.Translation[i] = Position(Random);
+			Transform.Scale3D[i] = ScaleMode == 0 ? 1.0f : (ScaleMode == 1 ? Uniform : Scale(Random));
+		}
+		return Transform;
+	}
+
+	// Worst position (in steps) and rotation (in degrees) error of the decoded transforms, -1 when a scale differs.
+	void MeasureError(const std::vector<PackedTransform>& Source, const PackedTransform* Decoded, float Step, double& OutMaxSteps, double& OutMaxDegrees)
+	{
+		OutMaxSteps = 0.0;
+		OutMaxDegrees = 0.0;
+		bool bExactScale = true;
+		for (size_t i = 0; i < Source.size(); ++i)
+		{
+			for (int Axis = 0; Axis < 3; ++Axis)
+			{
+				// the decoded position is rounded to float, like the PackedTransform it stands in for
+				const double Rounding = std::fabs(Source[i].Translation[Axis]) * 1.2e-7;
+				const double Error = std::max(0.0, std::fabs(double(Decoded[i].Translation[Axis]) - Source[i].Translation[Axis]) - Rounding);
+				OutMaxSteps = std::max(OutMaxSteps, Error / Step);
+				bExactScale &= Decoded[i].Scale3D[Axis] == Source[i].Scale3D[Axis];
+			}
+			// from the chord between the unit quats, acos of their dot loses the small angles to rounding
+			double A[4], B[4], LengthA = 0.0, LengthB = 0.0, Dot = 0.0;
+			for (int c = 0; c < 4; ++c)
+			{
+				A[c] = Source[i].Rotation[c];
+				B[c] = Decoded[i].Rotation[c];
+				LengthA += A[c] * A[c];
+				LengthB += B[c] * B[c];
+				Dot += A[c] * B[c];
+			}
+			double Chord = 0.0;
+			for (int c = 0; c < 4; ++c)
+			{
+				const double Delta = A[c] / std::sqrt(LengthA) - (Dot < 0.0 ? -B[c] : B[c]) / std::sqrt(LengthB);
+				Chord += Delta * Delta;
+			}
+			OutMaxDegrees = std::max(OutMaxDegrees, 4.0 * std::asin(std::min(1.0, std::sqrt(Chord) * 0.5)) * 57.29577951308232);
+		}
+		if (!bExactScale)
+			OutMaxSteps = OutMaxDegrees = -1.0;
+	}
+
+	void TestQuantization()
+	{
+		struct FCase
+		{
+			float Spread;
+			float Step;
+			int ScaleMode;
+			uint8_t ExpectedBits;
+		};
+		const FCase Cases[] = {
+			{ 1000.0f, 0.1f, 0, 16 },
+			{ 500000.0f, 0.05f, 1, 32 },
+			{ 3000.0f, 0.1f, 2, 16 },
+		};
+		std::mt19937 Random(17);
+		for (const FCase& Case : Cases)
+		{
+			std::vector<PackedTransform> Source(2000);
+			for (PackedTransform& Transform : Source)
+				Transform = MakeTransform(Random, Case.Spread, Case.ScaleMode);
+
+			QuantizedInstanceChunk Chunk;
+			PrepareQuantizedChunk(Source.data(), static_cast<uint32_t>(Source.size()), Case.Step, Chunk);
+			CHECK(Chunk.PositionBits == Case.ExpectedBits);
+			CHECK(Chunk.ScaleMode == Case.ScaleMode);
+			CHECK(Chunk.RawSize == QuantizedChunkRawSize(Chunk.NumInstances, Chunk.PositionBits, Chunk.ScaleMode));
+
+			std::vector<uint8_t> Raw(Chunk.RawSize);
+			QuantizeChunk(Source.data(), Chunk, Raw.data());
+			std::vector<PackedTransform> Decoded(Source.size());
+			DequantizeChunk(Chunk, Raw.data(), Decoded.data());
+
+			double MaxSteps, MaxDegrees;
+			MeasureError(Source, Decoded.data(), Case.Step, MaxSteps, MaxDegrees);
+			CHECK(MaxSteps >= 0.0 && MaxSteps <= 0.5 + 1e-6);
+			CHECK(MaxDegrees >= 0.0 && MaxDegrees < 0.01);
+		}
+	}
+
+	void TestBodyOverrides()
+	{
+		static_assert(BodyOverrideWords(0) == 2, "empty set is Mask and BoolBits");
+		// SleepFamily (Enum), bUseCCD and bIgnoreAnalyticCollisions (Bool), MassOverride (Float), CustomDOFPlaneNormal (Vector)
+		const uint32_t Mask = (1u << 0) | (1u << 1) | (1u << 2) | (1u << 14) | (1u << 17);
+		CHECK(BodyOverrideWords(Mask) == 2 + 1 + 1 + 3);
+
+		const float Mass = 12.5f;
+		const float Normal[3] = { 0.0f, 0.0f, 1.0f };
+		std::vector<uint32_t> Set = { Mask, 1u << 1, 2 };
+		uint32_t Word;
+		std::memcpy(&Word, &Mass, sizeof(Word));
+		Set.push_back(Word);
+		for (const float Value : Normal)
+		{
+			std::memcpy(&Word, &Value, sizeof(Word));
+			Set.push_back(Word);
+		}
+
+		std::vector<std::string> Fields;
+		ForEachBodyOverride(Set.data(), [&](uint32_t Field, const uint32_t* Words)
+		{
+			Fields.emplace_back(BodyOverrideFields[Field].Name);
+			float Value;
+			std::memcpy(&Value, Words, sizeof(Value));
+			if (Field == 0)
+				CHECK(Words[0] == 2);
+			else if (Field == 1)
+				CHECK(Words[0] == 1);
+			else if (Field == 2)
+				CHECK(Words[0] == 0);
+			else if (Field == 14)
+				CHECK(Value == Mass);
+			else if (Field == 17)
+				CHECK(std::memcmp(Words, Normal, sizeof(Normal)) == 0);
+		});
+		CHECK((Fields == std::vector<std::string>{ "SleepFamily", "bUseCCD", "bIgnoreAnalyticCollisions", "MassOverride", "CustomDOFPlaneNormal" }));
+	}
+
+	// Records of a small scene: one BodySetup used by a StaticMesh body with overrides and an ISM with quantized
+	// instances, two constraints sharing a profile and one island.
+	struct FSceneContent
+	{
+		std::vector<char> Strings;
+		std::vector<BodySetupRecord> BodySetups;
+		std::vector<BodyRecord> StaticMeshBodies;
+		std::vector<InstancedBodyRecord> InstancedBodies;
+		std::vector<QuantizedInstanceChunk> Chunks;
+		std::vector<uint8_t> ChunkData;
+		std::vector<ConstraintRecord> Constraints;
+		std::vector<uint32_t> BodyOverrides;
+		std::vector<uint32_t> ConstraintProfiles;
+		std::vector<ConstraintIslandRecord> Islands;
+		std::vector<uint32_t> IslandBodies;
+		std::vector<uint32_t> IslandConstraints;
+		std::vector<PackedTransform> Instances;	// source of the chunks, not written
+	};
+
+	uint32_t AddString(std::vector<char>& Strings, const char* Str)
+	{
+		const uint32_t Offset = static_cast<uint32_t>(Strings.size());
+		Strings.insert(Strings.end(), Str, Str + std::strlen(Str) + 1);
+		return Offset;
+	}
+
+	FSceneContent MakeSceneContent()
+	{
+		FSceneContent Content;
+		Content.Strings.push_back(0);
+
+		BodySetupRecord BodySetup = {};
+		BodySetup.Package = AddString(Content.Strings, "/Game/Props/SM_Crate");
+		BodySetup.Name = AddString(Content.Strings, "BodySetup_0");
+		BodySetup.NumStaticMesh = 1;
+		BodySetup.NumInstanced = 1;
+		Content.BodySetups.push_back(BodySetup);
+
+		std::mt19937 Random(3);
+		BodyRecord Body = {};
+		Body.ActorID = 10;
+		Body.CompID = 1;
+		Body.Name = AddString(Content.Strings, "Crate");
+		Body.Transform = MakeTransform(Random, 100.0f, 0);
+		Body.Flags = BodyFlag_SimulatePhysics | BodyFlag_EnableGravity;
+		// the set at 0 is the empty one
+		const float Damping = 0.25f;
+		uint32_t DampingWord;
+		std::memcpy(&DampingWord, &Damping, sizeof(DampingWord));
+		Content.BodyOverrides = { 0, 0, (1u << 1) | (1u << 15), 1u << 1, DampingWord };
+		Body.Overrides = 2;
+		Content.StaticMeshBodies.push_back(Body);
+
+		Content.Instances.resize(300);
+		for (PackedTransform& Transform : Content.Instances)
+			Transform = MakeTransform(Random, 5000.0f, 1);
+		InstancedBodyRecord Instanced = {};
+		Instanced.Body.ActorID = 11;
+		Instanced.Body.CompID = 2;
+		Instanced.NumInstances = static_cast<uint32_t>(Content.Instances.size());
+		Content.InstancedBodies.push_back(Instanced);
+
+		// one raw and one zlib chunk
+		for (uint32_t First = 0; First < Content.Instances.size(); First += 200)
+		{
+			const uint32_t Count = std::min<uint32_t>(200, static_cast<uint32_t>(Content.Instances.size()) - First);
+			QuantizedInstanceChunk Chunk;
+			PrepareQuantizedChunk(Content.Instances.data() + First, Count, 0.1f, Chunk);
+			Chunk.FirstInstance = First;
+			std::vector<uint8_t> Raw(Chunk.RawSize);
+			QuantizeChunk(Content.Instances.data() + First, Chunk, Raw.data());
+			if (First > 0)
+			{
+				uLongf Size = ::compressBound(Raw.size());
+				std::vector<uint8_t> Compressed(Size);
+				::compress2(Compressed.data(), &Size, Raw.data(), Raw.size(), Z_BEST_SPEED);
+				Compressed.resize(Size);
+				Raw.swap(Compressed);
+				Chunk.Codec = uint8_t(ECodec::Zlib);
+			}
+			Chunk.DataSize = static_cast<uint32_t>(Raw.size());
+			Chunk.DataOffset = AppendAligned(Content.ChunkData, Raw.data(), Raw.size());
+			Content.Chunks.push_back(Chunk);
+		}
+
+		Content.ConstraintProfiles.push_back(AddString(Content.Strings, "{\"bDisableCollision\":true}"));
+		for (uint32_t i = 0; i < 2; ++i)
+		{
+			ConstraintRecord Constraint = {};
+			Constraint.OwnerID = 20 + i;
+			Constraint.ActorID1 = i == 0 ? 0 : 10;
+			Constraint.ActorID2 = i == 0 ? 10 : 12;
+			Constraint.Transform = MakeTransform(Random, 100.0f, 0);
+			Constraint.Profile = 0;
+			Content.Constraints.push_back(Constraint);
+		}
+		Content.Islands.push_back({ 0, 2, 0, 2 });
+		Content.IslandBodies = { 10, 12 };
+		Content.IslandConstraints = { 0, 1 };
+		return Content;
+	}
+
+	template<typename T>
+	void AddSection(std::vector<uint8_t>& Bytes, std::vector<SectionEntry>& Sections, ESection Type, const std::vector<T>& Records)
+	{
+		SectionEntry Entry;
+		Entry.Type = static_cast<uint32_t>(Type);
+		Entry.Stride = sizeof(T);
+		Entry.Offset = AppendAligned(Bytes, Records.data(), Records.size());
+		Entry.Count = Records.size();
+		Entry.Size = Records.size() * sizeof(T);
+		Sections.push_back(Entry);
+	}
+
+	// The sections a scene does not use are left out of the table, they read as empty.
+	std::vector<uint8_t> BuildScene(const FSceneContent& Content)
+	{
+		std::vector<SectionEntry> Sections;
+		std::vector<uint8_t> Bytes(sizeof(SceneHeader) + 12 * sizeof(SectionEntry));
+		AddSection(Bytes, Sections, ESection::Strings, Content.Strings);
+		AddSection(Bytes, Sections, ESection::BodySetups, Content.BodySetups);
+		AddSection(Bytes, Sections, ESection::StaticMeshBodies, Content.StaticMeshBodies);
+		AddSection(Bytes, Sections, ESection::InstancedBodies, Content.InstancedBodies);
+		AddSection(Bytes, Sections, ESection::Constraints, Content.Constraints);
+		AddSection(Bytes, Sections, ESection::QuantizedInstanceChunks, Content.Chunks);
+		AddSection(Bytes, Sections, ESection::QuantizedInstanceData, Content.ChunkData);
+		AddSection(Bytes, Sections, ESection::BodyOverrides, Content.BodyOverrides);
+		AddSection(Bytes, Sections, ESection::ConstraintProfiles, Content.ConstraintProfiles);
+		AddSection(Bytes, Sections, ESection::ConstraintIslands, Content.Islands);
+		AddSection(Bytes, Sections, ESection::IslandBodies, Content.IslandBodies);
+		AddSection(Bytes, Sections, ESection::IslandConstraints, Content.IslandConstraints);
+
+		SceneHeader& Header = At<SceneHeader>(Bytes, 0);
+		Header.Magic = Magic;
+		Header.Version = Version;
+		Header.SectionCount = static_cast<uint32_t>(Sections.size());
+		Header.SectionTableOffset = sizeof(SceneHeader);
+		Header.FileSize = Bytes.size();
+		std::memcpy(Bytes.data() + Header.SectionTableOffset, Sections.data(), Sections.size() * sizeof(SectionEntry));
+		return Bytes;
+	}
+
+	void TestScene()
+	{
+		const FSceneContent Content = MakeSceneContent();
+		const std::string Path = TestPath("Map.pscene");
+		WriteFile(Path, BuildScene(Content));
+
+		SceneFile Scene;
+		std::string Error;
+		if (!CHECK(Scene.Open(Path.c_str(), Error)))
+		{
+			std::fprintf(stderr, "  %s\n", Error.c_str());
+			return;
+		}
+		CHECK(Scene.BodySetups().Count == 1 && std::strcmp(Scene.String(Scene.BodySetups()[0].Package), "/Game/Props/SM_Crate") == 0);
+		CHECK(Scene.StaticMeshBodies().Count == 1 && std::strcmp(Scene.String(Scene.StaticMeshBodies()[0].Name), "Crate") == 0);
+		CHECK(std::memcmp(&Scene.StaticMeshBodies()[0], &Content.StaticMeshBodies[0], sizeof(BodyRecord)) == 0);
+		CHECK(Scene.InstanceTransforms().empty() && Scene.PhysicFields().empty() && Scene.StaticBVHNodes().empty());
+
+		// overrides of the body: bUseCCD on, AngularDamping 0.25
+		int NumOverrides = 0;
+		ForEachBodyOverride(Scene.BodyOverrides(Scene.StaticMeshBodies()[0]), [&](uint32_t Field, const uint32_t* Words)
+		{
+			float Value;
+			std::memcpy(&Value, Words, sizeof(Value));
+			CHECK((Field == 1 && Words[0] == 1) || (Field == 15 && Value == 0.25f));
+			NumOverrides++;
+		});
+		CHECK(NumOverrides == 2);
+
+		std::vector<PackedTransform> Instances;
+		CHECK(Scene.NumInstances() == Content.Instances.size());
+		if (CHECK(Scene.DecodeInstances(Instances, Error)) && CHECK(Instances.size() == Content.Instances.size()))
+		{
+			double MaxSteps, MaxDegrees;
+			MeasureError(Content.Instances, Instances.data(), 0.1f, MaxSteps, MaxDegrees);
+			CHECK(MaxSteps >= 0.0 && MaxSteps <= 0.5 + 1e-6);
+			CHECK(MaxDegrees >= 0.0 && MaxDegrees < 0.01);
+		}
+		SceneSoA SoA;
+		CHECK(BuildSceneSoA(Scene, SoA, Error) && SoA.Instances.Size() == Content.Instances.size() && SoA.InstanceOwner.back() == 0);
+
+		CHECK(Scene.Constraints().Count == 2);
+		CHECK(std::strcmp(Scene.ConstraintProfile(Scene.Constraints()[1]), "{\"bDisableCollision\":true}") == 0);
+		CHECK(Scene.ConstraintIslands().Count == 1 && Scene.IslandConstraints().Count == 2 && Scene.IslandBodies()[1] == 12);
+	}
+
+	void TestSceneRejected()
+	{
+		const FSceneContent Good = MakeSceneContent();
+		const std::vector<uint8_t> Bytes = BuildScene(Good);
+
+		CHECK_REJECTED(SceneFile, "header.pscene", std::vector<uint8_t>(Bytes.begin(), Bytes.begin() + 12), "truncated header");
+		CHECK_REJECTED(SceneFile, "truncated.pscene", std::vector<uint8_t>(Bytes.begin(), Bytes.end() - 16), "file size");
+
+		std::vector<uint8_t> Corrupt = Bytes;
+		At<SceneHeader>(Corrupt, 0).Version = Version + 1;
+		CHECK_REJECTED(SceneFile, "newer.pscene", Corrupt, "unsupported version");
+		At<SceneHeader>(Corrupt, 0).Version = MinVersion - 1;
+		CHECK_REJECTED(SceneFile, "older.pscene", Corrupt, "unsupported version");
+
+		Corrupt = Bytes;
+		At<SectionEntry>(Corrupt, sizeof(SceneHeader) + 2 * sizeof(SectionEntry)).Offset = Bytes.size();
+		CHECK_REJECTED(SceneFile, "section.pscene", Corrupt, "out of the file");
+
+		Corrupt = Bytes;
+		At<SectionEntry>(Corrupt, sizeof(SceneHeader) + 2 * sizeof(SectionEntry)).Stride = sizeof(BodyRecord) - 4;
+		CHECK_REJECTED(SceneFile, "stride.pscene", Corrupt, "bad record size");
+
+		FSceneContent Content = Good;
+		Content.Strings.back() = 'x';
+		CHECK_REJECTED(SceneFile, "strings.pscene", BuildScene(Content), "unterminated string table");
+
+		Content = Good;
+		Content.BodySetups[0].NumStaticMesh = 2;
+		CHECK_REJECTED(SceneFile, "bodysetup.pscene", BuildScene(Content), "BodySetup body range");
+
+		Content = Good;
+		Content.StaticMeshBodies[0].BodySetup = 1;
+		CHECK_REJECTED(SceneFile, "body.pscene", BuildScene(Content), "StaticMesh body");
+
+		Content = Good;
+		Content.StaticMeshBodies[0].Overrides = static_cast<uint32_t>(Content.BodyOverrides.size()) - 1;
+		CHECK_REJECTED(SceneFile, "overrides.pscene", BuildScene(Content), "StaticMesh body");
+
+		Content = Good;
+		Content.BodyOverrides[2] |= 1u << 31;
+		CHECK_REJECTED(SceneFile, "field.pscene", BuildScene(Content), "StaticMesh body");
+
+		Content = Good;
+		Content.InstancedBodies[0].NumInstances++;
+		CHECK_REJECTED(SceneFile, "instances.pscene", BuildScene(Content), "instanced body");
+
+		Content = Good;
+		Content.Chunks[1].FirstInstance++;
+		CHECK_REJECTED(SceneFile, "chunk.pscene", BuildScene(Content), "bad quantized chunk");
+
+		Content = Good;
+		Content.Chunks[1].DataSize = static_cast<uint32_t>(Content.ChunkData.size());
+		CHECK_REJECTED(SceneFile, "chunkdata.pscene", BuildScene(Content), "bad quantized chunk");
+
+		Content = Good;
+		Content.Constraints[0].Profile = 1;
+		CHECK_REJECTED(SceneFile, "profile.pscene", BuildScene(Content), "constraint profile");
+
+		Content = Good;
+		Content.Islands[0].NumBodies = 3;
+		CHECK_REJECTED(SceneFile, "island.pscene", BuildScene(Content), "constraint island");
+
+		Content = Good;
+		Content.IslandConstraints[1] = 2;
+		CHECK_REJECTED(SceneFile, "islandconstraint.pscene", BuildScene(Content), "island constraint");
+
+		// a corrupt zlib stream passes Open, the decode reports it
+		Content = Good;
+		std::memset(Content.ChunkData.data() + Content.Chunks[1].DataOffset, 0xab, 8);
+		const std::string Path = TestPath("zlib.pscene");
+		WriteFile(Path, BuildScene(Content));
+		SceneFile Scene;
+		std::vector<PackedTransform> Instances;
+		std::string Error;
+		CHECK(Scene.Open(Path.c_str(), Error) && !Scene.DecodeInstances(Instances, Error) && Error.find("corrupt quantized chunk") != std::string::npos);
+	}
+
+	// Tiles at (0, 0), (63, 0) and (0, 63), sorted by (SectionBaseY, SectionBaseX).
+	std::vector<uint8_t> BuildArchive()
+	{
+		const int32_t Bases[3][2] = { { 0, 0 }, { 63, 0 }, { 0, 63 } };
+		std::vector<uint8_t> Bytes(sizeof(LandscapeArchiveHeader) + 3 * sizeof(LandscapeTileEntry));
+		std::vector<LandscapeTileEntry> Tiles;
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			const std::vector<uint8_t> Payload(100 + i * 10, static_cast<uint8_t>(i + 1));
+			LandscapeTileEntry Tile = {};
+			Tile.SectionBaseX = Bases[i][0];
+			Tile.SectionBaseY = Bases[i][1];
+			Tile.CompID = 100 + i;
+			Tile.Size = Payload.size();
+			Tile.Offset = AppendAligned(Bytes, Payload.data(), Payload.size());
+			Tiles.push_back(Tile);
+		}
+		LandscapeArchiveHeader& Header = At<LandscapeArchiveHeader>(Bytes, 0);
+		Header.Magic = LandscapeArchiveMagic;
+		Header.Version = LandscapeArchiveVersion;
+		Header.TileCount = 3;
+		Header.TileTableOffset = sizeof(LandscapeArchiveHeader);
+		Header.FileSize = Bytes.size();
+		std::memcpy(Bytes.data() + Header.TileTableOffset, Tiles.data(), Tiles.size() * sizeof(LandscapeTileEntry));
+		return Bytes;
+	}
+
+	void TestLandscapeArchive()
+	{
+		const std::vector<uint8_t> Bytes = BuildArchive();
+		const std::string Path = TestPath("Land.ldata");
+		WriteFile(Path, Bytes);
+
+		LandscapeArchiveFile Archive;
+		std::string Error;
+		if (CHECK(Archive.Open(Path.c_str(), Error)))
+		{
+			CHECK(Archive.Tiles().Count == 3);
+			const LandscapeTileEntry* Tile = Archive.FindTile(63, 0);
+			CHECK(Tile != nullptr && Tile->CompID == 101 && Tile->Size == 110 && Archive.TileData(*Tile)[109] == 2);
+			CHECK(Archive.FindTile(0, 63) != nullptr && Archive.FindTile(0, 63)->CompID == 102);
+			CHECK(Archive.FindTile(63, 63) == nullptr);
+			CHECK(FindLandscapeTile(Archive.Tiles().Data, 3, 0, 0) == &Archive.Tiles()[0]);
+		}
+
+		CHECK_REJECTED(LandscapeArchiveFile, "truncated.ldata", std::vector<uint8_t>(Bytes.begin(), Bytes.end() - 1), "file size");
+		std::vector<uint8_t> Corrupt = Bytes;
+		At<LandscapeArchiveHeader>(Corrupt, 0).Version = LandscapeArchiveVersion + 1;
+		CHECK_REJECTED(LandscapeArchiveFile, "version.ldata", Corrupt, "unsupported version");
+		Corrupt = Bytes;
+		At<LandscapeArchiveHeader>(Corrupt, 0).TileCount = 1000;
+		CHECK_REJECTED(LandscapeArchiveFile, "count.ldata", Corrupt, "tile table out of the file");
+		Corrupt = Bytes;
+		At<LandscapeTileEntry>(Corrupt, sizeof(LandscapeArchiveHeader) + sizeof(LandscapeTileEntry)).Size = Bytes.size();
+		CHECK_REJECTED(LandscapeArchiveFile, "tile.ldata", Corrupt, "tile out of the file");
+	}
+
+	// One 2x2 quad tile without simple collision, heights rising along X.
+	std::vector<uint8_t> BuildHeights()
+	{
+		constexpr uint32_t SizeQuads = 2;
+		std::vector<uint8_t> Bytes(sizeof(LandscapeHeightsHeader) + sizeof(HeightTileEntry));
+		HeightTileEntry Tile = {};
+		Tile.CompID = 7;
+		Tile.SizeQuads = SizeQuads;
+		Tile.CollisionScale = 100.0f;
+		Tile.NumMips = HeightPyramidNumMips(SizeQuads);
+		Tile.Transform = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f } };
+
+		std::vector<uint16_t> Samples;
+		for (uint32_t y = 0; y <= SizeQuads; ++y)
+		{
+			for (uint32_t x = 0; x <= SizeQuads; ++x)
+				Samples.push_back(static_cast<uint16_t>(LandscapeHeightZero + x * 128));
+		}
+		Tile.SamplesOffset = AppendAligned(Bytes, Samples.data(), Samples.size());
+
+		// mip 0 per quad, then the 1x1 top
+		std::vector<HeightMinMax> Pyramid;
+		for (uint32_t y = 0; y < SizeQuads; ++y)
+		{
+			for (uint32_t x = 0; x < SizeQuads; ++x)
+				Pyramid.push_back({ Samples[x], Samples[x + 1] });
+		}
+		Pyramid.push_back({ Samples[0], Samples[SizeQuads] });
+		Tile.PyramidOffset = AppendAligned(Bytes, Pyramid.data(), Pyramid.size());
+
+		LandscapeHeightsHeader& Header = At<LandscapeHeightsHeader>(Bytes, 0);
+		Header.Magic = LandscapeHeightsMagic;
+		Header.Version = LandscapeHeightsVersion;
+		Header.TileCount = 1;
+		Header.TileTableOffset = sizeof(LandscapeHeightsHeader);
+		Header.FileSize = Bytes.size();
+		At<HeightTileEntry>(Bytes, Header.TileTableOffset) = Tile;
+		return Bytes;
+	}
+
+	void TestLandscapeHeights()
+	{
+		const std::vector<uint8_t> Bytes = BuildHeights();
+		const std::string Path = TestPath("Land.lheight");
+		WriteFile(Path, Bytes);
+
+		LandscapeHeightsFile Heights;
+		std::string Error;
+		if (CHECK(Heights.Open(Path.c_str(), Error)))
+		{
+			const HeightTileEntry* Tile = Heights.FindTile(0, 0);
+			if (CHECK(Tile != nullptr && Tile->CompID == 7))
+			{
+				CHECK(HeightPyramidCellCount(Tile->SizeQuads) == 5);
+				CHECK(Heights.SimpleSamples(*Tile) == nullptr);
+				CHECK(SampleTileHeight(Heights.Samples(*Tile), Tile->SizeQuads, 1.5f, 1.0f) == LandscapeHeightZero + 192.0f);
+				CHECK(Heights.Pyramid(*Tile)[4].Max == LandscapeHeightZero + 256);
+			}
+		}
+
+		const uint64_t TileOffset = sizeof(LandscapeHeightsHeader);
+		CHECK_REJECTED(LandscapeHeightsFile, "truncated.lheight", std::vector<uint8_t>(Bytes.begin(), Bytes.end() - 4), "file size");
+		std::vector<uint8_t> Corrupt = Bytes;
+		At<LandscapeHeightsHeader>(Corrupt, 0).Version = LandscapeHeightsVersion + 1;
+		CHECK_REJECTED(LandscapeHeightsFile, "version.lheight", Corrupt, "unsupported version");
+		Corrupt = Bytes;
+		At<HeightTileEntry>(Corrupt, TileOffset).NumMips = 1;
+		CHECK_REJECTED(LandscapeHeightsFile, "mips.lheight", Corrupt, "bad tile size");
+		Corrupt = Bytes;
+		At<HeightTileEntry>(Corrupt, TileOffset).SizeQuads = 3;
+		CHECK_REJECTED(LandscapeHeightsFile, "size.lheight", Corrupt, "bad tile size");
+		Corrupt = Bytes;
+		At<HeightTileEntry>(Corrupt, TileOffset).PyramidOffset = Bytes.size() - sizeof(HeightMinMax);
+		CHECK_REJECTED(LandscapeHeightsFile, "pyramid.lheight", Corrupt, "tile out of the file");
+		Corrupt = Bytes;
+		At<HeightTileEntry>(Corrupt, TileOffset).SimpleSizeQuads = 2;
+		At<HeightTileEntry>(Corrupt, TileOffset).SimpleSamplesOffset = Bytes.size() - 2 * sizeof(uint16_t);
+		CHECK_REJECTED(LandscapeHeightsFile, "simple.lheight", Corrupt, "tile out of the file");
+	}
+
+	// A box and a convex, 40 bytes of cooked data.
+	std::vector<uint8_t> BuildBodySetup()
+	{
+		std::vector<uint8_t> Bytes(sizeof(BodySetupFileHeader));
+		BodyShapeRecord Shapes[2] = {};
+		Shapes[0].Type = uint8_t(EBodyShapeType::Box);
+		Shapes[0].Rotation[3] = 1.0f;
+		Shapes[0].Size[0] = 50.0f;
+		Shapes[1].Type = uint8_t(EBodyShapeType::Convex);
+		Shapes[1].Rotation[3] = 1.0f;
+		const uint64_t ShapeTableOffset = AppendAligned(Bytes, Shapes, 2);
+		const std::vector<uint8_t> Cooked(40, 0x5a);
+		const uint64_t CookedOffset = AppendAligned(Bytes, Cooked.data(), Cooked.size());
+		std::vector<char> Strings = { 0 };
+		const uint32_t CookedFormat = AddString(Strings, "Chaos");
+		const uint32_t EngineVersion = AddString(Strings, "5.3.2");
+		const uint32_t DefaultInstance = AddString(Strings, "{}");
+		const uint64_t StringsOffset = AppendAligned(Bytes, Strings.data(), Strings.size());
+
+		BodySetupFileHeader& Header = At<BodySetupFileHeader>(Bytes, 0);
+		Header.Magic = BodySetupFileMagic;
+		Header.Version = BodySetupFileVersion;
+		Header.ShapeCount = 2;
+		Header.ShapeTableOffset = static_cast<uint32_t>(ShapeTableOffset);
+		Header.FileSize = Bytes.size();
+		Header.CookedOffset = CookedOffset;
+		Header.CookedSize = Cooked.size();
+		Header.StringsOffset = static_cast<uint32_t>(StringsOffset);
+		Header.StringsSize = static_cast<uint32_t>(Strings.size());
+		Header.CookedFormat = CookedFormat;
+		Header.EngineVersion = EngineVersion;
+		Header.DefaultInstance = DefaultInstance;
+		return Bytes;
+	}
+
+	void TestBodySetup()
+	{
+		const std::vector<uint8_t> Bytes = BuildBodySetup();
+		const std::string Path = TestPath("SM_Crate.pbody");
+		WriteFile(Path, Bytes);
+
+		BodySetupFile BodySetup;
+		std::string Error;
+		if (CHECK(BodySetup.Open(Path.c_str(), Error)))
+		{
+			CHECK(BodySetup.Shapes().Count == 2 && BodySetup.Shapes()[0].Size[0] == 50.0f && BodySetup.Shapes()[1].Type == uint8_t(EBodyShapeType::Convex));
+			CHECK(BodySetup.CookedData().Count == 40 && BodySetup.CookedData()[39] == 0x5a);
+			CHECK(std::strcmp(BodySetup.CookedFormat(), "Chaos") == 0 && std::strcmp(BodySetup.EngineVersion(), "5.3.2") == 0);
+			CHECK(std::strcmp(BodySetup.PhysMaterial(), "") == 0);
+		}
+
+		CHECK_REJECTED(BodySetupFile, "truncated.pbody", std::vector<uint8_t>(Bytes.begin(), Bytes.end() - 1), "file size");
+		std::vector<uint8_t> Corrupt = Bytes;
+		At<BodySetupFileHeader>(Corrupt, 0).Version = BodySetupFileVersion + 1;
+		CHECK_REJECTED(BodySetupFile, "version.pbody", Corrupt, "unsupported version");
+		Corrupt = Bytes;
+		At<BodySetupFileHeader>(Corrupt, 0).CookedSize = Bytes.size();
+		CHECK_REJECTED(BodySetupFile, "cooked.pbody", Corrupt, "cooked data out of the file");
+		Corrupt = Bytes;
+		At<BodySetupFileHeader>(Corrupt, 0).StringsSize--;
+		CHECK_REJECTED(BodySetupFile, "strings.pbody", Corrupt, "bad string table");
+		Corrupt = Bytes;
+		At<BodyShapeRecord>(Corrupt, At<BodySetupFileHeader>(Corrupt, 0).ShapeTableOffset).Type = uint8_t(EBodyShapeType::Convex) + 1;
+		CHECK_REJECTED(BodySetupFile, "shape.pbody", Corrupt, "unknown shape type");
+	}
+}
+
+int main()
+{
+	char Dir[] = "/tmp/chaos_scene_test.XXXXXX";
+	if (::mkdtemp(Dir) == nullptr)
+	{
+		std::fprintf(stderr, "cannot create a temporary directory\n");
+		return 1;
+	}
+	TestDir = Dir;
+
+	TestQuantization();
+	TestBodyOverrides();
+	TestScene();
+	TestSceneRejected();
+	TestLandscapeArchive();
+	TestLandscapeHeights();
+	TestBodySetup();
+
+	std::system(("rm -rf " + TestDir).c_str());
+	std::printf("%d checks, %d failed\n", NumChecks, NumFailed);
+	return NumFailed == 0 ? 0 : 1;
+}
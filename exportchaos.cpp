@@ -14,6 +14,13 @@
 #include "Widgets/Notifications/SNotificationList.h"
 #include <vector>
 #include <unordered_map>
+#include <atomic>
+#include <algorithm>
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#else
+#include <sys/resource.h>
+#endif
 
 #include "Misc/Paths.h"
 #include "Engine/Engine.h"
@@ -24,6 +31,7 @@
 
 #include "EngineUtils.h"
 #include "PhysicsEngine/BodySetup.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
 #include "Components/InstancedStaticMeshComponent.h"
 #include "PhysicsEngine/ConstraintInstance.h"
 #include "PhysicsEngine/PhysicsConstraintComponent.h"
@@ -35,6 +43,7 @@
 #include "Serialization/JsonWriter.h"
 #include "Serialization/JsonReader.h"
 #include "Serialization/JsonTypes.h"
+#include "Serialization/MemoryWriter.h"
 #include "Json.h"
 
 #include "Field/FieldSystemActor.h"
@@ -43,9 +52,163 @@
 #include "Landscape.h"
 #include "LandscapeInfo.h"
 #include "LandscapeHeightfieldCollisionComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Base64.h"
+#include "Misc/Compression.h"
+#include "Hash/CityHash.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/ScopeLock.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "ExportChaosSceneFormat.h"
+#include "ExportChaosExporter.h"
 
 static const FName ExportChaosTabName("ExportChaos");
 
+static TAutoConsoleVariable<int32> CVarExportChaosBinaryScene(
+	TEXT("ExportChaos.BinaryScene"),
+	0,
+	TEXT("Also write PhysicScene/<Map>.pscene, the memory-mappable layout described in ExportChaosSceneFormat.h.\n")
+	TEXT(" 0: json only (default)\n")
+	TEXT(" 1: json and binary"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarExportChaosInstanceEncoding(
+	TEXT("ExportChaos.InstanceEncoding"),
+	0,
+	TEXT("How the instances of a StaticMeshInstance entry are written to the PhysicScene json.\n")
+	TEXT(" 0: \"InstancesTM\", one object with a Transform string per instance (default)\n")
+	TEXT(" 1: \"InstancesPacked\", one flat float array, 10 floats per instance\n")
+	TEXT(" 2: \"InstancesBase64\", the same floats as a base64 little endian blob\n")
+	TEXT(" 3: \"InstancesQuantized\", chunks of quantized, compressed instances, also used instead of InstanceTransforms in the .pscene\n")
+	TEXT("Packed instances use the ChaosScene::PackedTransform layout: translation xyz, quat xyzw, scale xyz.\n")
+	TEXT("Quantized chunks use the ChaosScene::QuantizedInstanceChunk layout, with the payload as base64 in \"Data\"."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarExportChaosInstanceQuantizationStep(
+	TEXT("ExportChaos.InstanceQuantizationStep"),
+	0.1f,
+	TEXT("Position step in cm of the quantized instance encoding (ExportChaos.InstanceEncoding 3), positions are off by\n")
+	TEXT("at most half a step. Clamped to at least 0.01."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosInstanceCompression(
+	TEXT("ExportChaos.InstanceCompression"),
+	true,
+	TEXT("Zlib compress each chunk of quantized instances, chunks that do not get smaller are stored raw."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosInstancesFromSMData(
+	TEXT("ExportChaos.InstancesFromPerInstanceSMData"),
+	false,
+	TEXT("Read ISM instance transforms from PerInstanceSMData instead of InstanceBodies,\n")
+	TEXT("so instances whose physics bodies are not created yet are still exported."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosIncremental(
+	TEXT("ExportChaos.Incremental"),
+	true,
+	TEXT("Skip the package save, the cook and the landscape .data write of everything whose content hash\n")
+	TEXT("matches PhysicScene/<Map>.manifest.json from the previous export. Set to false to force a full export."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarExportChaosCookShards(
+	TEXT("ExportChaos.CookShards"),
+	0,
+	TEXT("Number of cook commandlets the exported BodySetup packages are split over, 0 uses the number of cores."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarExportChaosCookRetries(
+	TEXT("ExportChaos.CookRetries"),
+	1,
+	TEXT("How many times a failed cook shard is relaunched."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosLandscapeArchive(
+	TEXT("ExportChaos.LandscapeArchive"),
+	false,
+	TEXT("Write the collision of each landscape into one Landscape/<Map>/<LandGuid>.ldata archive with a tile index\n")
+	TEXT("(see ChaosScene::LandscapeArchiveHeader) instead of one .data file per collision component."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosLandscapeHeights(
+	TEXT("ExportChaos.LandscapeHeights"),
+	false,
+	TEXT("Also write the raw collision height samples of each landscape with a min/max pyramid per tile\n")
+	TEXT("to Landscape/<Map>/<LandGuid>.lheight (see ChaosScene::LandscapeHeightsHeader)."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosStaticBVH(
+	TEXT("ExportChaos.StaticBVH"),
+	false,
+	TEXT("Build a SAH BVH over the bounds of all static bodies and instances and store it in the binary PhysicScene\n")
+	TEXT("(StaticBVHNodes / StaticBVHPrims sections), so the server can bulk load its broadphase. Turns the binary output on."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosBatchedPackageSaves(
+	TEXT("ExportChaos.BatchedPackageSaves"),
+	true,
+	TEXT("Save the exported BodySetup packages with async file writes and wait for all of them once,\n")
+	TEXT("instead of waiting for the write of each package before saving the next one."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosDirectBodySetups(
+	TEXT("ExportChaos.DirectBodySetups"),
+	false,
+	TEXT("Write the shapes and the cooked geometry of each changed BodySetup straight to Physic/<Package>.pbody\n")
+	TEXT("(see ChaosScene::BodySetupFileHeader) instead of saving a package and running the cook commandlet on it."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<FString> CVarExportChaosCollisionLOD(
+	TEXT("ExportChaos.CollisionLOD"),
+	TEXT(""),
+	TEXT("Rules for the coarse collision proxy exported next to the full geometry of each BodySetup, empty for none.\n")
+	TEXT("<match>=<proxy> separated by ';', the first match wins. <match> is a wildcard on the BodySetup package or\n")
+	TEXT("tag:<Name> for a component or actor tag, <proxy> is box, sphere, hull[:<MaxVertices>] or none.\n")
+	TEXT("Example: tag:Hero=none;SM_Rock*=hull:24;*=box"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosParallelSerialize(
+	TEXT("ExportChaos.ParallelSerialize"),
+	true,
+	TEXT("Format the transforms, instances and constraint profiles of the PhysicScene on all cores ahead of the json writer,\n")
+	TEXT("the output is the same as with a single thread."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosDedupBodySetups(
+	TEXT("ExportChaos.DedupBodySetups"),
+	true,
+	TEXT("Export the BodySetups of different meshes with identical collision (shapes, cooked data, defaults) once,\n")
+	TEXT("as the package of the first one by path, and let all their components reference it."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarExportChaosDelta(
+	TEXT("ExportChaos.Delta"),
+	false,
+	TEXT("Also write PhysicScene/<Map>.delta.json with only the bodies, constraints, fields and landscape tiles added or\n")
+	TEXT("modified since the previous export, plus the keys of the removed ones, so a running server can patch its scene.\n")
+	TEXT("The record hashes of the last export are kept in PhysicScene/<Map>.state.json."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarExportChaosGridCellSize(
+	TEXT("ExportChaos.GridCellSize"),
+	0.0f,
+	TEXT("Size in cm of the XY grid cells of a partitioned export, 0 writes the whole map into one PhysicScene.\n")
+	TEXT("Each cell goes to PhysicScene/<Map>/cell_<X>_<Y>.json, listed by PhysicScene/<Map>.cells.json."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarExportChaosStaticAggregateCellSize(
+	TEXT("ExportChaos.StaticAggregateCellSize"),
+	0.0f,
+	TEXT("Size in cm of the cubic cells static bodies (not simulating, not movable) are merged by, 0 keeps one body per component.\n")
+	TEXT("The bodies of each cell are written as one \"StaticAggregates\" entry, a single server particle with a shape per body."),
+	ECVF_Default);
+
+// stops a running export and waits for its thread, defined with the export pipeline below
+void CancelPhysicExport();
+
 #define LOCTEXT_NAMESPACE "FExportChaosEditorModule"
 
 void FExportChaosEditorModule::StartupModule()
@@ -85,6 +248,7 @@ void FExportChaosEditorModule::ShutdownModule()
 {
 	// This function may be called during shutdown to clean up your module.  For modules that support dynamic reloading,
 	// we call this function before unloading the module.
+	CancelPhysicExport();
 	FExportChaosStyle::Shutdown();
 
 	FExportChaosCommands::Unregister();
@@ -146,656 +310,4358 @@ FString JsonObjToJsonStr(TSharedPtr<FJsonObject> JsonObject)
 	return JsonStr;
 }
 
+FString JsonObjToCondensedJsonStr(TSharedPtr<FJsonObject> JsonObject)
+{
+	FString JsonStr;
+	TSharedRef<TJsonWriter<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>> JsonWriter = TJsonWriterFactory<TCHAR, TCondensedJsonPrintPolicy<TCHAR>>::Create(&JsonStr);
+	FJsonSerializer::Serialize(JsonObject.ToSharedRef(), JsonWriter);
+	return JsonStr;
+}
+
+enum class EInstanceEncoding : int32
+{
+	Objects,
+	PackedFloats,
+	Base64,
+	Quantized,
+};
+
+using FSceneJsonWriter = TJsonWriter<UTF8CHAR, TPrettyJsonPrintPolicy<UTF8CHAR>>;
+using FSceneJsonWriterFactory = TJsonWriterFactory<UTF8CHAR, TPrettyJsonPrintPolicy<UTF8CHAR>>;
+
 template<typename EnumType>
 auto enum_to_int(EnumType e)
 {
 	return static_cast<std::underlying_type_t<EnumType>>(e);
 }
 
-constexpr float DEFAULT_CAPSULE_RADIUS = 50;
-constexpr float DEFAULT_CAPSULE_HALFHEIGHT = 90;
-
-void SaveBodyInstanceDetail(TSharedPtr<FJsonObject> detail_info, FBodyInstance* BodyInstance)
+ChaosScene::PackedTransform ToPackedTransform(const FTransform& Transform)
 {
-	UBodySetup* BodySetup = BodyInstance->GetBodySetup();
-	if (BodySetup == nullptr)
-		return;
-	const auto& default_instance = &BodySetup->DefaultInstance;
-	if (default_instance->SleepFamily != BodyInstance->SleepFamily)
-		detail_info->SetNumberField("SleepFamily", enum_to_int(BodyInstance->SleepFamily));
-	if (default_instance->bUseCCD != BodyInstance->bUseCCD)
-		detail_info->SetBoolField("bUseCCD", BodyInstance->bUseCCD);
-	if (default_instance->bIgnoreAnalyticCollisions != BodyInstance->bIgnoreAnalyticCollisions)
-		detail_info->SetBoolField("bIgnoreAnalyticCollisions", BodyInstance->bIgnoreAnalyticCollisions);
-	if (default_instance->bNotifyRigidBodyCollision != BodyInstance->bNotifyRigidBodyCollision)
-		detail_info->SetBoolField("bNotifyRigidBodyCollision", BodyInstance->bNotifyRigidBodyCollision);
-	if (default_instance->bSmoothEdgeCollisions != BodyInstance->bSmoothEdgeCollisions)
-		detail_info->SetBoolField("bSmoothEdgeCollisions", BodyInstance->bSmoothEdgeCollisions);
-	if (default_instance->bLockTranslation != BodyInstance->bLockTranslation)
-		detail_info->SetBoolField("bLockTranslation", BodyInstance->bLockTranslation);
-	if (default_instance->bLockRotation != BodyInstance->bLockRotation)
-		detail_info->SetBoolField("bLockRotation", BodyInstance->bLockRotation);
-	if (default_instance->bLockXTranslation != BodyInstance->bLockXTranslation)
-		detail_info->SetBoolField("bLockXTranslation", BodyInstance->bLockXTranslation);
-	if (default_instance->bLockYTranslation != BodyInstance->bLockYTranslation)
-		detail_info->SetBoolField("bLockYTranslation", BodyInstance->bLockYTranslation);
-	if (default_instance->bLockZTranslation != BodyInstance->bLockZTranslation)
-		detail_info->SetBoolField("bLockZTranslation", BodyInstance->bLockZTranslation);
-	if (default_instance->bLockXRotation != BodyInstance->bLockXRotation)
-		detail_info->SetBoolField("bLockXRotation", BodyInstance->bLockXRotation);
-	if (default_instance->bLockYRotation != BodyInstance->bLockYRotation)
-		detail_info->SetBoolField("bLockYRotation", BodyInstance->bLockYRotation);
-	if (default_instance->bLockZRotation != BodyInstance->bLockZRotation)
-		detail_info->SetBoolField("bLockZRotation", BodyInstance->bLockZRotation);
-	if (default_instance->bOverrideMaxAngularVelocity != BodyInstance->bOverrideMaxAngularVelocity)
-		detail_info->SetBoolField("bOverrideMaxAngularVelocity", BodyInstance->bOverrideMaxAngularVelocity);
-	if (default_instance->GetMassOverride() != BodyInstance->GetMassOverride())
-		detail_info->SetNumberField("MassOverride", BodyInstance->GetMassOverride());
-	if (default_instance->LinearDamping != BodyInstance->LinearDamping)
-		detail_info->SetNumberField("LinearDamping", BodyInstance->LinearDamping);
-	if (default_instance->AngularDamping != BodyInstance->AngularDamping)
-		detail_info->SetNumberField("AngularDamping", BodyInstance->AngularDamping);
-	if (default_instance->CustomDOFPlaneNormal != BodyInstance->CustomDOFPlaneNormal)
-		detail_info->SetStringField("CustomDOFPlaneNormal", BodyInstance->CustomDOFPlaneNormal.ToString());
-	if (default_instance->COMNudge != BodyInstance->COMNudge)
-		detail_info->SetStringField("COMNudge", BodyInstance->COMNudge.ToString());
-	if (default_instance->MassScale != BodyInstance->MassScale)
-		detail_info->SetNumberField("MassScale", BodyInstance->MassScale);
-	if (default_instance->InertiaTensorScale != BodyInstance->InertiaTensorScale)
-		detail_info->SetStringField("InertiaTensorScale", BodyInstance->InertiaTensorScale.ToString());
-	if (default_instance->MaxAngularVelocity != BodyInstance->MaxAngularVelocity)
-		detail_info->SetNumberField("MaxAngularVelocity", BodyInstance->MaxAngularVelocity);
-	if (default_instance->CustomSleepThresholdMultiplier != BodyInstance->CustomSleepThresholdMultiplier)
-		detail_info->SetNumberField("CustomSleepThresholdMultiplier", BodyInstance->CustomSleepThresholdMultiplier);
-	if (default_instance->StabilizationThresholdMultiplier != BodyInstance->StabilizationThresholdMultiplier)
-		detail_info->SetNumberField("StabilizationThresholdMultiplier", BodyInstance->StabilizationThresholdMultiplier);
+	const FVector Translation = Transform.GetTranslation();
+	const FQuat Rotation = Transform.GetRotation();
+	const FVector Scale3D = Transform.GetScale3D();
 
+	ChaosScene::PackedTransform Packed;
+	Packed.Translation[0] = static_cast<float>(Translation.X);
+	Packed.Translation[1] = static_cast<float>(Translation.Y);
+	Packed.Translation[2] = static_cast<float>(Translation.Z);
+	Packed.Rotation[0] = static_cast<float>(Rotation.X);
+	Packed.Rotation[1] = static_cast<float>(Rotation.Y);
+	Packed.Rotation[2] = static_cast<float>(Rotation.Z);
+	Packed.Rotation[3] = static_cast<float>(Rotation.W);
+	Packed.Scale3D[0] = static_cast<float>(Scale3D.X);
+	Packed.Scale3D[1] = static_cast<float>(Scale3D.Y);
+	Packed.Scale3D[2] = static_cast<float>(Scale3D.Z);
+	return Packed;
 }
 
-enum class EPhysicFieldType : uint8
+void CopyGuid(const FGuid& Guid, uint32_t (&Out)[4])
 {
-	None,
-	DirectionalForce, //向一个方向施加一个力
-};
-
-
-
+	Out[0] = Guid.A;
+	Out[1] = Guid.B;
+	Out[2] = Guid.C;
+	Out[3] = Guid.D;
+}
 
+// Mask, BoolBits and values of the overridden fields of a body, see ChaosScene::BodyOverrideFields.
+using FBodyOverrides = TArray<uint32, TInlineAllocator<8>>;
 
-void ExportLandscape(FString SavePath, ALandscape* landscape, TArray<TSharedPtr<FJsonValue>>& LandInfoArray)
+// Collects the fixed-layout sections of the binary PhysicScene while the json is being built.
+class FChaosSceneBinaryWriter
 {
-	ULandscapeInfo* Info = landscape->GetLandscapeInfo();
-	if (Info == nullptr)
-		return;
-	TSharedPtr<FJsonObject> land_info = MakeShareable(new FJsonObject);
-	land_info->SetNumberField("LandID", landscape->GetUniqueID());
-	land_info->SetStringField("LandGuid", landscape->GetLandscapeGuid().ToString());
-	land_info->SetNumberField("LandscapeSectionOffsetX", landscape->LandscapeSectionOffset.X);
-	land_info->SetNumberField("LandscapeSectionOffsetY", landscape->LandscapeSectionOffset.Y);
-	land_info->SetStringField("ActorToWorld", landscape->ActorToWorld().ToString());
-	land_info->SetStringField("LandscapeActorToWorld", landscape->LandscapeActorToWorld().ToString());
-	
-	TArray<TSharedPtr<FJsonValue >> CollisionInfoArray;
-	for (const auto& [key, CollisionComponent] : Info->XYtoCollisionComponentMap)
+public:
+	FChaosSceneBinaryWriter()
 	{
-		if (CollisionComponent->CookedCollisionData.Num() == 0)
-			continue;
-		
-		FString PackageFileName = SavePath / CollisionComponent->GetName() + ".data";
-		TUniquePtr<FArchive> FileAr(IFileManager::Get().CreateFileWriter(*PackageFileName));
-		if (FileAr == NULL)
-			continue;
-		CollisionComponent->CookedCollisionData.BulkSerialize(*FileAr);
-		FileAr->Close();
-			
-		TSharedPtr<FJsonObject> coll_info = MakeShareable(new FJsonObject);
-		coll_info->SetNumberField("OwnerID", landscape->GetUniqueID());
-		coll_info->SetNumberField("CompID", CollisionComponent->GetUniqueID());
-		coll_info->SetStringField("Package", CollisionComponent->GetName());
-		coll_info->SetNumberField("SectionBaseX", CollisionComponent->SectionBaseX);
-		coll_info->SetNumberField("SectionBaseY", CollisionComponent->SectionBaseY);
-		coll_info->SetNumberField("SimpleCollisionSizeQuads", CollisionComponent->SimpleCollisionSizeQuads);
-		coll_info->SetNumberField("CollisionScale", CollisionComponent->CollisionScale);
-		coll_info->SetNumberField("CollisionSizeQuads", CollisionComponent->CollisionSizeQuads);
-		coll_info->SetStringField("HeightfieldGuid", CollisionComponent->HeightfieldGuid.ToString());
-		coll_info->SetStringField("Transform", CollisionComponent->GetComponentTransform().ToString());
-		CollisionInfoArray.Add(MakeShareable(new FJsonValueObject(coll_info)));
-		
+		// offset 0 is the empty string and the empty override set
+		Strings.Add(0);
+		BodyOverrides.AddZeroed(2);
 	}
-	land_info->SetArrayField("collions", CollisionInfoArray);
-
-	LandInfoArray.Add(MakeShareable(new FJsonValueObject(land_info)));
-}
 
-bool FExportChaosEditorModule::ExportPhysicData()
-{
-	// UWorld* World = GEditor->GetEditorWorldContext(false).World();
-	UWorld* World = NULL;
+	uint32 AddString(const FString& Str)
+	{
+		if (Str.IsEmpty())
+			return 0;
+		FTCHARToUTF8 Utf8(*Str);
+		const uint32 Offset = Strings.Num();
+		Strings.Append(reinterpret_cast<const uint8*>(Utf8.Get()), Utf8.Length());
+		Strings.Add(0);
+		return Offset;
+	}
 
-	auto WorldList = GEngine->GetWorldContexts();
-	for (int32 i = 0; i < WorldList.Num(); ++i)
+	// Identical override sets are stored once, returns the word offset of the set.
+	uint32 AddBodyOverrides(const FBodyOverrides& Overrides)
 	{
-		UWorld* local_World = WorldList[i].World();
-		if (local_World && UKismetSystemLibrary::IsValid(local_World))
+		if (Overrides[0] == 0)
+			return 0;
+		const uint64 Hash = CityHash64(reinterpret_cast<const char*>(Overrides.GetData()), Overrides.Num() * sizeof(uint32));
+		if (const uint32* Offset = BodyOverrideOffsets.Find(Hash))
 		{
-			World = local_World;
-			break;
+			if (FMemory::Memcmp(&BodyOverrides[*Offset], Overrides.GetData(), Overrides.Num() * sizeof(uint32)) == 0)
+				return *Offset;
 		}
+		const uint32 Offset = BodyOverrides.Num();
+		BodyOverrides.Append(Overrides);
+		BodyOverrideOffsets.Add(Hash, Offset);
+		return Offset;
 	}
-	if (!World) return false;
 
-	FString MapName = World->GetMapName();
-	//World->bDebugDrawAllTraceTags = true;
-	//FVector Start = FVector(1680, 1240, 60);
-	//FVector End = FVector(1680, 1740, 60);
-	//FQuat   Rot = FQuat(0, 0, 0, 1);
+	bool SaveToFile(const FString& FilePath) const
+	{
+		using namespace ChaosScene;
+		constexpr uint32 SectionCount = static_cast<uint32>(ESection::Count);
 
-	//for (TObjectIterator<ALandscape> It; It; ++It)
-	//{
-	//	if (It->GetWorld() == World)
-	//	{
-	//		auto Landscape = *It;
-	//		auto height_1 = Landscape->GetHeightAtLocation({ -5130.000000,-6500.000000,1360.000000 }, EHeightfieldSource::Complex);
-	//		auto height_2 = Landscape->GetHeightAtLocation({ 1600.000000,-6500.000000,0.000000 }, EHeightfieldSource::Complex);
-	//		UE_LOG(LogTemp, Warning, TEXT("ID:%d %f %f"), Landscape->GetUniqueID(), height_1.GetValue(), height_2.GetValue());
-	//	}
-	//}
-	
-	//if(true)
-	//{
-	//	static FCollisionShape CollisionShape = FCollisionShape::MakeCapsule(DEFAULT_CAPSULE_RADIUS, DEFAULT_CAPSULE_HALFHEIGHT);
+		TArray<uint8> Buffer;
+		Buffer.SetNumZeroed(sizeof(SceneHeader) + SectionCount * sizeof(SectionEntry));
 
-	//	ECollisionChannel                         TraceChannel = ECC_WorldStatic;
-	//	const struct FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam;
-	//	const struct FCollisionResponseParams& ResponseParams = FCollisionResponseParams::DefaultResponseParam;
-	//	const struct FCollisionObjectQueryParams& ObjectParams = FCollisionObjectQueryParams::DefaultObjectQueryParam;
-	//	struct FHitResult                         OutHit;
-	//	if (FPhysicsInterface::GeomSweepSingle(World,
-	//		CollisionShape,
-	//		Rot,
-	//		OutHit,
-	//		Start,
-	//		End,
-	//		TraceChannel,
-	//		Params,
-	//		ResponseParams,
-	//		ObjectParams) == true)
-	//	{
-	//		UE_LOG(LogTemp, Warning, TEXT("XXXXXXX"));
-	//	}
-	//	else
-	//	{
-	//		UE_LOG(LogTemp, Warning, TEXT("YYYYYYY"));
-	//	}
+		TArray<SectionEntry> Sections;
+		AppendSection(Buffer, Sections, ESection::Strings, Strings);
+		AppendSection(Buffer, Sections, ESection::BodySetups, BodySetups);
+		AppendSection(Buffer, Sections, ESection::StaticMeshBodies, StaticMeshBodies);
+		AppendSection(Buffer, Sections, ESection::InstancedBodies, InstancedBodies);
+		AppendSection(Buffer, Sections, ESection::InstanceTransforms, InstanceTransforms);
+		AppendSection(Buffer, Sections, ESection::Constraints, Constraints);
+		AppendSection(Buffer, Sections, ESection::PhysicFields, PhysicFields);
+		AppendSection(Buffer, Sections, ESection::Landscapes, Landscapes);
+		AppendSection(Buffer, Sections, ESection::LandscapeCollisions, LandscapeCollisions);
+		AppendSection(Buffer, Sections, ESection::StaticBVHNodes, StaticBVHNodes);
+		AppendSection(Buffer, Sections, ESection::StaticBVHPrims, StaticBVHPrims);
+		AppendSection(Buffer, Sections, ESection::QuantizedInstanceChunks, QuantizedInstanceChunks);
+		AppendSection(Buffer, Sections, ESection::QuantizedInstanceData, QuantizedInstanceData);
+		AppendSection(Buffer, Sections, ESection::StaticAggregates, StaticAggregates);
+		AppendSection(Buffer, Sections, ESection::AggregateShapes, AggregateShapes);
+		AppendSection(Buffer, Sections, ESection::CollisionLODs, CollisionLODs);
+		AppendSection(Buffer, Sections, ESection::CollisionLODVertices, CollisionLODVertices);
+		AppendSection(Buffer, Sections, ESection::BodyOverrides, BodyOverrides);
+		AppendSection(Buffer, Sections, ESection::ConstraintProfiles, ConstraintProfiles);
+		AppendSection(Buffer, Sections, ESection::ConstraintIslands, ConstraintIslands);
+		AppendSection(Buffer, Sections, ESection::IslandBodies, IslandBodies);
+		AppendSection(Buffer, Sections, ESection::IslandConstraints, IslandConstraints);
+		check(Sections.Num() == SectionCount);
 
-	//}
+		SceneHeader Header;
+		Header.Magic = ChaosScene::Magic;
+		Header.Version = ChaosScene::Version;
+		Header.SectionCount = SectionCount;
+		Header.SectionTableOffset = sizeof(SceneHeader);
+		Header.FileSize = Buffer.Num();
+		FMemory::Memcpy(Buffer.GetData(), &Header, sizeof(Header));
+		FMemory::Memcpy(Buffer.GetData() + Header.SectionTableOffset, Sections.GetData(), Sections.Num() * sizeof(SectionEntry));
 
-	struct BodySetupData
-	{
-		std::vector<UStaticMeshComponent*> static_mesh;
-		std::vector<UInstancedStaticMeshComponent*> instanced_static_mesh;
-	};
-	std::unordered_map<UBodySetup*, BodySetupData> BodySetupMap;
-	
-	struct SaveConstraintData
-	{
-		uint32_t OwnerID = 0;
-		uint32_t CompID = 0;
-		uint32_t ActorID1 = 0;
-		uint32_t ActorID2 = 0;
-		FTransform Transform;
-		FConstraintProfileProperties profile;
-	};
-	
-	std::vector<SaveConstraintData> ConstraintDataSet;
+		// Same as the json, a failed or interrupted save never leaves a partial .pscene in place
+		const FString TempFilePath = FilePath + TEXT(".tmp");
+		if (!FFileHelper::SaveArrayToFile(Buffer, *TempFilePath) || !IFileManager::Get().Move(*FilePath, *TempFilePath, true))
+		{
+			IFileManager::Get().Delete(*TempFilePath);
+			return false;
+		}
+		return true;
+	}
 
-	struct SavePhysicFieldData
-	{
-		uint32_t OwnerID = 0;
-		uint32_t CompID = 0;
-		FTransform Transform;
-		FVector Direction;
-		float Magnitude = 1.0f;
-		bool bEnable = false;
-		uint8_t FieldType = 0;
-	};
-	std::vector<SavePhysicFieldData> PhysicFieldDataSet;
-	
-	TArray<TSharedPtr<FJsonValue>> LandInfoArray;
-	
-	for (TActorIterator<AActor> It(World); It; ++It)
+	// Appends the instances of one component, either as PackedTransforms or as its quantized chunks
+	// (FirstInstance and DataOffset relative to the component). Returns the index of its first instance.
+	uint32 AddInstances(const TArray<ChaosScene::PackedTransform>& Packed, const TArray<ChaosScene::QuantizedInstanceChunk>& Chunks, const TArray<uint8>& ChunkData)
 	{
-		AActor* actor = *It;
-		if (actor == nullptr)
-			continue;
-		if (actor->GetClass()->GetName() == "DirectionalForce_C")
-		{
-			auto pComponent = actor->FindComponentByClass(UFieldSystemComponent::StaticClass());
-			SavePhysicFieldData data;
-			data.OwnerID = actor->GetUniqueID();
-			data.CompID = (pComponent) ? pComponent->GetUniqueID() : actor->GetUniqueID();
-			data.Transform = actor->GetTransform();
-			data.bEnable = true;
-			data.FieldType = static_cast<uint8_t>(EPhysicFieldType::DirectionalForce);
-			//auto FieldSysComp = actor->FindComponentByClass(UFieldSystemComponent::StaticClass());
-			PhysicFieldDataSet.emplace_back(std::move(data));
-				
-			
-			continue;
+		const uint32 FirstInstance = NumInstances;
+		if (Chunks.Num() > 0)
+		{
+			const uint64 DataBase = Align(QuantizedInstanceData.Num(), ChaosScene::SectionAlignment);
+			QuantizedInstanceData.SetNumZeroed(DataBase);
+			QuantizedInstanceData.Append(ChunkData);
+			for (ChaosScene::QuantizedInstanceChunk Chunk : Chunks)
+			{
+				Chunk.FirstInstance += FirstInstance;
+				Chunk.DataOffset += DataBase;
+				QuantizedInstanceChunks.Add(Chunk);
+			}
 		}
-		 
-		if (actor->GetClass() == ALandscape::StaticClass())
+		else
 		{
-			FString SavePath = FPaths::ProjectSavedDir() / "Cooked/LinuxServer" / FApp::GetProjectName() / "Content/Landscape" / MapName;
-			ALandscape* landscape = Cast<ALandscape>(actor);
-			ExportLandscape(SavePath, landscape, LandInfoArray);
+			InstanceTransforms.Append(Packed);
+		}
+		NumInstances += Packed.Num();
+		return FirstInstance;
+	}
 
+	TArray<uint8> Strings;
+	TArray<ChaosScene::BodySetupRecord> BodySetups;
+	TArray<ChaosScene::BodyRecord> StaticMeshBodies;
+	TArray<ChaosScene::InstancedBodyRecord> InstancedBodies;
+	TArray<ChaosScene::PackedTransform> InstanceTransforms;
+	TArray<ChaosScene::ConstraintRecord> Constraints;
+	TArray<ChaosScene::PhysicFieldRecord> PhysicFields;
+	TArray<ChaosScene::LandscapeRecord> Landscapes;
+	TArray<ChaosScene::LandscapeCollisionRecord> LandscapeCollisions;
+	TArray<ChaosScene::BVHNode> StaticBVHNodes;
+	TArray<ChaosScene::StaticBVHPrim> StaticBVHPrims;
+	TArray<ChaosScene::QuantizedInstanceChunk> QuantizedInstanceChunks;
+	TArray<uint8> QuantizedInstanceData;
+	TArray<ChaosScene::StaticAggregateRecord> StaticAggregates;
+	TArray<ChaosScene::BodyRecord> AggregateShapes;
+	TArray<ChaosScene::CollisionLODRecord> CollisionLODs;
+	TArray<ChaosScene::CollisionLODVertex> CollisionLODVertices;
+	TArray<uint32> BodyOverrides;
+	TArray<uint32> ConstraintProfiles;	// string, condensed json of FConstraintProfileProperties
+	TArray<ChaosScene::ConstraintIslandRecord> ConstraintIslands;
+	TArray<uint32> IslandBodies;
+	TArray<uint32> IslandConstraints;
+	uint32 NumInstances = 0;	// InstanceTransforms or quantized
 
-			continue;
-		}
-		
+private:
+	TMap<uint64, uint32> BodyOverrideOffsets;	// content hash -> offset in BodyOverrides
+
+	template<typename RecordType>
+	static void AppendSection(TArray<uint8>& Buffer, TArray<ChaosScene::SectionEntry>& Sections, ChaosScene::ESection Type, const TArray<RecordType>& Records)
+	{
+		Buffer.SetNumZeroed(Align(Buffer.Num(), ChaosScene::SectionAlignment));
+
+		ChaosScene::SectionEntry Entry;
+		Entry.Type = static_cast<uint32_t>(Type);
+		Entry.Stride = sizeof(RecordType);
+		Entry.Offset = Buffer.Num();
+		Entry.Count = Records.Num();
+		Entry.Size = Records.Num() * sizeof(RecordType);
+		Buffer.Append(reinterpret_cast<const uint8*>(Records.GetData()), Records.Num() * sizeof(RecordType));
+		Sections.Add(Entry);
+	}
+};
 
-		for (UActorComponent* ActorComponent : actor->GetComponents())
+// Content hashes of everything the previous export saved, cooked or wrote, kept as PhysicScene/<Map>.manifest.json.
+// Entries that hash the same as last time (and whose output still exists) are skipped.
+class FExportManifest
+{
+public:
+	static constexpr int32 Version = 1;
+
+	void Load(const FString& FilePath)
+	{
+		Previous.Reset();
+		FString JsonStr;
+		if (!FFileHelper::LoadFileToString(JsonStr, *FilePath))
+			return;
+		TSharedPtr<FJsonObject> JsonObject = JsonStrToJsonObj(JsonStr);
+		if (!JsonObject.IsValid() || JsonObject->GetIntegerField(TEXT("Version")) != Version)
+			return;
+		for (const auto& [SectionName, SectionValue] : JsonObject->Values)
 		{
-			if (ActorComponent->IsEditorOnly())
+			const TSharedPtr<FJsonObject>* SectionObject = nullptr;
+			if (!SectionValue->TryGetObject(SectionObject))
 				continue;
-			
-			if (UPrimitiveComponent* PriComponent = Cast<UPrimitiveComponent>(ActorComponent))
-			{
-				if (PriComponent->IsCollisionEnabled() == false)
-					continue;
-			}
-			
-			if (UInstancedStaticMeshComponent* InstancedStaticMeshComponent = Cast<UInstancedStaticMeshComponent>(ActorComponent))
+			auto& Section = Previous.FindOrAdd(SectionName);
+			for (const auto& [Key, HashValue] : (*SectionObject)->Values)
 			{
-				auto BodySetup = InstancedStaticMeshComponent->GetBodySetup();
-				if (BodySetup->AggGeom.GetElementCount() <= 0)
-					continue;
-
-				auto& data = BodySetupMap[BodySetup];
-				data.instanced_static_mesh.push_back(InstancedStaticMeshComponent);
+				Section.Add(Key, FParse::HexNumber64(*HashValue->AsString()));
 			}
-			else if (UStaticMeshComponent* StaticMeshComponent = Cast<UStaticMeshComponent>(ActorComponent))
-			{
-				auto BodySetup = StaticMeshComponent->GetBodySetup();
-				if (BodySetup->AggGeom.GetElementCount() <= 0)
-					continue;
+		}
+	}
 
-				auto& data = BodySetupMap[BodySetup];
-				data.static_mesh.push_back(StaticMeshComponent);
-			}
-			else if (UPhysicsConstraintComponent* ConstraintComponent = Cast<UPhysicsConstraintComponent>(ActorComponent))
+	bool Save(const FString& FilePath) const
+	{
+		TSharedRef<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
+		JsonObject->SetNumberField(TEXT("Version"), Version);
+		for (const auto& [SectionName, Section] : Current)
+		{
+			TSharedPtr<FJsonObject> SectionObject = MakeShareable(new FJsonObject);
+			for (const auto& [Key, Hash] : Section)
 			{
-				SaveConstraintData cs_data;
-				if (ConstraintComponent->ConstraintActor1)
-					cs_data.ActorID1 = ConstraintComponent->ConstraintActor1->GetUniqueID();
-				else
-					cs_data.ActorID1 = actor->GetUniqueID();
-				if (ConstraintComponent->ConstraintActor2)
-					cs_data.ActorID2 = ConstraintComponent->ConstraintActor2->GetUniqueID();
-				else
-					cs_data.ActorID2 = actor->GetUniqueID();
-				cs_data.OwnerID = actor->GetUniqueID();
-				cs_data.CompID = ConstraintComponent->GetUniqueID();
-				cs_data.Transform = ConstraintComponent->GetRelativeTransform();
-				cs_data.profile = ConstraintComponent->ConstraintInstance.ProfileInstance;
-				ConstraintDataSet.emplace_back(std::move(cs_data));
+				SectionObject->SetStringField(Key, FString::Printf(TEXT("%016llx"), Hash));
 			}
-			
-
+			JsonObject->SetObjectField(SectionName, SectionObject);
 		}
+		return FFileHelper::SaveStringToFile(JsonObjToJsonStr(JsonObject), *FilePath);
+	}
 
+	bool HasPrevious() const
+	{
+		return Previous.Num() > 0;
 	}
 
-	ITargetPlatform* TargetPlatform = GetTargetPlatformManager()->FindTargetPlatform(TEXT("LinuxServer"));
-	if (TargetPlatform == nullptr)
+	// Keys of the previous export that this one did not record again.
+	TArray<FString> GetRemoved(const FString& SectionName) const
 	{
-		UE_LOG(LogTemp, Warning, TEXT("Should Add TargetPlatfrom LinuxServer"));
-		return false;
+		TArray<FString> Removed;
+		const auto* PreviousSection = Previous.Find(SectionName);
+		const auto* CurrentSection = Current.Find(SectionName);
+		if (PreviousSection == nullptr)
+			return Removed;
+		for (const auto& [Key, Hash] : *PreviousSection)
+		{
+			if (CurrentSection == nullptr || !CurrentSection->Contains(Key))
+				Removed.Add(Key);
+		}
+		return Removed;
 	}
-	/*{
-		auto loadPkg = LoadPackage(nullptr, ANSI_TO_TCHAR("/Game/Physic/SM_Cube"), LOAD_None);
-		if (loadPkg)
+
+	// Order independent fingerprint of all entries, of the previous export or of this one.
+	uint64 GetFingerprint(bool bPrevious) const
+	{
+		uint64 Fingerprint = 0;
+		for (const auto& [SectionName, Section] : bPrevious ? Previous : Current)
 		{
-			auto NewBodySetup = LoadObject<UBodySetup>(loadPkg, ANSI_TO_TCHAR("BodySetup_1"));
-			check(NewBodySetup);
-			if (NewBodySetup)
+			for (const auto& [Key, Hash] : Section)
 			{
-				check(NewBodySetup->IsAsset());
-				check(NewBodySetup->IsCachedCookedPlatformDataLoaded(TargetPlatform));
+				const FString Entry = SectionName / Key;
+				Fingerprint += CityHash64WithSeed(reinterpret_cast<const char*>(*Entry), Entry.Len() * sizeof(TCHAR), Hash);
 			}
-
 		}
-	}*/
+		return Fingerprint;
+	}
 
-	//save
+	bool IsUnchanged(const FString& SectionName, const FString& Key, uint64 Hash) const
 	{
+		const auto* Section = Previous.Find(SectionName);
+		const uint64* PreviousHash = Section ? Section->Find(Key) : nullptr;
+		return PreviousHash && *PreviousHash == Hash;
+	}
 
-		//TOptional<FArchiveCookData> CookData;
-		//
-		//FString ResolvedRootPath = FPaths::ProjectContentDir() / "Physic";
-		//FString ResolvedMetadataPath = FPaths::ProjectContentDir() / "Physic"/ "Metadata";
-		//
-		//auto ZenStoreWriter = new FZenStoreWriter(ResolvedRootPath, ResolvedMetadataPath, TargetPlatform);
-
-		//ICookedPackageWriter::FCookInfo CookInfo;
-		//CookInfo.bFullBuild = true;
-		//ZenStoreWriter->Initialize(CookInfo);
-		//ZenStoreWriter->BeginCook();
-		//
-		//FSavePackageContext SaveContext(TargetPlatform, ZenStoreWriter);
-
-
-		FSavePackageArgs SaveArgs;
-		//SaveArgs.SavePackageContext = &SaveContext;
-
-		SaveArgs.TopLevelFlags = EObjectFlags::RF_Public;
-		//SaveArgs.SaveFlags = ESaveFlags::SAVE_NoError | ESaveFlags::SAVE_FromAutosave;
-		SaveArgs.Error = GWarn;
+	void Record(const FString& SectionName, const FString& Key, uint64 Hash)
+	{
+		Current.FindOrAdd(SectionName).Add(Key, Hash);
+	}
 
-		TArray<FString> PackageNameArray;
-		TArray<TSharedPtr<FJsonValue>> JsonBodySetupInfoArray;
-		for (const auto& [BodySetup, Data] : BodySetupMap)
+	// Drops entries from a saved manifest, for packages whose deferred cook failed after the export recorded them.
+	static bool RemoveSaved(const FString& FilePath, const FString& SectionName, const TArray<FString>& Keys)
+	{
+		FExportManifest Manifest;
+		Manifest.Load(FilePath);
+		Manifest.Current = Manifest.Previous;
+		if (auto* Section = Manifest.Current.Find(SectionName))
 		{
-			if (BodySetup == nullptr)
-				continue;
-			FString MeshName = BodySetup->GetOuter()->GetName();
-			FString BodySetupName = BodySetup->GetName();
-			UE_LOG(LogTemp, Warning, TEXT("BodySetup:%s Guid:%u"), *MeshName, *BodySetup->BodySetupGuid.ToString());
-
-			FString PackageName = TEXT("/Game/Physic/") + MeshName;
-			UPackage* SavePkg = CreatePackage(*PackageName);
-			SavePkg->ClearFlags(RF_Transient);
-			//SavePkg->SetFlags(RF_Standalone);
-			//SavePkg->SetPackageFlags(PKG_FilterEditorOnly);
-			auto NewBodySetup = FindObject<UBodySetup>(SavePkg, *BodySetup->GetName());
-			if (NewBodySetup == nullptr)
-			{
-				NewBodySetup = DuplicateObject(BodySetup, SavePkg);
-			}
-			else
+			for (const FString& Key : Keys)
 			{
-				NewBodySetup->CopyBodyPropertiesFrom(BodySetup);
+				Section->Remove(Key);
 			}
+		}
+		return Manifest.Save(FilePath);
+	}
 
-			NewBodySetup->SetFlags(EObjectFlags::RF_Public);
-			NewBodySetup->ClearFlags(EObjectFlags::RF_Transient);
-			BodySetup->CookedFormatDataOverride = &BodySetup->CookedFormatData;
-			check(BodySetup->IsCachedCookedPlatformDataLoaded(TargetPlatform));
-			NewBodySetup->bSharedCookedData = true;
-			NewBodySetup->CookedFormatData = BodySetup->CookedFormatData;
-			NewBodySetup->bUseSavedCookData = true;
-			NewBodySetup->AddToRoot();
-
-			FAssetRegistryModule::AssetCreated(NewBodySetup);
-			SavePkg->SetDirtyFlag(true);
+private:
+	TMap<FString, TMap<FString, uint64>> Previous;
+	TMap<FString, TMap<FString, uint64>> Current;
+};
 
-			/*UPackage::Save(SavePkg, NewBodySetup, *NewBodySetup->GetName(), SaveArgs); */
+uint64 HashCombineBytes(uint64 Hash, const void* Data, int64 Size)
+{
+	return CityHash64WithSeed(static_cast<const char*>(Data), Size, Hash);
+}
 
+uint64 HashTransform(uint64 Hash, const FTransform& Transform)
+{
+	const FVector Translation = Transform.GetTranslation();
+	const FQuat Rotation = Transform.GetRotation();
+	const FVector Scale3D = Transform.GetScale3D();
+	const double Values[] = { Translation.X, Translation.Y, Translation.Z, Rotation.X, Rotation.Y, Rotation.Z, Rotation.W, Scale3D.X, Scale3D.Y, Scale3D.Z };
+	return HashCombineBytes(Hash, Values, sizeof(Values));
+}
 
+// Everything that ends up in the exported /Game/Physic package of a BodySetup.
+uint64 HashBodySetup(UBodySetup* BodySetup)
+{
+	uint64 Hash = HashCombineBytes(0, &BodySetup->BodySetupGuid, sizeof(FGuid));
+	for (const auto& [FormatName, BulkData] : BodySetup->CookedFormatData.Formats)
+	{
+		const FString Format = FormatName.ToString();
+		Hash = HashCombineBytes(Hash, *Format, Format.Len() * sizeof(TCHAR));
 
-			FString PackageFileName = FPaths::ProjectContentDir() / "Physic" / MeshName + ".uasset";
-			if (IFileManager::Get().FileExists(*PackageFileName))
-			{
-				IFileManager::Get().Delete(*PackageFileName);
-			}
-			PackageNameArray.Add(MeshName);
-			//FArchiveCookContext CookContext(SavePkg, FArchiveCookContext::ECookTypeUnknown);
-			//if (TargetPlatform != nullptr)
-			//{
-			//	CookData.Emplace(*TargetPlatform, CookContext);
-			//}
+		const int64 Size = BulkData->GetBulkDataSize();
+		if (Size > 0)
+		{
+			const void* Data = BulkData->LockReadOnly();
+			Hash = HashCombineBytes(Hash, Data, Size);
+			BulkData->Unlock();
+		}
+	}
 
-			//SaveArgs.ArchiveCookData = CookData.GetPtrOrNull();
+	const uint8 CollisionTraceFlag = static_cast<uint8>(BodySetup->CollisionTraceFlag.GetValue());
+	Hash = HashCombineBytes(Hash, &CollisionTraceFlag, sizeof(CollisionTraceFlag));
+	const FString PhysMaterial = BodySetup->PhysMaterial ? BodySetup->PhysMaterial->GetPathName() : FString();
+	Hash = HashCombineBytes(Hash, *PhysMaterial, PhysMaterial.Len() * sizeof(TCHAR));
+	return Hash;
+}
 
-			//ICookedPackageWriter::FBeginPackageInfo Info;
-			//Info.PackageName = SavePkg->GetFName();
-			//Info.LooseFilePath = PackageFileName;
-			//ZenStoreWriter->BeginPackage(Info);
+// From the binary property serialization, far cheaper than the json reflection of the profile.
+uint64 HashConstraintProfile(const FConstraintProfileProperties& Profile)
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	FConstraintProfileProperties::StaticStruct()->SerializeBin(Writer, const_cast<FConstraintProfileProperties*>(&Profile));
+	return HashCombineBytes(0, Bytes.GetData(), Bytes.Num());
+}
 
-			UPackage::SavePackage(SavePkg, nullptr, *PackageFileName, SaveArgs);
-			/*GIsCookerLoadingPackage = true;
-			uint32 SaveFlags = SAVE_KeepGUID | SAVE_Async | SAVE_ComputeHash | SAVE_Unversioned;
-			EObjectFlags CookedFlags = RF_Public;
+// Collision of a BodySetup without its Guid, equal for the BodySetups of meshes sharing the same geometry.
+uint64 HashBodySetupContent(UBodySetup* BodySetup)
+{
+	const FKAggregateGeom& AggGeom = BodySetup->AggGeom;
+	const int32 ElementCounts[] = { AggGeom.SphereElems.Num(), AggGeom.BoxElems.Num(), AggGeom.SphylElems.Num(), AggGeom.ConvexElems.Num(), AggGeom.TaperedCapsuleElems.Num() };
+	uint64 Hash = HashCombineBytes(0, ElementCounts, sizeof(ElementCounts));
+	for (const FKSphereElem& Elem : AggGeom.SphereElems)
+	{
+		const double Values[] = { Elem.Center.X, Elem.Center.Y, Elem.Center.Z, Elem.Radius };
+		Hash = HashCombineBytes(Hash, Values, sizeof(Values));
+	}
+	for (const FKBoxElem& Elem : AggGeom.BoxElems)
+	{
+		const double Values[] = { Elem.Center.X, Elem.Center.Y, Elem.Center.Z, Elem.Rotation.Pitch, Elem.Rotation.Yaw, Elem.Rotation.Roll, Elem.X, Elem.Y, Elem.Z };
+		Hash = HashCombineBytes(Hash, Values, sizeof(Values));
+	}
+	for (const FKSphylElem& Elem : AggGeom.SphylElems)
+	{
+		const double Values[] = { Elem.Center.X, Elem.Center.Y, Elem.Center.Z, Elem.Rotation.Pitch, Elem.Rotation.Yaw, Elem.Rotation.Roll, Elem.Radius, Elem.Length };
+		Hash = HashCombineBytes(Hash, Values, sizeof(Values));
+	}
+	for (const FKTaperedCapsuleElem& Elem : AggGeom.TaperedCapsuleElems)
+	{
+		const double Values[] = { Elem.Center.X, Elem.Center.Y, Elem.Center.Z, Elem.Rotation.Pitch, Elem.Rotation.Yaw, Elem.Rotation.Roll, Elem.Radius0, Elem.Radius1, Elem.Length };
+		Hash = HashCombineBytes(Hash, Values, sizeof(Values));
+	}
+	for (const FKConvexElem& Elem : AggGeom.ConvexElems)
+	{
+		Hash = HashTransform(Hash, Elem.GetTransform());
+		Hash = HashCombineBytes(Hash, Elem.VertexData.GetData(), Elem.VertexData.Num() * sizeof(FVector));
+	}
 
-			FSavePackageResultStruct Result = GEditor->Save(SavePkg, nullptr, *PackageFileName, SaveArgs);
-			GIsCookerLoadingPackage = false;*/
+	for (const auto& [FormatName, BulkData] : BodySetup->CookedFormatData.Formats)
+	{
+		const FString Format = FormatName.ToString();
+		Hash = HashCombineBytes(Hash, *Format, Format.Len() * sizeof(TCHAR));
 
-			UPackage::WaitForAsyncFileWrites();
-			/*ICookedPackageWriter::FCommitPackageInfo CommitInfo;
-			CommitInfo.Status = IPackageWriter::ECommitStatus::Success;
-			CommitInfo.PackageName = SavePkg->GetFName();
-			CommitInfo.PackageGuid = FGuid();
-			CommitInfo.WriteOptions = IPackageWriter::EWriteOptions::Write | IPackageWriter::EWriteOptions::ComputeHash;
+		const int64 Size = BulkData->GetBulkDataSize();
+		if (Size > 0)
+		{
+			const void* Data = BulkData->LockReadOnly();
+			Hash = HashCombineBytes(Hash, Data, Size);
+			BulkData->Unlock();
+		}
+	}
 
-			ZenStoreWriter->CommitPackage(MoveTemp(CommitInfo));
+	// the defaults ship in the package too, components only export their overrides of them
+	FString DefaultInstance;
+	FJsonObjectConverter::UStructToJsonObjectString(BodySetup->DefaultInstance, DefaultInstance);
+	Hash = HashCombineBytes(Hash, *DefaultInstance, DefaultInstance.Len() * sizeof(TCHAR));
+	const uint8 Flags[] = { static_cast<uint8>(BodySetup->CollisionTraceFlag.GetValue()), static_cast<uint8>(BodySetup->PhysicsType.GetValue()), static_cast<uint8>(BodySetup->bDoubleSidedGeometry) };
+	Hash = HashCombineBytes(Hash, Flags, sizeof(Flags));
+	const FString PhysMaterial = BodySetup->PhysMaterial ? BodySetup->PhysMaterial->GetPathName() : FString();
+	return HashCombineBytes(Hash, *PhysMaterial, PhysMaterial.Len() * sizeof(TCHAR));
+}
 
-			check(IFileManager::Get().FileExists(*PackageFileName));*/
+uint64 HashLandscapeCollision(ULandscapeHeightfieldCollisionComponent* CollisionComponent)
+{
+	uint64 Hash = HashCombineBytes(0, &CollisionComponent->HeightfieldGuid, sizeof(FGuid));
+	Hash = HashTransform(Hash, CollisionComponent->GetComponentTransform());
+	return HashCombineBytes(Hash, CollisionComponent->CookedCollisionData.GetData(), CollisionComponent->CookedCollisionData.Num());
+}
 
+constexpr float DEFAULT_CAPSULE_RADIUS = 50;
+constexpr float DEFAULT_CAPSULE_HALFHEIGHT = 90;
+
+// Reads one ChaosScene::BodyOverrideFields entry of a FBodyInstance as its value words, a Bool as one word.
+struct FBodyOverrideAccessor
+{
+	const char* Name;
+	void (*Read)(const FBodyInstance& Body, uint32* OutWords);
+};
+
+#define BODY_OVERRIDE_BOOL(Member) { #Member, [](const FBodyInstance& Body, uint32* OutWords) { OutWords[0] = Body.Member ? 1 : 0; } }
+#define BODY_OVERRIDE_ENUM(Member) { #Member, [](const FBodyInstance& Body, uint32* OutWords) { OutWords[0] = static_cast<uint32>(enum_to_int(Body.Member)); } }
+#define BODY_OVERRIDE_FLOAT(Name, Value) { Name, [](const FBodyInstance& Body, uint32* OutWords) { const float Float = Value; FMemory::Memcpy(OutWords, &Float, sizeof(Float)); } }
+#define BODY_OVERRIDE_VECTOR(Member) { #Member, [](const FBodyInstance& Body, uint32* OutWords) { const FVector3f Vector(Body.Member); FMemory::Memcpy(OutWords, &Vector, sizeof(Vector)); } }
+
+// same order as ChaosScene::BodyOverrideFields, checked below
+constexpr FBodyOverrideAccessor BodyOverrideAccessors[] = {
+	BODY_OVERRIDE_ENUM(SleepFamily),
+	BODY_OVERRIDE_BOOL(bUseCCD),
+	BODY_OVERRIDE_BOOL(bIgnoreAnalyticCollisions),
+	BODY_OVERRIDE_BOOL(bNotifyRigidBodyCollision),
+	BODY_OVERRIDE_BOOL(bSmoothEdgeCollisions),
+	BODY_OVERRIDE_BOOL(bLockTranslation),
+	BODY_OVERRIDE_BOOL(bLockRotation),
+	BODY_OVERRIDE_BOOL(bLockXTranslation),
+	BODY_OVERRIDE_BOOL(bLockYTranslation),
+	BODY_OVERRIDE_BOOL(bLockZTranslation),
+	BODY_OVERRIDE_BOOL(bLockXRotation),
+	BODY_OVERRIDE_BOOL(bLockYRotation),
+	BODY_OVERRIDE_BOOL(bLockZRotation),
+	BODY_OVERRIDE_BOOL(bOverrideMaxAngularVelocity),
+	BODY_OVERRIDE_FLOAT("MassOverride", Body.GetMassOverride()),
+	BODY_OVERRIDE_FLOAT("LinearDamping", Body.LinearDamping),
+	BODY_OVERRIDE_FLOAT("AngularDamping", Body.AngularDamping),
+	BODY_OVERRIDE_VECTOR(CustomDOFPlaneNormal),
+	BODY_OVERRIDE_VECTOR(COMNudge),
+	BODY_OVERRIDE_FLOAT("MassScale", Body.MassScale),
+	BODY_OVERRIDE_VECTOR(InertiaTensorScale),
+	BODY_OVERRIDE_FLOAT("MaxAngularVelocity", Body.MaxAngularVelocity),
+	BODY_OVERRIDE_FLOAT("CustomSleepThresholdMultiplier", Body.CustomSleepThresholdMultiplier),
+	BODY_OVERRIDE_FLOAT("StabilizationThresholdMultiplier", Body.StabilizationThresholdMultiplier),
+};
+
+#undef BODY_OVERRIDE_BOOL
+#undef BODY_OVERRIDE_ENUM
+#undef BODY_OVERRIDE_FLOAT
+#undef BODY_OVERRIDE_VECTOR
+
+constexpr bool BodyOverrideAccessorsMatchFields()
+{
+	for (uint32 i = 0; i < ChaosScene::BodyOverrideFieldCount; ++i)
+	{
+		const char* A = BodyOverrideAccessors[i].Name;
+		const char* B = ChaosScene::BodyOverrideFields[i].Name;
+		while (*A != 0 && *A == *B)
+		{
+			++A;
+			++B;
+		}
+		if (*A != *B)
+			return false;
+	}
+	return true;
+}
+static_assert(UE_ARRAY_COUNT(BodyOverrideAccessors) == ChaosScene::BodyOverrideFieldCount && BodyOverrideAccessorsMatchFields(),
+	"BodyOverrideAccessors out of sync with ChaosScene::BodyOverrideFields");
+
+// Override set of BodyInstance against the DefaultInstance of its BodySetup, values are compared as stored.
+void SaveBodyInstanceOverrides(const FBodyInstance& BodyInstance, FBodyOverrides& OutOverrides)
+{
+	using namespace ChaosScene;
+	OutOverrides.Init(0, 2);	// Mask, BoolBits
+	const UBodySetup* BodySetup = BodyInstance.GetBodySetup();
+	if (BodySetup == nullptr)
+		return;
+
+	const FBodyInstance& DefaultInstance = BodySetup->DefaultInstance;
+	for (uint32 i = 0; i < BodyOverrideFieldCount; ++i)
+	{
+		uint32 Value[3];
+		uint32 DefaultValue[3];
+		BodyOverrideAccessors[i].Read(BodyInstance, Value);
+		BodyOverrideAccessors[i].Read(DefaultInstance, DefaultValue);
+		const EBodyOverrideType Type = BodyOverrideFields[i].Type;
+		const uint32 NumWords = BodyOverrideValueWords(Type);
+		if (FMemory::Memcmp(Value, DefaultValue, FMath::Max(NumWords, 1u) * sizeof(uint32)) == 0)
+			continue;
+
+		OutOverrides[0] |= 1u << i;
+		if (Type == EBodyOverrideType::Bool)
+		{
+			OutOverrides[1] |= Value[0] << i;
+		}
+		else
+		{
+			OutOverrides.Append(Value, NumWords);
+		}
+	}
+}
+
+enum class EPhysicFieldType : uint8
+{
+	None,
+	DirectionalForce, //向一个方向施加一个力
+};
+
+// Console options, read once on the game thread when an export starts.
+struct FExportChaosOptions
+{
+	bool bBinaryScene = false;
+	EInstanceEncoding InstanceEncoding = EInstanceEncoding::Objects;
+	float InstanceQuantizationStep = 0.1f;
+	bool bInstanceCompression = true;
+	bool bInstancesFromSMData = false;
+	bool bIncremental = true;
+	int32 CookShards = 0;
+	int32 CookRetries = 1;
+	bool bBatchedPackageSaves = true;
+	bool bDirectBodySetups = false;
+	FString CollisionLOD;
+	bool bLandscapeArchive = false;
+	bool bLandscapeHeights = false;
+	bool bStaticBVH = false;
+	float GridCellSize = 0.0f;
+	float StaticAggregateCellSize = 0.0f;
+	bool bDedupBodySetups = true;
+	bool bParallelSerialize = true;
+	bool bDelta = false;
+	FString DeferredCookList;	// set for the workers of a parallel commandlet, see ExportChaosPhysicScene
+
+	static FExportChaosOptions FromConsoleVariables()
+	{
+		FExportChaosOptions Options;
+		Options.bBinaryScene = CVarExportChaosBinaryScene.GetValueOnGameThread() != 0;
+		Options.InstanceEncoding = static_cast<EInstanceEncoding>(FMath::Clamp(CVarExportChaosInstanceEncoding.GetValueOnGameThread(), 0, 3));
+		Options.InstanceQuantizationStep = FMath::Max(CVarExportChaosInstanceQuantizationStep.GetValueOnGameThread(), 0.01f);
+		Options.bInstanceCompression = CVarExportChaosInstanceCompression.GetValueOnGameThread();
+		Options.bInstancesFromSMData = CVarExportChaosInstancesFromSMData.GetValueOnGameThread();
+		Options.bIncremental = CVarExportChaosIncremental.GetValueOnGameThread();
+		Options.CookShards = CVarExportChaosCookShards.GetValueOnGameThread();
+		Options.CookRetries = CVarExportChaosCookRetries.GetValueOnGameThread();
+		Options.bBatchedPackageSaves = CVarExportChaosBatchedPackageSaves.GetValueOnGameThread();
+		Options.bDirectBodySetups = CVarExportChaosDirectBodySetups.GetValueOnGameThread();
+		Options.CollisionLOD = CVarExportChaosCollisionLOD.GetValueOnGameThread();
+		Options.bLandscapeArchive = CVarExportChaosLandscapeArchive.GetValueOnGameThread();
+		Options.bLandscapeHeights = CVarExportChaosLandscapeHeights.GetValueOnGameThread();
+		Options.bStaticBVH = CVarExportChaosStaticBVH.GetValueOnGameThread();
+		Options.GridCellSize = FMath::Max(CVarExportChaosGridCellSize.GetValueOnGameThread(), 0.0f);
+		Options.StaticAggregateCellSize = FMath::Max(CVarExportChaosStaticAggregateCellSize.GetValueOnGameThread(), 0.0f);
+		Options.bDedupBodySetups = CVarExportChaosDedupBodySetups.GetValueOnGameThread();
+		Options.bParallelSerialize = CVarExportChaosParallelSerialize.GetValueOnGameThread();
+		Options.bDelta = CVarExportChaosDelta.GetValueOnGameThread();
+		return Options;
+	}
+};
+
+// Plain copies of the world taken on the game thread, the rest of the export only reads these.
+struct SaveBodyData
+{
+	uint32_t ActorID = 0;
+	uint32_t CompID = 0;
+	FString Name;
+	FTransform Transform;
+	bool bSimulatePhysics = false;
+	bool bEnableGravity = false;
+	bool bStartAwake = false;
+	bool bMovable = false;
+	FBodyOverrides Overrides;	// see ChaosScene::BodyOverrideFields
+	TArray<FTransform> Instances;	// instanced static mesh only
+};
+
+// What a .pbody holds, copied from the BodySetup on the game thread.
+struct SaveCookedGeometryData
+{
+	TArray<ChaosScene::BodyShapeRecord> Shapes;
+	TArray<uint8> CookedData;
+	FString CookedFormat;
+	FString DefaultInstance;
+	FString PhysMaterial;
+	uint8 CollisionTraceFlag = 0;
+	uint8 PhysicsType = 0;
+	bool bDoubleSidedGeometry = false;
+};
+
+// Coarse proxy of a BodySetup, see ChaosScene::CollisionLODRecord.
+struct SaveCollisionLODData
+{
+	ChaosScene::ECollisionLOD Type = ChaosScene::ECollisionLOD::Box;
+	FVector Center = FVector::ZeroVector;
+	FVector Extent = FVector::ZeroVector;	// half size, radius in X for a sphere
+	TArray<FVector3f> Vertices;		// hull only
+};
+
+struct SaveBodySetupData
+{
+	FString Package;
+	FString Name;
+	FString Path;
+	FGuid Guid;
+	FBox LocalBounds;		// AggGeom bounds in BodySetup space
+	uint64 Hash = 0;
+	bool bCook = false;		// package saved by this export, still has to be cooked
+	bool bSaveFailed = false;	// kept out of the manifest so the next export retries it
+	TSharedPtr<SaveCookedGeometryData> CookedGeometry;	// set instead of a saved package by a direct export
+	TSharedPtr<const SaveCollisionLODData> CollisionLOD;	// set when an ExportChaos.CollisionLOD rule matched
+	std::vector<SaveBodyData> static_mesh;
+	std::vector<SaveBodyData> instanced_static_mesh;
+};
+
+struct SaveConstraintData
+{
+	uint32_t OwnerID = 0;
+	uint32_t CompID = 0;
+	uint32_t ActorID1 = 0;
+	uint32_t ActorID2 = 0;
+	FTransform Transform;
+	FVector Location;		// world location, picks the grid cell
+	FConstraintProfileProperties profile;
+	uint64 ProfileHash = 0;		// HashConstraintProfile, constraints with the same profile share one table entry
+};
+
+struct SavePhysicFieldData
+{
+	uint32_t OwnerID = 0;
+	uint32_t CompID = 0;
+	FTransform Transform;
+	FVector Direction;
+	float Magnitude = 1.0f;
+	bool bEnable = false;
+	uint8_t FieldType = 0;
+};
+
+struct SaveLandscapeCollisionData
+{
+	uint32_t OwnerID = 0;
+	uint32_t CompID = 0;
+	FString Package;
+	int32 SectionBaseX = 0;
+	int32 SectionBaseY = 0;
+	int32 SimpleCollisionSizeQuads = 0;
+	int32 CollisionSizeQuads = 0;
+	float CollisionScale = 1.0f;
+	FGuid HeightfieldGuid;
+	FTransform Transform;
+	uint64 Hash = 0;
+	bool bWriteData = false;		// .data from the previous export is stale or missing
+	bool bExported = true;			// cleared when the .data could not be written
+	TArray<uint8> CookedCollisionData;	// only kept when bWriteData
+	TArray<uint16> HeightSamples;		// CollisionHeightData, only kept when the landscape heights are written
+};
+
+struct SaveLandscapeData
+{
+	uint32_t LandID = 0;
+	FGuid LandGuid;
+	FIntPoint LandscapeSectionOffset;
+	FTransform ActorToWorld;
+	FTransform LandscapeActorToWorld;
+	bool bArchive = false;			// collisions go to <LandGuid>.ldata, sorted by section
+	bool bWriteArchive = false;		// archive from the previous export is stale or missing
+	uint64 ArchiveHash = 0;
+	bool bHeights = false;			// raw heights go to <LandGuid>.lheight
+	bool bWriteHeights = false;
+	uint64 HeightsHash = 0;
+	std::vector<SaveLandscapeCollisionData> collisions;
+};
+
+// What a <Map>.delta.json holds on top of its added and modified records.
+struct FSceneDeltaInfo
+{
+	uint64 BaseState = 0;				// State of the export the delta applies to
+	TMap<FString, TArray<FString>> Removed;		// section -> keys of the records that are gone
+};
+
+struct FPhysicSceneSnapshot
+{
+	FString MapName;
+	uint64 State = 0;				// fingerprint of every record, only set by delta exports
+	TSharedPtr<const FSceneDeltaInfo> Delta;	// only set on the snapshot of a delta file
+	std::vector<SaveBodySetupData> BodySetupDataSet;
+	std::vector<SaveConstraintData> ConstraintDataSet;
+	std::vector<SavePhysicFieldData> PhysicFieldDataSet;
+	std::vector<SaveLandscapeData> LandscapeDataSet;
+};
+
+FString GetCookedContentDir()
+{
+	return FPaths::ProjectSavedDir() / "Cooked/LinuxServer" / FApp::GetProjectName() / "Content";
+}
+
+FString GetPhysicSceneFilePath(const FString& MapName)
+{
+	return GetCookedContentDir() / "PhysicScene" / MapName + ".json";
+}
+
+FString GetBodySetupFilePath(const FString& Package)
+{
+	return GetCookedContentDir() / "Physic" / Package + ".pbody";
+}
+
+TRACE_DECLARE_INT_COUNTER(ExportChaosBodies, TEXT("ExportChaos/Bodies"));
+TRACE_DECLARE_INT_COUNTER(ExportChaosInstances, TEXT("ExportChaos/Instances"));
+TRACE_DECLARE_INT_COUNTER(ExportChaosPackagesSaved, TEXT("ExportChaos/PackagesSaved"));
+TRACE_DECLARE_INT_COUNTER(ExportChaosPackagesCooked, TEXT("ExportChaos/PackagesCooked"));
+TRACE_DECLARE_INT_COUNTER(ExportChaosBytesWritten, TEXT("ExportChaos/BytesWritten"));
+
+// User + kernel time of the whole process (GetProcessTimes on Windows, getrusage elsewhere), so it includes
+// the other threads of the editor while a phase runs
+double GetProcessCPUSeconds()
+{
+#if PLATFORM_WINDOWS
+	FILETIME CreationTime, ExitTime, KernelTime, UserTime;
+	if (!::GetProcessTimes(::GetCurrentProcess(), &CreationTime, &ExitTime, &KernelTime, &UserTime))
+		return 0.0;
+	// 100 ns units
+	auto ToSeconds = [](const FILETIME& Time) { return ((static_cast<uint64>(Time.dwHighDateTime) << 32) | Time.dwLowDateTime) * 1e-7; };
+	return ToSeconds(KernelTime) + ToSeconds(UserTime);
+#else
+	struct rusage Usage;
+	if (::getrusage(RUSAGE_SELF, &Usage) != 0)
+		return 0.0;
+	return Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec + (Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+// Time, item count and bytes written of every export phase, saved as <Map>.report.json next to the scene.
+// Phases can nest, a phase includes the time of the phases it contains.
+class FExportChaosStats
+{
+public:
+	struct FPhase
+	{
+		FString Name;
+		int32 Calls = 0;
+		double WallSeconds = 0.0;
+		double CPUSeconds = 0.0;
+		int64 Items = 0;
+		int64 Bytes = 0;
+	};
+
+	// Any thread.
+	void AddTime(const TCHAR* Name, double WallSeconds, double CPUSeconds)
+	{
+		FScopeLock ScopeLock(&Lock);
+		FPhase& Phase = FindOrAddPhase(Name);
+		Phase.Calls++;
+		Phase.WallSeconds += WallSeconds;
+		Phase.CPUSeconds += CPUSeconds;
+	}
+
+	// Any thread.
+	void Add(const TCHAR* Name, int64 Items, int64 Bytes = 0)
+	{
+		FScopeLock ScopeLock(&Lock);
+		FPhase& Phase = FindOrAddPhase(Name);
+		Phase.Items += Items;
+		Phase.Bytes += Bytes;
+		TRACE_COUNTER_ADD(ExportChaosBytesWritten, Bytes);
+	}
+
+	// Size of what ended up in the scene, independent of the time it took.
+	void SetCounter(const TCHAR* Name, int64 Value)
+	{
+		FScopeLock ScopeLock(&Lock);
+		Counters.Add(Name, Value);
+	}
+
+	bool SaveReport(const FString& FilePath, const FString& MapName, const FExportChaosOptions& Options, const TCHAR* Result) const
+	{
+		FScopeLock ScopeLock(&Lock);
+		FString ReportJson;
+		TSharedRef<TJsonWriter<>> JsonWriter = TJsonWriterFactory<>::Create(&ReportJson);
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("MapName"), MapName);
+		JsonWriter->WriteValue(TEXT("Result"), Result);
+		JsonWriter->WriteValue(TEXT("EngineVersion"), FEngineVersion::Current().ToString());
+		JsonWriter->WriteValue(TEXT("Date"), FDateTime::UtcNow().ToIso8601());
+		JsonWriter->WriteValue(TEXT("WallSeconds"), FPlatformTime::Seconds() - StartTime);
+
+		JsonWriter->WriteObjectStart(TEXT("Options"));
+		JsonWriter->WriteValue(TEXT("BinaryScene"), Options.bBinaryScene);
+		JsonWriter->WriteValue(TEXT("InstanceEncoding"), static_cast<int32>(Options.InstanceEncoding));
+		JsonWriter->WriteValue(TEXT("InstanceQuantizationStep"), Options.InstanceQuantizationStep);
+		JsonWriter->WriteValue(TEXT("InstanceCompression"), Options.bInstanceCompression);
+		JsonWriter->WriteValue(TEXT("Incremental"), Options.bIncremental);
+		JsonWriter->WriteValue(TEXT("CookShards"), Options.CookShards);
+		JsonWriter->WriteValue(TEXT("BatchedPackageSaves"), Options.bBatchedPackageSaves);
+		JsonWriter->WriteValue(TEXT("DirectBodySetups"), Options.bDirectBodySetups);
+		JsonWriter->WriteValue(TEXT("CollisionLOD"), Options.CollisionLOD);
+		JsonWriter->WriteValue(TEXT("LandscapeArchive"), Options.bLandscapeArchive);
+		JsonWriter->WriteValue(TEXT("LandscapeHeights"), Options.bLandscapeHeights);
+		JsonWriter->WriteValue(TEXT("StaticBVH"), Options.bStaticBVH);
+		JsonWriter->WriteValue(TEXT("GridCellSize"), Options.GridCellSize);
+		JsonWriter->WriteValue(TEXT("StaticAggregateCellSize"), Options.StaticAggregateCellSize);
+		JsonWriter->WriteValue(TEXT("DedupBodySetups"), Options.bDedupBodySetups);
+		JsonWriter->WriteValue(TEXT("Delta"), Options.bDelta);
+		JsonWriter->WriteValue(TEXT("ParallelSerialize"), Options.bParallelSerialize);
+		JsonWriter->WriteObjectEnd();
+
+		JsonWriter->WriteObjectStart(TEXT("Counters"));
+		for (const auto& [Name, Value] : Counters)
+		{
+			JsonWriter->WriteValue(Name, Value);
+		}
+		JsonWriter->WriteObjectEnd();
+
+		JsonWriter->WriteArrayStart(TEXT("Phases"));
+		for (const FPhase& Phase : Phases)
+		{
+			JsonWriter->WriteObjectStart();
+			JsonWriter->WriteValue(TEXT("Name"), Phase.Name);
+			JsonWriter->WriteValue(TEXT("Calls"), Phase.Calls);
+			JsonWriter->WriteValue(TEXT("WallSeconds"), Phase.WallSeconds);
+			JsonWriter->WriteValue(TEXT("CPUSeconds"), Phase.CPUSeconds);
+			JsonWriter->WriteValue(TEXT("Items"), Phase.Items);
+			JsonWriter->WriteValue(TEXT("Bytes"), Phase.Bytes);
+			JsonWriter->WriteObjectEnd();
+		}
+		JsonWriter->WriteArrayEnd();
+		JsonWriter->WriteObjectEnd();
+		JsonWriter->Close();
+
+		for (const FPhase& Phase : Phases)
+		{
+			UE_LOG(LogTemp, Log, TEXT("ExportChaos %-28s %8.3fs wall %8.3fs cpu %8lld items %10lld bytes"), *Phase.Name, Phase.WallSeconds, Phase.CPUSeconds, Phase.Items, Phase.Bytes);
+		}
+		return FFileHelper::SaveStringToFile(ReportJson, *FilePath);
+	}
+
+private:
+	FPhase& FindOrAddPhase(const TCHAR* Name)
+	{
+		for (FPhase& Phase : Phases)
+		{
+			if (Phase.Name == Name)
+				return Phase;
+		}
+		FPhase& Phase = Phases.AddDefaulted_GetRef();
+		Phase.Name = Name;
+		return Phase;
+	}
+
+	mutable FCriticalSection Lock;
+	TArray<FPhase> Phases;		// in the order they first ran
+	TMap<FString, int64> Counters;
+	double StartTime = FPlatformTime::Seconds();
+};
+
+class FExportChaosPhaseScope
+{
+public:
+	FExportChaosPhaseScope(FExportChaosStats& InStats, const TCHAR* InName)
+		: Stats(InStats)
+		, Name(InName)
+		, StartWall(FPlatformTime::Seconds())
+		, StartCPU(GetProcessCPUSeconds())
+	{
+	}
+
+	~FExportChaosPhaseScope()
+	{
+		Stats.AddTime(Name, FPlatformTime::Seconds() - StartWall, GetProcessCPUSeconds() - StartCPU);
+	}
+
+private:
+	FExportChaosStats& Stats;
+	const TCHAR* Name;
+	double StartWall;
+	double StartCPU;
+};
+
+// Insights trace scope plus the time of the phase in the export report, Name is a string literal.
+#define EXPORT_CHAOS_PHASE(Stats, Name) \
+	TRACE_CPUPROFILER_EVENT_SCOPE_STR("ExportChaos." Name); \
+	FExportChaosPhaseScope ANONYMOUS_VARIABLE(ExportChaosPhase)(Stats, TEXT(Name))
+
+// Progress, cancellation and phase stats of a running export, shared by the editor notification and the export thread.
+class FExportChaosProgress : public TSharedFromThis<FExportChaosProgress>
+{
+public:
+	FExportChaosProgress()
+		: WakeEvent(FPlatformProcess::GetSynchEventFromPool(true))
+	{
+	}
+
+	~FExportChaosProgress()
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	void ShowNotification(const FText& Status)
+	{
+		check(IsInGameThread());
+		FNotificationInfo Info(Status);
+		Info.bFireAndForget = false;
+		Info.bUseLargeFont = false;
+
+		TWeakPtr<FExportChaosProgress> WeakThis = AsShared();
+		Info.ButtonDetails.Add(FNotificationButtonInfo(
+			LOCTEXT("ExportChaosCancel", "Cancel"),
+			LOCTEXT("ExportChaosCancelTooltip", "Stop the running physics export"),
+			FSimpleDelegate::CreateLambda([WeakThis]()
+			{
+				if (TSharedPtr<FExportChaosProgress> Progress = WeakThis.Pin())
+					Progress->Cancel();
+			}),
+			SNotificationItem::CS_Pending));
+
+		Notification = FSlateNotificationManager::Get().AddNotification(Info);
+		bHasNotification = true;
+		if (Notification.IsValid())
+			Notification->SetCompletionState(SNotificationItem::CS_Pending);
+	}
+
+	// Any thread.
+	void Report(const FText& Status)
+	{
+		UE_LOG(LogTemp, Log, TEXT("ExportChaos: %s"), *Status.ToString());
+		if (!bHasNotification)
+			return;
+		TWeakPtr<FExportChaosProgress> WeakThis = AsShared();
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Status]()
+		{
+			TSharedPtr<FExportChaosProgress> Progress = WeakThis.Pin();
+			if (Progress.IsValid() && Progress->Notification.IsValid())
+				Progress->Notification->SetText(Status);
+		});
+	}
+
+	void Finish(const FText& Status, bool bSuccess)
+	{
+		check(IsInGameThread());
+		UE_LOG(LogTemp, Log, TEXT("ExportChaos: %s"), *Status.ToString());
+		if (Notification.IsValid())
+		{
+			Notification->SetText(Status);
+			Notification->SetCompletionState(bSuccess ? SNotificationItem::CS_Success : SNotificationItem::CS_Fail);
+			Notification->ExpireAndFadeout();
+			Notification.Reset();
+		}
+	}
+
+	void Cancel()
+	{
+		bCancelled = true;
+		WakeEvent->Trigger();
+	}
+
+	bool IsCancelled() const
+	{
+		return bCancelled;
+	}
+
+	// Sleeps without burning a core, wakes up early when the export is cancelled.
+	void Wait(float Seconds)
+	{
+		WakeEvent->Wait(FTimespan::FromSeconds(Seconds));
+	}
+
+	FExportChaosStats& GetStats()
+	{
+		return Stats;
+	}
+
+private:
+	FExportChaosStats Stats;
+	std::atomic<bool> bCancelled{ false };
+	bool bHasNotification = false;	// set before the export thread starts, headless exports only log
+	FEvent* WakeEvent;
+	TSharedPtr<SNotificationItem> Notification;
+};
+
+// the export that is currently running, a second one is refused until it finishes
+static TWeakPtr<FExportChaosProgress> GActiveExport;
+static TFuture<void> GActiveExportTask;
+
+void CancelPhysicExport()
+{
+	if (TSharedPtr<FExportChaosProgress> Progress = GActiveExport.Pin())
+	{
+		Progress->Cancel();
+	}
+	if (GActiveExportTask.IsValid())
+	{
+		GActiveExportTask.Wait();
+		GActiveExportTask.Reset();
+	}
+}
+
+SaveBodyData CaptureBody(UStaticMeshComponent* Component)
+{
+	FBodyInstance* BodyInstance = Component->GetBodyInstance();
+
+	SaveBodyData data;
+	data.ActorID = Component->GetOwner()->GetUniqueID();
+	data.CompID = Component->GetUniqueID();
+	data.Name = Component->GetOwner()->GetActorLabel(false);
+	data.Transform = BodyInstance->GetUnrealWorldTransform_AssumesLocked();
+	data.Transform.SetScale3D(BodyInstance->Scale3D);
+	data.bSimulatePhysics = BodyInstance->bSimulatePhysics;
+	data.bEnableGravity = BodyInstance->bEnableGravity;
+	data.bStartAwake = BodyInstance->bStartAwake;
+	data.bMovable = Component->Mobility == EComponentMobility::Movable;
+	SaveBodyInstanceOverrides(*BodyInstance, data.Overrides);
+	return data;
+}
+
+// Visits the world transform of every instance of an ISM, either from its created physics bodies
+// or from PerInstanceSMData, which also covers instances whose bodies are not created.
+template<typename FuncType>
+void ForEachInstanceTransform(UInstancedStaticMeshComponent* Component, bool bFromPerInstanceSMData, FuncType&& Func)
+{
+	if (bFromPerInstanceSMData)
+	{
+		const int32 InstanceCount = Component->GetInstanceCount();
+		for (int32 i = 0; i < InstanceCount; ++i)
+		{
+			FTransform inst_Transform;
+			if (Component->GetInstanceTransform(i, inst_Transform, true))
+			{
+				Func(inst_Transform);
+			}
+		}
+		return;
+	}
+
+	for (const auto& inst : Component->InstanceBodies)
+	{
+		if (inst == nullptr)
+			continue;
+		auto inst_Transform = inst->GetUnrealWorldTransform_AssumesLocked();
+		inst_Transform.SetScale3D(inst->Scale3D);
+		Func(inst_Transform);
+	}
+}
+
+FString GetLandscapeArchiveName(const FGuid& LandGuid)
+{
+	return LandGuid.ToString() + ".ldata";
+}
+
+FString GetLandscapeHeightsName(const FGuid& LandGuid)
+{
+	return LandGuid.ToString() + ".lheight";
+}
+
+// Editor-only height samples of the collision, the complex ones followed by the simple ones.
+TArray<uint16> ReadCollisionHeights(ULandscapeHeightfieldCollisionComponent* CollisionComponent)
+{
+	TArray<uint16> Heights;
+	FWordBulkData& HeightData = CollisionComponent->CollisionHeightData;
+	const int32 NumSamples = HeightData.GetElementCount();
+	if (NumSamples > 0)
+	{
+		const uint16* Data = static_cast<const uint16*>(HeightData.LockReadOnly());
+		Heights.Append(Data, NumSamples);
+		HeightData.Unlock();
+	}
+	return Heights;
+}
+
+void CaptureLandscape(ALandscape* landscape, const FString& SavePath, bool bArchive, bool bHeights, const FExportManifest& Manifest, std::vector<SaveLandscapeData>& LandscapeDataSet)
+{
+	ULandscapeInfo* Info = landscape->GetLandscapeInfo();
+	if (Info == nullptr)
+		return;
+
+	SaveLandscapeData land_data;
+	land_data.LandID = landscape->GetUniqueID();
+	land_data.LandGuid = landscape->GetLandscapeGuid();
+	land_data.LandscapeSectionOffset = landscape->LandscapeSectionOffset;
+	land_data.ActorToWorld = landscape->ActorToWorld();
+	land_data.LandscapeActorToWorld = landscape->LandscapeActorToWorld();
+	land_data.bArchive = bArchive;
+	land_data.bHeights = bHeights;
+
+	TArray<ULandscapeHeightfieldCollisionComponent*> CollisionComponents;
+	for (const auto& [key, CollisionComponent] : Info->XYtoCollisionComponentMap)
+	{
+		if (CollisionComponent->CookedCollisionData.Num() == 0)
+			continue;
+		CollisionComponents.Add(CollisionComponent);
+	}
+	if (bArchive || bHeights)
+	{
+		// the order ChaosScene::FindLandscapeTile searches the tile table in
+		CollisionComponents.Sort([](const ULandscapeHeightfieldCollisionComponent& A, const ULandscapeHeightfieldCollisionComponent& B)
+		{
+			return ChaosScene::LandscapeTileLess(A, B.SectionBaseX, B.SectionBaseY);
+		});
+	}
+
+	for (ULandscapeHeightfieldCollisionComponent* CollisionComponent : CollisionComponents)
+	{
+		SaveLandscapeCollisionData coll_data;
+		coll_data.OwnerID = landscape->GetUniqueID();
+		coll_data.CompID = CollisionComponent->GetUniqueID();
+		coll_data.Package = CollisionComponent->GetName();
+		coll_data.SectionBaseX = CollisionComponent->SectionBaseX;
+		coll_data.SectionBaseY = CollisionComponent->SectionBaseY;
+		coll_data.SimpleCollisionSizeQuads = CollisionComponent->SimpleCollisionSizeQuads;
+		coll_data.CollisionSizeQuads = CollisionComponent->CollisionSizeQuads;
+		coll_data.CollisionScale = CollisionComponent->CollisionScale;
+		coll_data.HeightfieldGuid = CollisionComponent->HeightfieldGuid;
+		coll_data.Transform = CollisionComponent->GetComponentTransform();
+		coll_data.Hash = HashLandscapeCollision(CollisionComponent);
+		land_data.ArchiveHash = HashCombineBytes(land_data.ArchiveHash, &coll_data.Hash, sizeof(coll_data.Hash));
+		if (bHeights)
+		{
+			coll_data.HeightSamples = ReadCollisionHeights(CollisionComponent);
+			land_data.HeightsHash = HashCombineBytes(land_data.HeightsHash, &coll_data.Hash, sizeof(coll_data.Hash));
+			land_data.HeightsHash = HashCombineBytes(land_data.HeightsHash, coll_data.HeightSamples.GetData(), coll_data.HeightSamples.Num() * sizeof(uint16));
+		}
+
+		if (!bArchive)
+		{
+			FString PackageFileName = SavePath / coll_data.Package + ".data";
+			coll_data.bWriteData = !Manifest.IsUnchanged(TEXT("LandscapeTiles"), coll_data.Package, coll_data.Hash) || !IFileManager::Get().FileExists(*PackageFileName);
+			if (coll_data.bWriteData)
+			{
+				coll_data.CookedCollisionData = CollisionComponent->CookedCollisionData;
+			}
+		}
+		land_data.collisions.emplace_back(std::move(coll_data));
+	}
+
+	if (bArchive)
+	{
+		// a single changed, added or removed tile rewrites the whole archive
+		FString ArchiveFileName = SavePath / GetLandscapeArchiveName(land_data.LandGuid);
+		land_data.bWriteArchive = !Manifest.IsUnchanged(TEXT("LandscapeArchives"), land_data.LandGuid.ToString(), land_data.ArchiveHash) || !IFileManager::Get().FileExists(*ArchiveFileName);
+		if (land_data.bWriteArchive)
+		{
+			for (int32 i = 0; i < CollisionComponents.Num(); ++i)
+			{
+				land_data.collisions[i].bWriteData = true;
+				land_data.collisions[i].CookedCollisionData = CollisionComponents[i]->CookedCollisionData;
+			}
+		}
+	}
+
+	if (bHeights)
+	{
+		FString HeightsFileName = SavePath / GetLandscapeHeightsName(land_data.LandGuid);
+		land_data.bWriteHeights = !Manifest.IsUnchanged(TEXT("LandscapeHeights"), land_data.LandGuid.ToString(), land_data.HeightsHash) || !IFileManager::Get().FileExists(*HeightsFileName);
+		if (!land_data.bWriteHeights)
+		{
+			for (auto& coll_data : land_data.collisions)
+			{
+				coll_data.HeightSamples.Empty();
+			}
+		}
+	}
+
+	LandscapeDataSet.emplace_back(std::move(land_data));
+}
+
+ChaosScene::BodyShapeRecord MakeShapeRecord(ChaosScene::EBodyShapeType Type, int32 Index, const FVector& Center, const FQuat& Rotation, const FVector& Size)
+{
+	ChaosScene::BodyShapeRecord Shape;
+	FMemory::Memzero(Shape);
+	Shape.Type = static_cast<uint8>(Type);
+	Shape.Index = Index;
+	const ChaosScene::PackedTransform Packed = ToPackedTransform(FTransform(Rotation, Center, Size));
+	FMemory::Memcpy(Shape.Center, Packed.Translation, sizeof(Shape.Center));
+	FMemory::Memcpy(Shape.Rotation, Packed.Rotation, sizeof(Shape.Rotation));
+	FMemory::Memcpy(Shape.Size, Packed.Scale3D, sizeof(Shape.Size));
+	return Shape;
+}
+
+// Everything of BodySetup the server needs, for a .pbody instead of a duplicated and cooked package.
+// The cooked data is the one IsCachedCookedPlatformDataLoaded was checked for, of the physics format of the editor.
+TSharedPtr<SaveCookedGeometryData> CaptureCookedGeometry(UBodySetup* BodySetup)
+{
+	using namespace ChaosScene;
+
+	TSharedPtr<SaveCookedGeometryData> Geometry = MakeShared<SaveCookedGeometryData>();
+	const FKAggregateGeom& AggGeom = BodySetup->AggGeom;
+	for (int32 i = 0; i < AggGeom.SphereElems.Num(); ++i)
+	{
+		const FKSphereElem& Elem = AggGeom.SphereElems[i];
+		Geometry->Shapes.Add(MakeShapeRecord(EBodyShapeType::Sphere, i, Elem.Center, FQuat::Identity, FVector(Elem.Radius, 0.0, 0.0)));
+	}
+	for (int32 i = 0; i < AggGeom.BoxElems.Num(); ++i)
+	{
+		const FKBoxElem& Elem = AggGeom.BoxElems[i];
+		Geometry->Shapes.Add(MakeShapeRecord(EBodyShapeType::Box, i, Elem.Center, Elem.Rotation.Quaternion(), FVector(Elem.X, Elem.Y, Elem.Z)));
+	}
+	for (int32 i = 0; i < AggGeom.SphylElems.Num(); ++i)
+	{
+		const FKSphylElem& Elem = AggGeom.SphylElems[i];
+		Geometry->Shapes.Add(MakeShapeRecord(EBodyShapeType::Sphyl, i, Elem.Center, Elem.Rotation.Quaternion(), FVector(Elem.Radius, Elem.Length, 0.0)));
+	}
+	for (int32 i = 0; i < AggGeom.TaperedCapsuleElems.Num(); ++i)
+	{
+		const FKTaperedCapsuleElem& Elem = AggGeom.TaperedCapsuleElems[i];
+		Geometry->Shapes.Add(MakeShapeRecord(EBodyShapeType::TaperedCapsule, i, Elem.Center, Elem.Rotation.Quaternion(), FVector(Elem.Radius0, Elem.Radius1, Elem.Length)));
+	}
+	for (int32 i = 0; i < AggGeom.ConvexElems.Num(); ++i)
+	{
+		const FTransform ElemTransform = AggGeom.ConvexElems[i].GetTransform();
+		Geometry->Shapes.Add(MakeShapeRecord(EBodyShapeType::Convex, i, ElemTransform.GetTranslation(), ElemTransform.GetRotation(), ElemTransform.GetScale3D()));
+	}
+
+	const FName Format(FPlatformProperties::GetPhysicsFormat());
+	Geometry->CookedFormat = Format.ToString();
+	if (BodySetup->CookedFormatData.Contains(Format))
+	{
+		FByteBulkData& BulkData = BodySetup->CookedFormatData.GetFormat(Format);
+		const int64 Size = BulkData.GetBulkDataSize();
+		if (Size > 0)
+		{
+			Geometry->CookedData.Append(static_cast<const uint8*>(BulkData.LockReadOnly()), Size);
+			BulkData.Unlock();
+		}
+	}
+	else if (AggGeom.ConvexElems.Num() > 0 || BodySetup->CollisionTraceFlag != CTF_UseSimpleAsComplex)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("BodySetup %s has no %s cooked data, its .pbody only holds the simple shapes"), *BodySetup->GetPathName(), *Geometry->CookedFormat);
+	}
+
+	FJsonObjectConverter::UStructToJsonObjectString(BodySetup->DefaultInstance, Geometry->DefaultInstance, 0, 0, 0, nullptr, false);
+	Geometry->PhysMaterial = BodySetup->PhysMaterial ? BodySetup->PhysMaterial->GetPathName() : FString();
+	Geometry->CollisionTraceFlag = static_cast<uint8>(BodySetup->CollisionTraceFlag.GetValue());
+	Geometry->PhysicsType = static_cast<uint8>(BodySetup->PhysicsType.GetValue());
+	Geometry->bDoubleSidedGeometry = BodySetup->bDoubleSidedGeometry;
+	return Geometry;
+}
+
+// One <match>=<proxy> entry of ExportChaos.CollisionLOD.
+struct FCollisionLODRule
+{
+	FString Match;		// wildcard on the BodySetup package, or the tag name
+	bool bTag = false;
+	bool bNone = false;	// no proxy for the BodySetups it matches
+	ChaosScene::ECollisionLOD Type = ChaosScene::ECollisionLOD::Box;
+	int32 MaxHullVertices = 16;
+};
+
+TArray<FCollisionLODRule> ParseCollisionLODRules(const FString& Rules)
+{
+	TArray<FCollisionLODRule> Result;
+	TArray<FString> Entries;
+	Rules.ParseIntoArray(Entries, TEXT(";"));
+	for (const FString& Entry : Entries)
+	{
+		FString Match, Proxy;
+		if (!Entry.Split(TEXT("="), &Match, &Proxy))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("ExportChaos.CollisionLOD: ignored '%s', expected <match>=<proxy>"), *Entry);
+			continue;
+		}
+
+		FCollisionLODRule Rule;
+		Rule.Match = Match.TrimStartAndEnd();
+		Rule.bTag = Rule.Match.RemoveFromStart(TEXT("tag:"));
+		FString ProxyType, ProxyParam;
+		if (!Proxy.TrimStartAndEnd().Split(TEXT(":"), &ProxyType, &ProxyParam))
+		{
+			ProxyType = Proxy.TrimStartAndEnd();
+		}
+		if (ProxyType == TEXT("none"))
+		{
+			Rule.bNone = true;
+		}
+		else if (ProxyType == TEXT("box"))
+		{
+			Rule.Type = ChaosScene::ECollisionLOD::Box;
+		}
+		else if (ProxyType == TEXT("sphere"))
+		{
+			Rule.Type = ChaosScene::ECollisionLOD::Sphere;
+		}
+		else if (ProxyType == TEXT("hull"))
+		{
+			Rule.Type = ChaosScene::ECollisionLOD::Hull;
+			if (!ProxyParam.IsEmpty())
+			{
+				Rule.MaxHullVertices = FMath::Clamp(FCString::Atoi(*ProxyParam), 4, 256);
+			}
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("ExportChaos.CollisionLOD: ignored '%s', unknown proxy %s"), *Entry, *ProxyType);
+			continue;
+		}
+		Result.Add(MoveTemp(Rule));
+	}
+	return Result;
+}
+
+// First rule matching the package or one of the tags, nullptr when none does.
+const FCollisionLODRule* FindCollisionLODRule(const TArray<FCollisionLODRule>& Rules, const FString& Package, const TSet<FName>& Tags)
+{
+	for (const FCollisionLODRule& Rule : Rules)
+	{
+		if (Rule.bTag ? Tags.Contains(FName(*Rule.Match)) : Package.MatchesWildcard(Rule.Match))
+			return &Rule;
+	}
+	return nullptr;
+}
+
+// Farthest point of AggGeom along Direction, in BodySetup space. Tapered capsules use the larger of their radii.
+FVector GetAggGeomSupport(const FKAggregateGeom& AggGeom, const FVector& Direction)
+{
+	FVector Best = FVector::ZeroVector;
+	double BestDot = -UE_BIG_NUMBER;
+	auto Consider = [&Best, &BestDot, &Direction](const FVector& Point)
+	{
+		const double Dot = Point | Direction;
+		if (Dot > BestDot)
+		{
+			BestDot = Dot;
+			Best = Point;
+		}
+	};
+
+	for (const FKSphereElem& Elem : AggGeom.SphereElems)
+	{
+		Consider(Elem.Center + Direction * Elem.Radius);
+	}
+	for (const FKBoxElem& Elem : AggGeom.BoxElems)
+	{
+		const FQuat Rotation = Elem.Rotation.Quaternion();
+		const FVector Local = Rotation.UnrotateVector(Direction);
+		const FVector Corner(FMath::Sign(Local.X) * Elem.X, FMath::Sign(Local.Y) * Elem.Y, FMath::Sign(Local.Z) * Elem.Z);
+		Consider(Elem.Center + Rotation.RotateVector(Corner * 0.5));
+	}
+	for (const FKSphylElem& Elem : AggGeom.SphylElems)
+	{
+		const FVector Axis = Elem.Rotation.Quaternion().GetAxisZ() * (Elem.Length * 0.5);
+		Consider(Elem.Center + Axis + Direction * Elem.Radius);
+		Consider(Elem.Center - Axis + Direction * Elem.Radius);
+	}
+	for (const FKTaperedCapsuleElem& Elem : AggGeom.TaperedCapsuleElems)
+	{
+		const FVector Axis = Elem.Rotation.Quaternion().GetAxisZ() * (Elem.Length * 0.5);
+		const double Radius = FMath::Max(Elem.Radius0, Elem.Radius1);
+		Consider(Elem.Center + Axis + Direction * Radius);
+		Consider(Elem.Center - Axis + Direction * Radius);
+	}
+	for (const FKConvexElem& Elem : AggGeom.ConvexElems)
+	{
+		const FTransform ElemTransform = Elem.GetTransform();
+		for (const FVector& Vertex : Elem.VertexData)
+		{
+			Consider(ElemTransform.TransformPosition(Vertex));
+		}
+	}
+	return Best;
+}
+
+// Box and sphere from the AggGeom bounds. The hull is made of the support points of AggGeom along MaxHullVertices
+// directions spread evenly over the sphere (Fibonacci lattice), so it touches the full shape in every sampled
+// direction; points closer than 0.1 cm are merged, boxes end up with their 8 corners.
+TSharedPtr<const SaveCollisionLODData> MakeCollisionLOD(const FKAggregateGeom& AggGeom, const FCollisionLODRule& Rule)
+{
+	TSharedPtr<SaveCollisionLODData> LOD = MakeShared<SaveCollisionLODData>();
+	LOD->Type = Rule.Type;
+	const FBox Bounds = AggGeom.CalcAABB(FTransform::Identity);
+	LOD->Center = Bounds.GetCenter();
+	LOD->Extent = Bounds.GetExtent();
+	if (Rule.Type == ChaosScene::ECollisionLOD::Sphere)
+	{
+		LOD->Extent = FVector(Bounds.GetExtent().Size(), 0.0, 0.0);
+	}
+	else if (Rule.Type == ChaosScene::ECollisionLOD::Hull)
+	{
+		const int32 NumDirections = Rule.MaxHullVertices;
+		const double GoldenAngle = UE_DOUBLE_PI * (3.0 - FMath::Sqrt(5.0));
+		FBox HullBounds(ForceInit);
+		for (int32 i = 0; i < NumDirections; ++i)
+		{
+			const double Z = 1.0 - (2.0 * i + 1.0) / NumDirections;
+			const double R = FMath::Sqrt(FMath::Max(1.0 - Z * Z, 0.0));
+			const FVector Direction(R * FMath::Cos(GoldenAngle * (i + 0.5)), R * FMath::Sin(GoldenAngle * (i + 0.5)), Z);
+			const FVector3f Point(GetAggGeomSupport(AggGeom, Direction));
+			if (!LOD->Vertices.ContainsByPredicate([&Point](const FVector3f& Vertex) { return FVector3f::DistSquared(Vertex, Point) < 0.01f; }))
+			{
+				LOD->Vertices.Add(Point);
+				HullBounds += FVector(Point);
+			}
+		}
+		LOD->Center = HullBounds.GetCenter();
+		LOD->Extent = HullBounds.GetExtent();
+	}
+	return LOD;
+}
+
+// Duplicates BodySetup into /Game/Physic/<MeshName> and removes the .uasset of the previous export.
+UPackage* PrepareBodySetupPackage(UBodySetup* BodySetup, const FString& MeshName)
+{
+	FString PackageName = TEXT("/Game/Physic/") + MeshName;
+	UPackage* SavePkg = CreatePackage(*PackageName);
+	SavePkg->ClearFlags(RF_Transient);
+	//SavePkg->SetFlags(RF_Standalone);
+	//SavePkg->SetPackageFlags(PKG_FilterEditorOnly);
+	auto NewBodySetup = FindObject<UBodySetup>(SavePkg, *BodySetup->GetName());
+	if (NewBodySetup == nullptr)
+	{
+		NewBodySetup = DuplicateObject(BodySetup, SavePkg);
+	}
+	else
+	{
+		NewBodySetup->CopyBodyPropertiesFrom(BodySetup);
+	}
+
+	NewBodySetup->SetFlags(EObjectFlags::RF_Public);
+	NewBodySetup->ClearFlags(EObjectFlags::RF_Transient);
+	NewBodySetup->bSharedCookedData = true;
+	NewBodySetup->CookedFormatData = BodySetup->CookedFormatData;
+	NewBodySetup->bUseSavedCookData = true;
+	NewBodySetup->AddToRoot();
+
+	FAssetRegistryModule::AssetCreated(NewBodySetup);
+	SavePkg->SetDirtyFlag(true);
+
+	/*UPackage::Save(SavePkg, NewBodySetup, *NewBodySetup->GetName(), SaveArgs); */
+
+
+
+	FString PackageFileName = FPaths::ProjectContentDir() / "Physic" / MeshName + ".uasset";
+	if (IFileManager::Get().FileExists(*PackageFileName))
+	{
+		IFileManager::Get().Delete(*PackageFileName);
+	}
+	return SavePkg;
+}
+
+// Saves a package made by PrepareBodySetupPackage as a .uasset for the cook commandlet.
+// With SAVE_Async in SaveArgs the file write is left in flight, the caller waits for all of them at once.
+bool SaveBodySetupPackage(UPackage* SavePkg, const FString& MeshName, FSavePackageArgs& SaveArgs)
+{
+	FString PackageFileName = FPaths::ProjectContentDir() / "Physic" / MeshName + ".uasset";
+	//FArchiveCookContext CookContext(SavePkg, FArchiveCookContext::ECookTypeUnknown);
+	//if (TargetPlatform != nullptr)
+	//{
+	//	CookData.Emplace(*TargetPlatform, CookContext);
+	//}
+
+	//SaveArgs.ArchiveCookData = CookData.GetPtrOrNull();
+
+	//ICookedPackageWriter::FBeginPackageInfo Info;
+	//Info.PackageName = SavePkg->GetFName();
+	//Info.LooseFilePath = PackageFileName;
+	//ZenStoreWriter->BeginPackage(Info);
+
+	const FSavePackageResultStruct Result = UPackage::SavePackage(SavePkg, nullptr, *PackageFileName, SaveArgs);
+	/*GIsCookerLoadingPackage = true;
+	uint32 SaveFlags = SAVE_KeepGUID | SAVE_Async | SAVE_ComputeHash | SAVE_Unversioned;
+	EObjectFlags CookedFlags = RF_Public;
+
+	FSavePackageResultStruct Result = GEditor->Save(SavePkg, nullptr, *PackageFileName, SaveArgs);
+	GIsCookerLoadingPackage = false;*/
+
+	if ((SaveArgs.SaveFlags & SAVE_Async) == 0)
+	{
+		UPackage::WaitForAsyncFileWrites();
+	}
+	/*ICookedPackageWriter::FCommitPackageInfo CommitInfo;
+	CommitInfo.Status = IPackageWriter::ECommitStatus::Success;
+	CommitInfo.PackageName = SavePkg->GetFName();
+	CommitInfo.PackageGuid = FGuid();
+	CommitInfo.WriteOptions = IPackageWriter::EWriteOptions::Write | IPackageWriter::EWriteOptions::ComputeHash;
+
+	ZenStoreWriter->CommitPackage(MoveTemp(CommitInfo));
+
+	check(IFileManager::Get().FileExists(*PackageFileName));*/
+	if (!Result.IsSuccessful())
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to save %s"), *PackageFileName);
+		return false;
+	}
+	return true;
+}
+
+// Game thread part of the export: copies everything the scene needs out of the world
+// and saves the /Game/Physic packages whose BodySetup changed since the previous export.
+bool CapturePhysicScene(UWorld* World, ITargetPlatform* TargetPlatform, const FExportChaosOptions& Options, const FExportManifest& Manifest, FPhysicSceneSnapshot& Snapshot, FExportChaosStats& Stats)
+{
+	check(IsInGameThread());
+	Snapshot.MapName = World->GetMapName();
+
+	struct BodySetupData
+	{
+		std::vector<UStaticMeshComponent*> static_mesh;
+		std::vector<UInstancedStaticMeshComponent*> instanced_static_mesh;
+		TSet<FName> Tags;	// of the components and their actors, for the collision LOD rules
+	};
+	std::unordered_map<UBodySetup*, BodySetupData> BodySetupMap;
+	const TArray<FCollisionLODRule> CollisionLODRules = ParseCollisionLODRules(Options.CollisionLOD);
+	auto AddTags = [&CollisionLODRules](BodySetupData& data, AActor* actor, UActorComponent* Component)
+	{
+		if (CollisionLODRules.Num() > 0)
+		{
+			data.Tags.Append(actor->Tags);
+			data.Tags.Append(Component->ComponentTags);
+		}
+	};
+
+	{
+		EXPORT_CHAOS_PHASE(Stats, "Capture.Actors");
+		int32 NumActors = 0;
+		for (TActorIterator<AActor> It(World); It; ++It)
+		{
+			AActor* actor = *It;
+			if (actor == nullptr)
+				continue;
+			NumActors++;
+			if (actor->GetClass()->GetName() == "DirectionalForce_C")
+			{
+				auto pComponent = actor->FindComponentByClass(UFieldSystemComponent::StaticClass());
+				SavePhysicFieldData data;
+				data.OwnerID = actor->GetUniqueID();
+				data.CompID = (pComponent) ? pComponent->GetUniqueID() : actor->GetUniqueID();
+				data.Transform = actor->GetTransform();
+				data.bEnable = true;
+				data.FieldType = static_cast<uint8_t>(EPhysicFieldType::DirectionalForce);
+				//auto FieldSysComp = actor->FindComponentByClass(UFieldSystemComponent::StaticClass());
+				Snapshot.PhysicFieldDataSet.emplace_back(std::move(data));
+
+
+				continue;
+			}
+
+			if (actor->GetClass() == ALandscape::StaticClass())
+			{
+				FString SavePath = GetCookedContentDir() / "Landscape" / Snapshot.MapName;
+				ALandscape* landscape = Cast<ALandscape>(actor);
+				EXPORT_CHAOS_PHASE(Stats, "Capture.Landscape");
+				const size_t NumLandscapes = Snapshot.LandscapeDataSet.size();
+				CaptureLandscape(landscape, SavePath, Options.bLandscapeArchive, Options.bLandscapeHeights, Manifest, Snapshot.LandscapeDataSet);
+				if (Snapshot.LandscapeDataSet.size() > NumLandscapes)
+					Stats.Add(TEXT("Capture.Landscape"), (int64)Snapshot.LandscapeDataSet.back().collisions.size());
+
+
+				continue;
+			}
+
+
+			for (UActorComponent* ActorComponent : actor->GetComponents())
+			{
+				if (ActorComponent->IsEditorOnly())
+					continue;
+
+				if (UPrimitiveComponent* PriComponent = Cast<UPrimitiveComponent>(ActorComponent))
+				{
+					if (PriComponent->IsCollisionEnabled() == false)
+						continue;
+				}
+
+				if (UInstancedStaticMeshComponent* InstancedStaticMeshComponent = Cast<UInstancedStaticMeshComponent>(ActorComponent))
+				{
+					auto BodySetup = InstancedStaticMeshComponent->GetBodySetup();
+					if (BodySetup->AggGeom.GetElementCount() <= 0)
+						continue;
+
+					auto& data = BodySetupMap[BodySetup];
+					data.instanced_static_mesh.push_back(InstancedStaticMeshComponent);
+					AddTags(data, actor, InstancedStaticMeshComponent);
+				}
+				else if (UStaticMeshComponent* StaticMeshComponent = Cast<UStaticMeshComponent>(ActorComponent))
+				{
+					auto BodySetup = StaticMeshComponent->GetBodySetup();
+					if (BodySetup->AggGeom.GetElementCount() <= 0)
+						continue;
+
+					auto& data = BodySetupMap[BodySetup];
+					data.static_mesh.push_back(StaticMeshComponent);
+					AddTags(data, actor, StaticMeshComponent);
+				}
+				else if (UPhysicsConstraintComponent* ConstraintComponent = Cast<UPhysicsConstraintComponent>(ActorComponent))
+				{
+					SaveConstraintData cs_data;
+					if (ConstraintComponent->ConstraintActor1)
+						cs_data.ActorID1 = ConstraintComponent->ConstraintActor1->GetUniqueID();
+					else
+						cs_data.ActorID1 = actor->GetUniqueID();
+					if (ConstraintComponent->ConstraintActor2)
+						cs_data.ActorID2 = ConstraintComponent->ConstraintActor2->GetUniqueID();
+					else
+						cs_data.ActorID2 = actor->GetUniqueID();
+					cs_data.OwnerID = actor->GetUniqueID();
+					cs_data.CompID = ConstraintComponent->GetUniqueID();
+					cs_data.Transform = ConstraintComponent->GetRelativeTransform();
+					cs_data.Location = ConstraintComponent->GetComponentLocation();
+					cs_data.profile = ConstraintComponent->ConstraintInstance.ProfileInstance;
+					cs_data.ProfileHash = HashConstraintProfile(cs_data.profile);
+					Snapshot.ConstraintDataSet.emplace_back(std::move(cs_data));
+				}
+
+
+			}
+
+		}
+		Stats.Add(TEXT("Capture.Actors"), NumActors);
+	}
+
+	if (Options.bDedupBodySetups)
+	{
+		EXPORT_CHAOS_PHASE(Stats, "Capture.DedupBodySetups");
+		// every group of identical BodySetups is exported as the one with the smallest path,
+		// so the package picked for a group stays the same from one export to the next
+		std::vector<std::pair<UBodySetup*, uint64>> ContentHashes;
+		ContentHashes.reserve(BodySetupMap.size());
+		TMap<uint64, UBodySetup*> Canonical;
+		for (const auto& [BodySetup, Data] : BodySetupMap)
+		{
+			if (BodySetup == nullptr)
+				continue;
+			const uint64 Hash = HashBodySetupContent(BodySetup);
+			ContentHashes.emplace_back(BodySetup, Hash);
+			UBodySetup*& Target = Canonical.FindOrAdd(Hash, BodySetup);
+			if (BodySetup->GetPathName() < Target->GetPathName())
+				Target = BodySetup;
+		}
+
+		int32 NumMerged = 0;
+		for (const auto& [BodySetup, Hash] : ContentHashes)
+		{
+			UBodySetup* Target = Canonical[Hash];
+			if (Target == BodySetup)
+				continue;
+			auto& From = BodySetupMap[BodySetup];
+			auto& To = BodySetupMap[Target];
+			To.static_mesh.insert(To.static_mesh.end(), From.static_mesh.begin(), From.static_mesh.end());
+			To.instanced_static_mesh.insert(To.instanced_static_mesh.end(), From.instanced_static_mesh.begin(), From.instanced_static_mesh.end());
+			To.Tags.Append(From.Tags);
+			BodySetupMap.erase(BodySetup);
+			++NumMerged;
+		}
+		UE_LOG(LogTemp, Log, TEXT("BodySetups: %d merged into identical ones, %d exported"), NumMerged, (int32)BodySetupMap.size());
+		Stats.Add(TEXT("Capture.DedupBodySetups"), NumMerged);
+	}
+
+	//save
+	{
+
+		//TOptional<FArchiveCookData> CookData;
+		//
+		//FString ResolvedRootPath = FPaths::ProjectContentDir() / "Physic";
+		//FString ResolvedMetadataPath = FPaths::ProjectContentDir() / "Physic"/ "Metadata";
+		//
+		//auto ZenStoreWriter = new FZenStoreWriter(ResolvedRootPath, ResolvedMetadataPath, TargetPlatform);
+
+		//ICookedPackageWriter::FCookInfo CookInfo;
+		//CookInfo.bFullBuild = true;
+		//ZenStoreWriter->Initialize(CookInfo);
+		//ZenStoreWriter->BeginCook();
+		//
+		//FSavePackageContext SaveContext(TargetPlatform, ZenStoreWriter);
+
+
+		FSavePackageArgs SaveArgs;
+		//SaveArgs.SavePackageContext = &SaveContext;
+
+		SaveArgs.TopLevelFlags = EObjectFlags::RF_Public;
+		//SaveArgs.SaveFlags = ESaveFlags::SAVE_NoError | ESaveFlags::SAVE_FromAutosave;
+		SaveArgs.Error = GWarn;
+		if (Options.bBatchedPackageSaves)
+		{
+			SaveArgs.SaveFlags |= SAVE_Async;
+		}
+
+		// index into BodySetupDataSet of every package waiting for its batched save
+		TArray<TPair<UPackage*, int32>> PendingSaves;
+
+		Snapshot.BodySetupDataSet.reserve(BodySetupMap.size());
+		for (const auto& [BodySetup, Data] : BodySetupMap)
+		{
+			if (BodySetup == nullptr)
+				continue;
+			SaveBodySetupData bs_data;
+			bs_data.Package = BodySetup->GetOuter()->GetName();
+			bs_data.Name = BodySetup->GetName();
+			bs_data.Path = BodySetup->GetPathName();
+			bs_data.Guid = BodySetup->BodySetupGuid;
+			bs_data.LocalBounds = BodySetup->AggGeom.CalcAABB(FTransform::Identity);
+			UE_LOG(LogTemp, Warning, TEXT("BodySetup:%s Guid:%u"), *bs_data.Package, *BodySetup->BodySetupGuid.ToString());
+
+			BodySetup->CookedFormatDataOverride = &BodySetup->CookedFormatData;
+			check(BodySetup->IsCachedCookedPlatformDataLoaded(TargetPlatform));
+
+			bs_data.Hash = HashBodySetup(BodySetup);
+			const FString CookedFileName = Options.bDirectBodySetups ? GetBodySetupFilePath(bs_data.Package) : GetCookedContentDir() / "Physic" / bs_data.Package + ".uasset";
+			// unchanged BodySetups keep the package cooked by the previous export
+			bs_data.bCook = !Manifest.IsUnchanged(TEXT("BodySetups"), bs_data.Package, bs_data.Hash) || !IFileManager::Get().FileExists(*CookedFileName);
+			if (bs_data.bCook && Options.bDirectBodySetups)
+			{
+				// written on the export thread, no package and no cook
+				EXPORT_CHAOS_PHASE(Stats, "Capture.CookedGeometry");
+				bs_data.CookedGeometry = CaptureCookedGeometry(BodySetup);
+				Stats.Add(TEXT("Capture.CookedGeometry"), 1, bs_data.CookedGeometry->CookedData.Num());
+			}
+			else if (bs_data.bCook)
+			{
+				UPackage* SavePkg = nullptr;
+				{
+					EXPORT_CHAOS_PHASE(Stats, "Capture.DuplicateBodySetup");
+					SavePkg = PrepareBodySetupPackage(BodySetup, bs_data.Package);
+					Stats.Add(TEXT("Capture.DuplicateBodySetup"), 1);
+				}
+				if (Options.bBatchedPackageSaves)
+				{
+					PendingSaves.Emplace(SavePkg, static_cast<int32>(Snapshot.BodySetupDataSet.size()));
+				}
+				else
+				{
+					EXPORT_CHAOS_PHASE(Stats, "Capture.SavePackage");
+					if (!SaveBodySetupPackage(SavePkg, bs_data.Package, SaveArgs))
+					{
+						bs_data.bCook = false;
+						bs_data.bSaveFailed = true;
+					}
+				}
+			}
+
+			if (const FCollisionLODRule* Rule = FindCollisionLODRule(CollisionLODRules, bs_data.Package, Data.Tags))
+			{
+				if (!Rule->bNone)
+				{
+					EXPORT_CHAOS_PHASE(Stats, "Capture.CollisionLOD");
+					bs_data.CollisionLOD = MakeCollisionLOD(BodySetup->AggGeom, *Rule);
+					Stats.Add(TEXT("Capture.CollisionLOD"), 1);
+				}
+			}
+
+			EXPORT_CHAOS_PHASE(Stats, "Capture.Bodies");
+			bs_data.static_mesh.reserve(Data.static_mesh.size());
+			for (const auto& StaticMeshComponent : Data.static_mesh)
+			{
+				bs_data.static_mesh.emplace_back(CaptureBody(StaticMeshComponent));
+			}
+
+			bs_data.instanced_static_mesh.reserve(Data.instanced_static_mesh.size());
+			for (const auto& InstancedStaticMeshComponent : Data.instanced_static_mesh)
+			{
+				SaveBodyData data = CaptureBody(InstancedStaticMeshComponent);
+				data.Instances.Reserve(InstancedStaticMeshComponent->GetInstanceCount());
+				ForEachInstanceTransform(InstancedStaticMeshComponent, Options.bInstancesFromSMData, [&](const FTransform& inst_Transform)
+				{
+					data.Instances.Add(inst_Transform);
+				});
+				bs_data.instanced_static_mesh.emplace_back(std::move(data));
+			}
+
+			Snapshot.BodySetupDataSet.emplace_back(std::move(bs_data));
+		}
+
+		// every package is duplicated first, then all saves are issued with their writes in flight together
+		{
+			EXPORT_CHAOS_PHASE(Stats, "Capture.SavePackage");
+			for (const auto& [SavePkg, Index] : PendingSaves)
+			{
+				auto& bs_data = Snapshot.BodySetupDataSet[Index];
+				if (!SaveBodySetupPackage(SavePkg, bs_data.Package, SaveArgs))
+				{
+					bs_data.bCook = false;
+					bs_data.bSaveFailed = true;
+				}
+			}
+			if (PendingSaves.Num() > 0)
+			{
+				UPackage::WaitForAsyncFileWrites();
+			}
+		}
+
+		int64 NumBodies = 0;
+		int64 NumInstances = 0;
+		int32 NumSaved = 0;
+		int64 SavedBytes = 0;
+		for (const auto& bs_data : Snapshot.BodySetupDataSet)
+		{
+			NumBodies += bs_data.static_mesh.size() + bs_data.instanced_static_mesh.size();
+			for (const auto& data : bs_data.instanced_static_mesh)
+			{
+				NumInstances += data.Instances.Num();
+			}
+			if (bs_data.bCook && !bs_data.CookedGeometry)
+			{
+				NumSaved++;
+				SavedBytes += FMath::Max<int64>(IFileManager::Get().FileSize(*(FPaths::ProjectContentDir() / "Physic" / bs_data.Package + ".uasset")), 0);
+			}
+		}
+		Stats.Add(TEXT("Capture.SavePackage"), NumSaved, SavedBytes);
+		Stats.Add(TEXT("Capture.Bodies"), NumBodies);
+		Stats.SetCounter(TEXT("BodySetups"), (int64)Snapshot.BodySetupDataSet.size());
+		Stats.SetCounter(TEXT("Bodies"), NumBodies);
+		Stats.SetCounter(TEXT("Instances"), NumInstances);
+		Stats.SetCounter(TEXT("Constraints"), (int64)Snapshot.ConstraintDataSet.size());
+		Stats.SetCounter(TEXT("PhysicFields"), (int64)Snapshot.PhysicFieldDataSet.size());
+		Stats.SetCounter(TEXT("Landscapes"), (int64)Snapshot.LandscapeDataSet.size());
+		TRACE_COUNTER_SET(ExportChaosBodies, NumBodies);
+		TRACE_COUNTER_SET(ExportChaosInstances, NumInstances);
+		TRACE_COUNTER_SET(ExportChaosPackagesSaved, NumSaved);
+		//ZenStoreWriter->EndCook();
+	}
+
+	return true;
+}
+
+ChaosScene::BodyRecord MakeBodyRecord(FChaosSceneBinaryWriter& BinaryWriter, uint32 BodySetupIndex, const SaveBodyData& data)
+{
+	ChaosScene::BodyRecord Record;
+	Record.ActorID = data.ActorID;
+	Record.CompID = data.CompID;
+	Record.Name = BinaryWriter.AddString(data.Name);
+	Record.BodySetup = BodySetupIndex;
+	Record.Transform = ToPackedTransform(data.Transform);
+	Record.Flags = 0;
+	if (data.bSimulatePhysics)
+		Record.Flags |= ChaosScene::BodyFlag_SimulatePhysics;
+	if (data.bEnableGravity)
+		Record.Flags |= ChaosScene::BodyFlag_EnableGravity;
+	if (data.bStartAwake)
+		Record.Flags |= ChaosScene::BodyFlag_StartAwake;
+	if (data.bMovable)
+		Record.Flags |= ChaosScene::BodyFlag_Movable;
+	Record.Overrides = BinaryWriter.AddBodyOverrides(data.Overrides);
+	return Record;
+}
+
+// Floats as raw json array values, "x, y, ..." without the brackets.
+FString FormatFloats(const float* Floats, int32 Count)
+{
+	FString Formatted;
+	for (int32 i = 0; i < Count; ++i)
+	{
+		// %.9g round-trips a float, the default float formatting of TJsonWriter only keeps 6 digits
+		Formatted += FString::Printf(i == 0 ? TEXT("%.9g") : TEXT(", %.9g"), Floats[i]);
+	}
+	return Formatted;
+}
+
+// Override set as raw json array values: Mask, BoolBits, then the values like the binary words, numbers instead of bits.
+FString FormatBodyOverrides(const FBodyOverrides& Overrides)
+{
+	FString Formatted = FString::Printf(TEXT("%u, %u"), Overrides[0], Overrides[1]);
+	ChaosScene::ForEachBodyOverride(Overrides.GetData(), [&Formatted](uint32 Field, const uint32* Words)
+	{
+		switch (ChaosScene::BodyOverrideFields[Field].Type)
+		{
+		case ChaosScene::EBodyOverrideType::Bool:
+			break;
+		case ChaosScene::EBodyOverrideType::Enum:
+			Formatted += FString::Printf(TEXT(", %u"), Words[0]);
+			break;
+		default:
+			Formatted += TEXT(", ") + FormatFloats(reinterpret_cast<const float*>(Words), ChaosScene::BodyOverrideValueWords(ChaosScene::BodyOverrideFields[Field].Type));
+			break;
+		}
+	});
+	return Formatted;
+}
+
+// Fields shared by the "StaticMesh", "StaticMeshInstance" and aggregate shape entries, the caller opens and closes the object.
+void WriteBodyInstanceJson(const TSharedRef<FSceneJsonWriter>& JsonWriter, const SaveBodyData& data, const FString& Transform)
+{
+	JsonWriter->WriteValue(TEXT("ActorID"), static_cast<int64>(data.ActorID));
+	JsonWriter->WriteValue(TEXT("CompID"), static_cast<int64>(data.CompID));
+	JsonWriter->WriteValue(TEXT("Name"), data.Name);
+	JsonWriter->WriteValue(TEXT("Transform"), Transform);
+	JsonWriter->WriteValue(TEXT("SimulatePhysics"), data.bSimulatePhysics);
+	if (data.Overrides[0] != 0)
+	{
+		JsonWriter->WriteRawJSONValue(TEXT("Overrides"), TEXT("[") + FormatBodyOverrides(data.Overrides) + TEXT("]"));
+	}
+
+	JsonWriter->WriteValue(TEXT("EnableGravity"), data.bEnableGravity);
+	JsonWriter->WriteValue(TEXT("StartAwake"), data.bStartAwake);
+
+	JsonWriter->WriteValue(TEXT("Movable"), data.bMovable);
+}
+
+// The floats of one instance as raw json array values.
+FString FormatPackedInstance(const ChaosScene::PackedTransform& Packed)
+{
+	return FormatFloats(reinterpret_cast<const float*>(&Packed), sizeof(ChaosScene::PackedTransform) / sizeof(float));
+}
+
+// Strings of one "StaticMesh" / "StaticMeshInstance" entry that are costly to make, formatted ahead of the writer.
+struct FFormattedBody
+{
+	FString Transform;
+	TArray<FString> Instances;	// Transform strings, or packed floats, one per instance
+	TArray<ChaosScene::PackedTransform> PackedInstances;
+	FString InstancesBase64;
+	TArray<ChaosScene::QuantizedInstanceChunk> QuantizedChunks;	// FirstInstance and DataOffset relative to this body
+	TArray<uint8> QuantizedData;
+	TArray<FString> QuantizedBase64;	// payload of each chunk
+};
+
+// Formats the bodies in the order the json writer visits them, one window of bodies at a time with ParallelFor,
+// so the writer only copies finished strings and the memory stays bounded by the window. Instances of large
+// ISMs are formatted in parallel chunks too. The output does not depend on the number of threads.
+class FBodyFormatQueue
+{
+public:
+	static constexpr int32 MaxWindowBodies = 4096;
+	static constexpr int64 MaxWindowInstances = 256 * 1024;
+	static constexpr int32 InstanceChunkSize = 4096;
+
+	FBodyFormatQueue(const FPhysicSceneSnapshot& Snapshot, const FExportChaosOptions& Options, bool bInNeedPacked)
+		: Encoding(Options.InstanceEncoding)
+		, QuantizationStep(Options.InstanceQuantizationStep)
+		, bCompressInstances(Options.bInstanceCompression)
+		, bNeedPacked(bInNeedPacked || Options.InstanceEncoding != EInstanceEncoding::Objects)
+		, ParallelFlags(Options.bParallelSerialize ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread)
+	{
+		for (const auto& bs_data : Snapshot.BodySetupDataSet)
+		{
+			for (const auto& data : bs_data.static_mesh)
+				Bodies.Add(&data);
+			for (const auto& data : bs_data.instanced_static_mesh)
+				Bodies.Add(&data);
+		}
+	}
+
+	// The next body of the walk, valid until the following call.
+	const FFormattedBody& Next()
+	{
+		if (Cursor == WindowEnd)
+		{
+			FormatWindow();
+		}
+		return Window[Cursor++ - WindowStart];
+	}
+
+private:
+	void FormatWindow()
+	{
+		WindowStart = WindowEnd;
+		int64 NumInstances = 0;
+		while (WindowEnd < Bodies.Num() && WindowEnd - WindowStart < MaxWindowBodies
+			&& (WindowEnd == WindowStart || NumInstances + Bodies[WindowEnd]->Instances.Num() <= MaxWindowInstances))
+		{
+			NumInstances += Bodies[WindowEnd]->Instances.Num();
+			WindowEnd++;
+		}
+
+		Window.Reset();
+		Window.SetNum(WindowEnd - WindowStart);
+		ParallelFor(Window.Num(), [this](int32 i)
+		{
+			FormatBody(*Bodies[WindowStart + i], Window[i]);
+		}, ParallelFlags);
+	}
+
+	void FormatBody(const SaveBodyData& data, FFormattedBody& Out) const
+	{
+		Out.Transform = data.Transform.ToString();
+
+		const int32 NumInstances = data.Instances.Num();
+		if (bNeedPacked)
+			Out.PackedInstances.SetNumUninitialized(NumInstances);
+		if (Encoding == EInstanceEncoding::Objects || Encoding == EInstanceEncoding::PackedFloats)
+			Out.Instances.SetNum(NumInstances);
+
+		const int32 NumChunks = FMath::DivideAndRoundUp(NumInstances, InstanceChunkSize);
+		ParallelFor(NumChunks, [this, &data, &Out, NumInstances](int32 Chunk)
+		{
+			const int32 End = FMath::Min(NumInstances, (Chunk + 1) * InstanceChunkSize);
+			for (int32 i = Chunk * InstanceChunkSize; i < End; ++i)
+			{
+				if (bNeedPacked)
+					Out.PackedInstances[i] = ToPackedTransform(data.Instances[i]);
+				if (Encoding == EInstanceEncoding::Objects)
+					Out.Instances[i] = data.Instances[i].ToString();
+				else if (Encoding == EInstanceEncoding::PackedFloats)
+					Out.Instances[i] = FormatPackedInstance(Out.PackedInstances[i]);
+			}
+		}, ParallelFlags);
+
+		if (Encoding == EInstanceEncoding::Base64)
+		{
+			const uint32 PackedSize = NumInstances * sizeof(ChaosScene::PackedTransform);
+			Out.InstancesBase64 = FBase64::Encode(reinterpret_cast<const uint8*>(Out.PackedInstances.GetData()), PackedSize);
+		}
+		else if (Encoding == EInstanceEncoding::Quantized)
+		{
+			QuantizeInstances(Out);
+		}
+	}
+
+	// One ChaosScene chunk per InstanceChunkSize packed instances, zlib compressed when that makes it smaller.
+	void QuantizeInstances(FFormattedBody& Out) const
+	{
+		using namespace ChaosScene;
+
+		const int32 NumInstances = Out.PackedInstances.Num();
+		const int32 NumChunks = FMath::DivideAndRoundUp(NumInstances, InstanceChunkSize);
+		TArray<TArray<uint8>> ChunkData;
+		ChunkData.SetNum(NumChunks);
+		Out.QuantizedChunks.SetNum(NumChunks);
+		Out.QuantizedBase64.SetNum(NumChunks);
+		ParallelFor(NumChunks, [this, &Out, &ChunkData, NumInstances](int32 Chunk)
+		{
+			const int32 First = Chunk * InstanceChunkSize;
+			const PackedTransform* Transforms = Out.PackedInstances.GetData() + First;
+			QuantizedInstanceChunk& Header = Out.QuantizedChunks[Chunk];
+			PrepareQuantizedChunk(Transforms, FMath::Min(NumInstances - First, InstanceChunkSize), QuantizationStep, Header);
+			Header.FirstInstance = First;
+
+			TArray<uint8> Raw;
+			Raw.SetNumUninitialized(Header.RawSize);
+			QuantizeChunk(Transforms, Header, Raw.GetData());
+
+			TArray<uint8>& Data = ChunkData[Chunk];
+			Header.Codec = static_cast<uint8>(ECodec::None);
+			if (bCompressInstances)
+			{
+				int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Raw.Num());
+				Data.SetNumUninitialized(CompressedSize);
+				if (FCompression::CompressMemory(NAME_Zlib, Data.GetData(), CompressedSize, Raw.GetData(), Raw.Num()) && CompressedSize < Raw.Num())
+				{
+					Data.SetNum(CompressedSize);
+					Header.Codec = static_cast<uint8>(ECodec::Zlib);
+				}
+			}
+			if (Header.Codec == static_cast<uint8>(ECodec::None))
+			{
+				Data = MoveTemp(Raw);
+			}
+			Header.DataSize = Data.Num();
+			Out.QuantizedBase64[Chunk] = FBase64::Encode(Data);
+		}, ParallelFlags);
+
+		// the same layout as the QuantizedInstanceData section, so the binary writer copies it as is
+		for (int32 Chunk = 0; Chunk < NumChunks; ++Chunk)
+		{
+			Out.QuantizedData.SetNumZeroed(Align(Out.QuantizedData.Num(), SectionAlignment));
+			Out.QuantizedChunks[Chunk].DataOffset = Out.QuantizedData.Num();
+			Out.QuantizedData.Append(ChunkData[Chunk]);
+		}
+	}
+
+	const EInstanceEncoding Encoding;
+	const float QuantizationStep;
+	const bool bCompressInstances;
+	const bool bNeedPacked;
+	const EParallelForFlags ParallelFlags;
+	TArray<const SaveBodyData*> Bodies;
+	TArray<FFormattedBody> Window;
+	int32 WindowStart = 0;
+	int32 WindowEnd = 0;
+	int32 Cursor = 0;
+};
+
+// Write fills <FilePath>.tmp, which is only moved over FilePath once complete: a failed or interrupted write
+// never leaves a partial file where the server maps it.
+bool WriteFileThroughTemp(const FString& FilePath, TFunctionRef<void(FArchive&)> Write)
+{
+	const FString TempFilePath = FilePath + TEXT(".tmp");
+	TUniquePtr<FArchive> FileAr(IFileManager::Get().CreateFileWriter(*TempFilePath));
+	bool bWritten = false;
+	if (FileAr != nullptr)
+	{
+		Write(*FileAr);
+		bWritten = FileAr->Close();
+		FileAr.Reset();
+	}
+	if (!bWritten || !IFileManager::Get().Move(*FilePath, *TempFilePath, true))
+	{
+		IFileManager::Get().Delete(*TempFilePath);
+		return false;
+	}
+	return true;
+}
+
+// Writes the collision of one landscape as a ChaosScene landscape archive, the tiles are already sorted by section.
+bool WriteLandscapeArchive(const FString& FilePath, std::vector<SaveLandscapeCollisionData>& collisions)
+{
+	using namespace ChaosScene;
+
+	TArray<LandscapeTileEntry> Tiles;
+	Tiles.Reserve(collisions.size());
+	uint64 FileSize = sizeof(LandscapeArchiveHeader) + collisions.size() * sizeof(LandscapeTileEntry);
+	for (const auto& coll_data : collisions)
+	{
+		LandscapeTileEntry& Tile = Tiles.AddZeroed_GetRef();
+		Tile.SectionBaseX = coll_data.SectionBaseX;
+		Tile.SectionBaseY = coll_data.SectionBaseY;
+		Tile.CompID = coll_data.CompID;
+		Tile.Offset = Align(FileSize, SectionAlignment);
+		Tile.Size = coll_data.CookedCollisionData.Num();
+		FileSize = Tile.Offset + Tile.Size;
+	}
+
+	LandscapeArchiveHeader Header;
+	Header.Magic = LandscapeArchiveMagic;
+	Header.Version = LandscapeArchiveVersion;
+	Header.TileCount = Tiles.Num();
+	Header.TileTableOffset = sizeof(LandscapeArchiveHeader);
+	Header.FileSize = FileSize;
+
+	return WriteFileThroughTemp(FilePath, [&](FArchive& FileAr)
+	{
+		FileAr.Serialize(&Header, sizeof(Header));
+		FileAr.Serialize(Tiles.GetData(), Tiles.Num() * sizeof(LandscapeTileEntry));
+
+		uint8 Padding[SectionAlignment] = {};
+		for (int32 i = 0; i < Tiles.Num(); ++i)
+		{
+			FileAr.Serialize(Padding, Tiles[i].Offset - FileAr.Tell());
+			FileAr.Serialize(collisions[i].CookedCollisionData.GetData(), Tiles[i].Size);
+			collisions[i].CookedCollisionData.Empty();
+		}
+	});
+}
+
+// Mip 0 holds the height range of every quad, every next mip merges 2x2 cells of the previous one.
+void BuildHeightPyramid(const uint16* Samples, uint32 SizeQuads, TArray<ChaosScene::HeightMinMax>& OutPyramid)
+{
+	using namespace ChaosScene;
+
+	OutPyramid.SetNumUninitialized(static_cast<int32>(HeightPyramidCellCount(SizeQuads)));
+	const uint32 Stride = SizeQuads + 1;
+	for (uint32 y = 0; y < SizeQuads; ++y)
+	{
+		for (uint32 x = 0; x < SizeQuads; ++x)
+		{
+			const uint16 H00 = Samples[y * Stride + x];
+			const uint16 H10 = Samples[y * Stride + x + 1];
+			const uint16 H01 = Samples[(y + 1) * Stride + x];
+			const uint16 H11 = Samples[(y + 1) * Stride + x + 1];
+			OutPyramid[y * SizeQuads + x] = { FMath::Min(FMath::Min(H00, H10), FMath::Min(H01, H11)), FMath::Max(FMath::Max(H00, H10), FMath::Max(H01, H11)) };
+		}
+	}
+
+	const uint32 NumMips = HeightPyramidNumMips(SizeQuads);
+	for (uint32 Mip = 1; Mip < NumMips; ++Mip)
+	{
+		const uint32 ParentSize = HeightPyramidMipSize(SizeQuads, Mip - 1);
+		const uint32 Size = HeightPyramidMipSize(SizeQuads, Mip);
+		const HeightMinMax* Parent = OutPyramid.GetData() + HeightPyramidMipOffset(SizeQuads, Mip - 1);
+		HeightMinMax* Cells = OutPyramid.GetData() + HeightPyramidMipOffset(SizeQuads, Mip);
+		for (uint32 y = 0; y < Size; ++y)
+		{
+			for (uint32 x = 0; x < Size; ++x)
+			{
+				HeightMinMax Range = { MAX_uint16, 0 };
+				for (uint32 Child = 0; Child < 4; ++Child)
+				{
+					const uint32 ChildX = x * 2 + (Child & 1);
+					const uint32 ChildY = y * 2 + (Child >> 1);
+					if (ChildX < ParentSize && ChildY < ParentSize)
+					{
+						Range.Min = FMath::Min(Range.Min, Parent[ChildY * ParentSize + ChildX].Min);
+						Range.Max = FMath::Max(Range.Max, Parent[ChildY * ParentSize + ChildX].Max);
+					}
+				}
+				Cells[y * Size + x] = Range;
+			}
+		}
+	}
+}
+
+// Writes the height samples and pyramids of one landscape as a ChaosScene landscape heights file.
+bool WriteLandscapeHeights(const FString& FilePath, std::vector<SaveLandscapeCollisionData>& collisions)
+{
+	using namespace ChaosScene;
+
+	struct FHeightTile
+	{
+		SaveLandscapeCollisionData* coll_data;
+		TArray<HeightMinMax> Pyramid;
+	};
+	TArray<FHeightTile> HeightTiles;
+	TArray<HeightTileEntry> Tiles;
+	for (auto& coll_data : collisions)
+	{
+		const uint32 SizeQuads = coll_data.CollisionSizeQuads;
+		const uint32 SimpleSizeQuads = FMath::Max(coll_data.SimpleCollisionSizeQuads, 0);
+		const int32 NumSamples = (SizeQuads + 1) * (SizeQuads + 1);
+		const int32 NumSimpleSamples = SimpleSizeQuads > 0 ? (SimpleSizeQuads + 1) * (SimpleSizeQuads + 1) : 0;
+		if (SizeQuads == 0 || coll_data.HeightSamples.Num() != NumSamples + NumSimpleSamples)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("%s: %d height samples do not match CollisionSizeQuads %d, skipped"), *coll_data.Package, coll_data.HeightSamples.Num(), SizeQuads);
+			continue;
+		}
+
+		FHeightTile& HeightTile = HeightTiles.AddDefaulted_GetRef();
+		HeightTile.coll_data = &coll_data;
+		BuildHeightPyramid(coll_data.HeightSamples.GetData(), SizeQuads, HeightTile.Pyramid);
+
+		HeightTileEntry& Tile = Tiles.AddZeroed_GetRef();
+		Tile.SectionBaseX = coll_data.SectionBaseX;
+		Tile.SectionBaseY = coll_data.SectionBaseY;
+		Tile.CompID = coll_data.CompID;
+		Tile.SizeQuads = SizeQuads;
+		Tile.SimpleSizeQuads = SimpleSizeQuads;
+		Tile.CollisionScale = coll_data.CollisionScale;
+		Tile.NumMips = HeightPyramidNumMips(SizeQuads);
+		Tile.Transform = ToPackedTransform(coll_data.Transform);
+	}
+
+	uint64 FileSize = sizeof(LandscapeHeightsHeader) + Tiles.Num() * sizeof(HeightTileEntry);
+	for (int32 i = 0; i < Tiles.Num(); ++i)
+	{
+		HeightTileEntry& Tile = Tiles[i];
+		const uint64 NumSamples = uint64(Tile.SizeQuads + 1) * (Tile.SizeQuads + 1);
+		Tile.SamplesOffset = Align(FileSize, SectionAlignment);
+		FileSize = Tile.SamplesOffset + NumSamples * sizeof(uint16);
+		if (Tile.SimpleSizeQuads > 0)
+		{
+			Tile.SimpleSamplesOffset = Align(FileSize, SectionAlignment);
+			FileSize = Tile.SimpleSamplesOffset + (HeightTiles[i].coll_data->HeightSamples.Num() - NumSamples) * sizeof(uint16);
+		}
+		Tile.PyramidOffset = Align(FileSize, SectionAlignment);
+		FileSize = Tile.PyramidOffset + HeightTiles[i].Pyramid.Num() * sizeof(HeightMinMax);
+	}
+
+	LandscapeHeightsHeader Header;
+	Header.Magic = LandscapeHeightsMagic;
+	Header.Version = LandscapeHeightsVersion;
+	Header.TileCount = Tiles.Num();
+	Header.TileTableOffset = sizeof(LandscapeHeightsHeader);
+	Header.FileSize = FileSize;
+
+	return WriteFileThroughTemp(FilePath, [&](FArchive& FileAr)
+	{
+		FileAr.Serialize(&Header, sizeof(Header));
+		FileAr.Serialize(Tiles.GetData(), Tiles.Num() * sizeof(HeightTileEntry));
+
+		uint8 Padding[SectionAlignment] = {};
+		for (int32 i = 0; i < Tiles.Num(); ++i)
+		{
+			const HeightTileEntry& Tile = Tiles[i];
+			TArray<uint16>& HeightSamples = HeightTiles[i].coll_data->HeightSamples;
+			const int64 NumSamples = int64(Tile.SizeQuads + 1) * (Tile.SizeQuads + 1);
+
+			FileAr.Serialize(Padding, Tile.SamplesOffset - FileAr.Tell());
+			FileAr.Serialize(HeightSamples.GetData(), NumSamples * sizeof(uint16));
+			if (Tile.SimpleSizeQuads > 0)
+			{
+				FileAr.Serialize(Padding, Tile.SimpleSamplesOffset - FileAr.Tell());
+				FileAr.Serialize(HeightSamples.GetData() + NumSamples, (HeightSamples.Num() - NumSamples) * sizeof(uint16));
+			}
+			FileAr.Serialize(Padding, Tile.PyramidOffset - FileAr.Tell());
+			FileAr.Serialize(HeightTiles[i].Pyramid.GetData(), HeightTiles[i].Pyramid.Num() * sizeof(HeightMinMax));
+			HeightSamples.Empty();
+		}
+	});
+}
+
+// Writes one ChaosScene BodySetup file (.pbody).
+bool WriteBodySetupFile(const FString& FilePath, const SaveCookedGeometryData& Geometry)
+{
+	using namespace ChaosScene;
+
+	TArray<uint8> Strings;
+	Strings.Add(0);
+	auto AddString = [&Strings](const FString& Str) -> uint32
+	{
+		if (Str.IsEmpty())
+			return 0;
+		FTCHARToUTF8 Utf8(*Str);
+		const uint32 Offset = Strings.Num();
+		Strings.Append(reinterpret_cast<const uint8*>(Utf8.Get()), Utf8.Length());
+		Strings.Add(0);
+		return Offset;
+	};
+
+	BodySetupFileHeader Header;
+	FMemory::Memzero(Header);
+	Header.Magic = BodySetupFileMagic;
+	Header.Version = BodySetupFileVersion;
+	Header.ShapeCount = Geometry.Shapes.Num();
+	Header.ShapeTableOffset = sizeof(BodySetupFileHeader);
+	Header.CookedFormat = AddString(Geometry.CookedFormat);
+	Header.EngineVersion = AddString(FEngineVersion::Current().ToString());
+	Header.DefaultInstance = AddString(Geometry.DefaultInstance);
+	Header.PhysMaterial = AddString(Geometry.PhysMaterial);
+	Header.CollisionTraceFlag = Geometry.CollisionTraceFlag;
+	Header.PhysicsType = Geometry.PhysicsType;
+	Header.DoubleSidedGeometry = Geometry.bDoubleSidedGeometry ? 1 : 0;
+	Header.CookedOffset = Align(Header.ShapeTableOffset + Geometry.Shapes.Num() * sizeof(BodyShapeRecord), SectionAlignment);
+	Header.CookedSize = Geometry.CookedData.Num();
+	Header.StringsOffset = static_cast<uint32>(Header.CookedOffset + Header.CookedSize);
+	Header.StringsSize = Strings.Num();
+	Header.FileSize = Header.StringsOffset + Header.StringsSize;
+
+	// CapturePhysicScene skips an unchanged BodySetup whose .pbody exists, a partial one must never be left there
+	return WriteFileThroughTemp(FilePath, [&](FArchive& FileAr)
+	{
+		uint8 Padding[SectionAlignment] = {};
+		FileAr.Serialize(&Header, sizeof(Header));
+		FileAr.Serialize(const_cast<BodyShapeRecord*>(Geometry.Shapes.GetData()), Geometry.Shapes.Num() * sizeof(BodyShapeRecord));
+		FileAr.Serialize(Padding, Header.CookedOffset - FileAr.Tell());
+		FileAr.Serialize(const_cast<uint8*>(Geometry.CookedData.GetData()), Geometry.CookedData.Num());
+		FileAr.Serialize(Strings.GetData(), Strings.Num());
+	});
+}
+
+// The .pbody of every BodySetup a direct export captured, on all cores. They are done with then: no package is
+// left to cook, failed ones stay out of the manifest like a failed package save.
+void WriteBodySetupFiles(FPhysicSceneSnapshot& Snapshot, FExportChaosProgress& Progress)
+{
+	FExportChaosStats& Stats = Progress.GetStats();
+	EXPORT_CHAOS_PHASE(Stats, "Write.BodySetups");
+	IFileManager::Get().MakeDirectory(*(GetCookedContentDir() / "Physic"), true);
+
+	TArray<SaveBodySetupData*> Pending;
+	for (auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		if (bs_data.bCook && bs_data.CookedGeometry)
+			Pending.Add(&bs_data);
+	}
+	std::atomic<int64> BytesWritten = 0;
+	ParallelFor(Pending.Num(), [&Pending, &BytesWritten, &Progress](int32 i)
+	{
+		if (Progress.IsCancelled())
+			return;
+		SaveBodySetupData& bs_data = *Pending[i];
+		const FString FilePath = GetBodySetupFilePath(bs_data.Package);
+		if (WriteBodySetupFile(FilePath, *bs_data.CookedGeometry))
+		{
+			BytesWritten += IFileManager::Get().FileSize(*FilePath);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to write %s"), *FilePath);
+			bs_data.bSaveFailed = true;
+		}
+		bs_data.bCook = false;
+		bs_data.CookedGeometry.Reset();
+	});
+	Stats.Add(TEXT("Write.BodySetups"), Pending.Num(), BytesWritten.load());
+}
+
+// Writes the .data (or the archive) of every landscape tile that changed and drops the copied collision data again.
+void WriteLandscapeData(FPhysicSceneSnapshot& Snapshot, FExportManifest& Manifest, FExportChaosProgress& Progress)
+{
+	const FString SavePath = GetCookedContentDir() / "Landscape" / Snapshot.MapName;
+	FExportChaosStats& Stats = Progress.GetStats();
+	EXPORT_CHAOS_PHASE(Stats, "Write.Landscape");
+	for (auto& land_data : Snapshot.LandscapeDataSet)
+	{
+		if (Progress.IsCancelled())
+			return;
+
+		if (land_data.bHeights)
+		{
+			FString HeightsFileName = SavePath / GetLandscapeHeightsName(land_data.LandGuid);
+			if (!land_data.bWriteHeights || WriteLandscapeHeights(HeightsFileName, land_data.collisions))
+			{
+				if (land_data.bWriteHeights)
+					Stats.Add(TEXT("Write.Landscape"), 0, IFileManager::Get().FileSize(*HeightsFileName));
+				Manifest.Record(TEXT("LandscapeHeights"), land_data.LandGuid.ToString(), land_data.HeightsHash);
+			}
+			else
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to write landscape heights %s"), *HeightsFileName);
+				land_data.bHeights = false;
+			}
+		}
+
+		if (land_data.bArchive)
+		{
+			FString ArchiveFileName = SavePath / GetLandscapeArchiveName(land_data.LandGuid);
+			if (land_data.bWriteArchive && !WriteLandscapeArchive(ArchiveFileName, land_data.collisions))
+			{
+				UE_LOG(LogTemp, Error, TEXT("Failed to write landscape archive %s"), *ArchiveFileName);
+				for (auto& coll_data : land_data.collisions)
+				{
+					coll_data.bExported = false;
+				}
+				continue;
+			}
+			if (land_data.bWriteArchive)
+				Stats.Add(TEXT("Write.Landscape"), (int64)land_data.collisions.size(), IFileManager::Get().FileSize(*ArchiveFileName));
+			Manifest.Record(TEXT("LandscapeArchives"), land_data.LandGuid.ToString(), land_data.ArchiveHash);
+			continue;
+		}
+
+		for (auto& coll_data : land_data.collisions)
+		{
+			if (Progress.IsCancelled())
+				return;
+
+			if (coll_data.bWriteData)
+			{
+				FString PackageFileName = SavePath / coll_data.Package + ".data";
+				TUniquePtr<FArchive> FileAr(IFileManager::Get().CreateFileWriter(*PackageFileName));
+				if (FileAr == NULL)
+				{
+					coll_data.bExported = false;
+					continue;
+				}
+				coll_data.CookedCollisionData.BulkSerialize(*FileAr);
+				Stats.Add(TEXT("Write.Landscape"), 1, FileAr->Tell());
+				FileAr->Close();
+				coll_data.CookedCollisionData.Empty();
+			}
+			Manifest.Record(TEXT("LandscapeTiles"), coll_data.Package, coll_data.Hash);
+		}
+	}
+}
+
+// Binned SAH BVH over world space boxes, flattened depth first as described at ChaosScene::BVHNode.
+class FStaticBVHBuilder
+{
+public:
+	static constexpr int32 NumBins = 16;
+	static constexpr int32 MinLeafSize = 4;		// nodes this small are never split
+	static constexpr int32 MaxLeafSize = 16;	// nodes this large are always split
+
+	void Add(const FBox& Bounds, const ChaosScene::StaticBVHPrim& Prim)
+	{
+		Boxes.Add(Bounds);
+		Centers.Add(Bounds.GetCenter());
+		Prims.Add(Prim);
+	}
+
+	void Build(TArray<ChaosScene::BVHNode>& OutNodes, TArray<ChaosScene::StaticBVHPrim>& OutPrims)
+	{
+		if (Prims.Num() == 0)
+			return;
+		Order.SetNumUninitialized(Prims.Num());
+		for (int32 i = 0; i < Order.Num(); ++i)
+		{
+			Order[i] = i;
+		}
+		OutNodes.Reserve(2 * Prims.Num() / MinLeafSize + 1);
+		BuildNode(0, Order.Num(), OutNodes);
+
+		OutPrims.Reserve(OutPrims.Num() + Order.Num());
+		for (int32 Index : Order)
+		{
+			OutPrims.Add(Prims[Index]);
+		}
+	}
+
+private:
+	static double SurfaceArea(const FBox& Box)
+	{
+		const FVector Size = Box.GetSize();
+		return 2.0 * (Size.X * Size.Y + Size.Y * Size.Z + Size.Z * Size.X);
+	}
+
+	int32 BuildNode(int32 Begin, int32 End, TArray<ChaosScene::BVHNode>& Nodes)
+	{
+		FBox Bounds(ForceInit);
+		FBox CenterBounds(ForceInit);
+		for (int32 i = Begin; i < End; ++i)
+		{
+			Bounds += Boxes[Order[i]];
+			CenterBounds += Centers[Order[i]];
+		}
+
+		const int32 NodeIndex = Nodes.AddZeroed();
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			Nodes[NodeIndex].Min[Axis] = static_cast<float>(Bounds.Min[Axis]);
+			Nodes[NodeIndex].Max[Axis] = static_cast<float>(Bounds.Max[Axis]);
+		}
+
+		const int32 Split = End - Begin > MinLeafSize ? PartitionNode(Begin, End, Bounds, CenterBounds) : INDEX_NONE;
+		if (Split == INDEX_NONE)
+		{
+			Nodes[NodeIndex].First = Begin;
+			Nodes[NodeIndex].Count = End - Begin;
+			return NodeIndex;
+		}
+
+		BuildNode(Begin, Split, Nodes);
+		const int32 RightIndex = BuildNode(Split, End, Nodes);
+		Nodes[NodeIndex].First = RightIndex;
+		Nodes[NodeIndex].Count = 0;
+		return NodeIndex;
+	}
+
+	// Reorders [Begin, End) around the cheapest binned split plane and returns the split point,
+	// INDEX_NONE when a leaf is cheaper than any split.
+	int32 PartitionNode(int32 Begin, int32 End, const FBox& Bounds, const FBox& CenterBounds)
+	{
+		const int32 Count = End - Begin;
+		double BestCost = Count * SurfaceArea(Bounds);
+		int32 BestAxis = INDEX_NONE;
+		int32 BestBin = 0;
+
+		for (int32 Axis = 0; Axis < 3; ++Axis)
+		{
+			const double Extent = CenterBounds.Max[Axis] - CenterBounds.Min[Axis];
+			if (Extent <= UE_DOUBLE_SMALL_NUMBER)
+				continue;
+
+			FBox BinBounds[NumBins];
+			int32 BinCounts[NumBins] = {};
+			for (int32 Bin = 0; Bin < NumBins; ++Bin)
+			{
+				BinBounds[Bin].Init();
+			}
+			for (int32 i = Begin; i < End; ++i)
+			{
+				const int32 Bin = GetBin(Centers[Order[i]][Axis], CenterBounds.Min[Axis], Extent);
+				BinBounds[Bin] += Boxes[Order[i]];
+				BinCounts[Bin]++;
+			}
+
+			// right side areas swept from the back, then the left side from the front
+			double RightArea[NumBins];
+			int32 RightCount[NumBins];
+			FBox Accum(ForceInit);
+			int32 AccumCount = 0;
+			for (int32 Bin = NumBins - 1; Bin > 0; --Bin)
+			{
+				Accum += BinBounds[Bin];
+				AccumCount += BinCounts[Bin];
+				RightArea[Bin] = AccumCount > 0 ? SurfaceArea(Accum) : 0.0;
+				RightCount[Bin] = AccumCount;
+			}
+			Accum.Init();
+			AccumCount = 0;
+			for (int32 Bin = 1; Bin < NumBins; ++Bin)
+			{
+				Accum += BinBounds[Bin - 1];
+				AccumCount += BinCounts[Bin - 1];
+				if (AccumCount == 0 || RightCount[Bin] == 0)
+					continue;
+				const double Cost = AccumCount * SurfaceArea(Accum) + RightCount[Bin] * RightArea[Bin];
+				if (Cost < BestCost)
+				{
+					BestCost = Cost;
+					BestAxis = Axis;
+					BestBin = Bin;
+				}
+			}
+		}
+
+		if (BestAxis == INDEX_NONE)
+		{
+			if (Count <= MaxLeafSize)
+				return INDEX_NONE;
+			// no plane separates the centers, split the range in half so leaves stay small
+			return Begin + Count / 2;
+		}
+
+		const double Min = CenterBounds.Min[BestAxis];
+		const double Extent = CenterBounds.Max[BestAxis] - Min;
+		int32* Middle = std::partition(Order.GetData() + Begin, Order.GetData() + End, [&](int32 Index)
+		{
+			return GetBin(Centers[Index][BestAxis], Min, Extent) < BestBin;
+		});
+		return static_cast<int32>(Middle - Order.GetData());
+	}
+
+	static int32 GetBin(double Center, double Min, double Extent)
+	{
+		return FMath::Clamp(static_cast<int32>(NumBins * (Center - Min) / Extent), 0, NumBins - 1);
+	}
+
+	TArray<FBox> Boxes;
+	TArray<FVector> Centers;
+	TArray<ChaosScene::StaticBVHPrim> Prims;
+	TArray<int32> Order;
+};
+
+// Static bodies of one scene merged by ExportChaos.StaticAggregateCellSize.
+struct FStaticAggregate
+{
+	FIntVector Cell;
+	FTransform Transform;		// center of the cell, the shapes are relative to it
+	FBox Bounds = FBox(ForceInit);	// world bounds of the shapes
+	TArray<TPair<int32, const SaveBodyData*>> Shapes;	// index into BodySetupDataSet, body
+};
+
+struct FStaticAggregates
+{
+	TArray<FStaticAggregate> Aggregates;
+	TSet<const SaveBodyData*> Bodies;	// every merged body, left out of the "StaticMesh" entries
+};
+
+// Groups the static bodies of the snapshot by cubic cell, in the order the cells are first seen.
+// A cell with a single body keeps it as a plain "StaticMesh" entry, merging it would not save a particle.
+FStaticAggregates BuildStaticAggregates(const FPhysicSceneSnapshot& Snapshot, float CellSize)
+{
+	FStaticAggregates Result;
+	TMap<FIntVector, int32> CellIndices;
+	for (int32 bs = 0; bs < (int32)Snapshot.BodySetupDataSet.size(); ++bs)
+	{
+		const auto& bs_data = Snapshot.BodySetupDataSet[bs];
+		for (const auto& data : bs_data.static_mesh)
+		{
+			if (data.bSimulatePhysics || data.bMovable)
+				continue;
+
+			const FVector Location = data.Transform.GetLocation();
+			const FIntVector Cell(FMath::FloorToInt32(Location.X / CellSize), FMath::FloorToInt32(Location.Y / CellSize), FMath::FloorToInt32(Location.Z / CellSize));
+			int32& Index = CellIndices.FindOrAdd(Cell, INDEX_NONE);
+			if (Index == INDEX_NONE)
+			{
+				Index = Result.Aggregates.Num();
+				FStaticAggregate& Aggregate = Result.Aggregates.AddDefaulted_GetRef();
+				Aggregate.Cell = Cell;
+				Aggregate.Transform.SetLocation((FVector(Cell) + 0.5) * CellSize);
+			}
+			FStaticAggregate& Aggregate = Result.Aggregates[Index];
+			Aggregate.Bounds += bs_data.LocalBounds.TransformBy(data.Transform);
+			Aggregate.Shapes.Emplace(bs, &data);
+		}
+	}
+
+	Result.Aggregates.RemoveAll([](const FStaticAggregate& Aggregate) { return Aggregate.Shapes.Num() < 2; });
+	for (const FStaticAggregate& Aggregate : Result.Aggregates)
+	{
+		for (const auto& Shape : Aggregate.Shapes)
+		{
+			Result.Bodies.Add(Shape.Value);
+		}
+	}
+	return Result;
+}
+
+// Transform of a merged body relative to its aggregate, which only has a translation.
+FTransform GetAggregateShapeTransform(const FStaticAggregate& Aggregate, const SaveBodyData& data)
+{
+	FTransform LocalTransform = data.Transform;
+	LocalTransform.SetLocation(data.Transform.GetLocation() - Aggregate.Transform.GetLocation());
+	return LocalTransform;
+}
+
+// Fills the StaticBVH sections, body and instance indices follow the order WritePhysicSceneJson adds the records in.
+void BuildStaticBVH(const FPhysicSceneSnapshot& Snapshot, const FStaticAggregates* Aggregates, FChaosSceneBinaryWriter& BinaryWriter)
+{
+	FStaticBVHBuilder Builder;
+	uint32 StaticMeshIndex = 0;
+	uint32 InstancedIndex = 0;
+	uint32 InstanceIndex = 0;
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		for (const auto& data : bs_data.static_mesh)
+		{
+			// StaticMeshBodies has no record for a merged body
+			if (Aggregates && Aggregates->Bodies.Contains(&data))
+				continue;
+
+			if (!data.bSimulatePhysics && !data.bMovable)
+			{
+				Builder.Add(bs_data.LocalBounds.TransformBy(data.Transform), { StaticMeshIndex, ChaosScene::InvalidIndex });
+			}
+			StaticMeshIndex++;
+		}
+
+		for (const auto& data : bs_data.instanced_static_mesh)
+		{
+			for (const auto& inst_Transform : data.Instances)
+			{
+				if (!data.bSimulatePhysics && !data.bMovable)
+				{
+					Builder.Add(bs_data.LocalBounds.TransformBy(inst_Transform), { InstancedIndex, InstanceIndex });
+				}
+				InstanceIndex++;
+			}
+			InstancedIndex++;
+		}
+	}
+	if (Aggregates)
+	{
+		for (int32 i = 0; i < Aggregates->Aggregates.Num(); ++i)
+		{
+			Builder.Add(Aggregates->Aggregates[i].Bounds, { static_cast<uint32>(i), ChaosScene::AggregatePrim });
+		}
+	}
+	Builder.Build(BinaryWriter.StaticBVHNodes, BinaryWriter.StaticBVHPrims);
+}
+
+// See ChaosScene::ConstraintIslandRecord.
+struct FConstraintIsland
+{
+	TArray<uint32> Bodies;		// ActorIDs
+	TArray<int32> Constraints;	// indices into ConstraintDataSet
+};
+
+// Islands of the constraints of the snapshot, in the order of their first constraint. An actor is a simulating body
+// when one of its bodies simulates; the other actors, and the ones without an exported body, are static anchors.
+TArray<FConstraintIsland> BuildConstraintIslands(const FPhysicSceneSnapshot& Snapshot)
+{
+	TSet<uint32> DynamicActors;
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		for (const auto& data : bs_data.static_mesh)
+		{
+			if (data.bSimulatePhysics)
+				DynamicActors.Add(data.ActorID);
+		}
+		for (const auto& data : bs_data.instanced_static_mesh)
+		{
+			if (data.bSimulatePhysics)
+				DynamicActors.Add(data.ActorID);
+		}
+	}
+
+	// constraints of each simulating body, in index order
+	const int32 NumConstraints = static_cast<int32>(Snapshot.ConstraintDataSet.size());
+	TMap<uint32, TArray<int32>> BodyConstraints;
+	for (int32 i = 0; i < NumConstraints; ++i)
+	{
+		const auto& data = Snapshot.ConstraintDataSet[i];
+		if (DynamicActors.Contains(data.ActorID1))
+			BodyConstraints.FindOrAdd(data.ActorID1).Add(i);
+		if (data.ActorID2 != data.ActorID1 && DynamicActors.Contains(data.ActorID2))
+			BodyConstraints.FindOrAdd(data.ActorID2).Add(i);
+	}
+	auto IsAnchored = [&DynamicActors](const SaveConstraintData& data)
+	{
+		return data.ActorID1 == data.ActorID2 || !DynamicActors.Contains(data.ActorID1) || !DynamicActors.Contains(data.ActorID2);
+	};
+
+	TArray<FConstraintIsland> Islands;
+	TBitArray<> VisitedConstraints(false, NumConstraints);
+	for (int32 First = 0; First < NumConstraints; ++First)
+	{
+		const auto& first_data = Snapshot.ConstraintDataSet[First];
+		const uint32 FirstBody = DynamicActors.Contains(first_data.ActorID1) ? first_data.ActorID1 : first_data.ActorID2;
+		// constraints between static bodies leave nothing to solve
+		if (VisitedConstraints[First] || !DynamicActors.Contains(FirstBody))
+			continue;
+
+		// flood fill for the constraints of the island
+		TArray<int32> IslandConstraints;
+		TArray<uint32> Stack = { FirstBody };
+		TSet<uint32> Reached = { FirstBody };
+		while (Stack.Num() > 0)
+		{
+			const uint32 ActorID = Stack.Pop();
+			for (const int32 c : BodyConstraints[ActorID])
+			{
+				if (VisitedConstraints[c])
+					continue;
+				VisitedConstraints[c] = true;
+				IslandConstraints.Add(c);
+				for (const uint32 Other : { Snapshot.ConstraintDataSet[c].ActorID1, Snapshot.ConstraintDataSet[c].ActorID2 })
+				{
+					if (DynamicActors.Contains(Other) && !Reached.Contains(Other))
+					{
+						Reached.Add(Other);
+						Stack.Add(Other);
+					}
+				}
+			}
+		}
+		IslandConstraints.Sort();
+
+		// anchored constraints first, then breadth first from their bodies
+		FConstraintIsland& Island = Islands.AddDefaulted_GetRef();
+		TSet<uint32> Queued;
+		TSet<int32> Emitted;
+		auto Enqueue = [&Island, &Queued, &DynamicActors](uint32 ActorID)
+		{
+			if (DynamicActors.Contains(ActorID) && !Queued.Contains(ActorID))
+			{
+				Queued.Add(ActorID);
+				Island.Bodies.Add(ActorID);
+			}
+		};
+		for (const int32 c : IslandConstraints)
+		{
+			if (IsAnchored(Snapshot.ConstraintDataSet[c]))
+			{
+				Emitted.Add(c);
+				Island.Constraints.Add(c);
+				Enqueue(Snapshot.ConstraintDataSet[c].ActorID1);
+				Enqueue(Snapshot.ConstraintDataSet[c].ActorID2);
+			}
+		}
+		Enqueue(FirstBody);
+
+		for (int32 b = 0; b < Island.Bodies.Num(); ++b)
+		{
+			for (const int32 c : BodyConstraints[Island.Bodies[b]])
+			{
+				if (Emitted.Contains(c))
+					continue;
+				Emitted.Add(c);
+				Island.Constraints.Add(c);
+				Enqueue(Snapshot.ConstraintDataSet[c].ActorID1);
+				Enqueue(Snapshot.ConstraintDataSet[c].ActorID2);
+			}
+		}
+	}
+	return Islands;
+}
+
+// Index of each constraint into the distinct profiles of the snapshot, in order of first use.
+void InternConstraintProfiles(const FPhysicSceneSnapshot& Snapshot, TArray<int32>& OutIndices, TArray<const FConstraintProfileProperties*>& OutProfiles)
+{
+	TMap<uint64, int32> ProfileIndices;
+	OutIndices.Reset(Snapshot.ConstraintDataSet.size());
+	for (const auto& data : Snapshot.ConstraintDataSet)
+	{
+		// the hash only picks the candidate, a collision gets its own entry
+		const int32* Found = ProfileIndices.Find(data.ProfileHash);
+		if (Found && FConstraintProfileProperties::StaticStruct()->CompareScriptStruct(OutProfiles[*Found], &data.profile, PPF_None))
+		{
+			OutIndices.Add(*Found);
+		}
+		else
+		{
+			const int32 Index = OutProfiles.Add(&data.profile);
+			ProfileIndices.Add(data.ProfileHash, Index);
+			OutIndices.Add(Index);
+		}
+	}
+}
+
+// Streams the snapshot into the PhysicScene json and, when BinaryWriter is set, the binary scene records.
+// The bodies of Aggregates are written as "StaticAggregates" instead of "StaticMesh" entries. Islands, built on the
+// whole map, are only written when the scene holds all its constraints in the order of Snapshot.ConstraintDataSet.
+bool WritePhysicSceneJson(const FPhysicSceneSnapshot& Snapshot, const FExportChaosOptions& Options, const FString& JsonFilePath, FChaosSceneBinaryWriter* BinaryWriter,
+	const FStaticAggregates* Aggregates, const TArray<FConstraintIsland>* Islands, FExportChaosProgress& Progress)
+{
+	// records are streamed straight into the file instead of building the whole FJsonObject tree first,
+	// the temp file is moved over the scene once it is complete
+	FString JsonTempFilePath = JsonFilePath + TEXT(".tmp");
+	TUniquePtr<FArchive> JsonFileAr(IFileManager::Get().CreateFileWriter(*JsonTempFilePath));
+	if (JsonFileAr == nullptr)
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to create %s"), *JsonTempFilePath);
+		return false;
+	}
+	TSharedRef<FSceneJsonWriter> JsonWriter = FSceneJsonWriterFactory::Create(JsonFileAr.Get());
+	JsonWriter->WriteObjectStart();
+
+	// decodes the "Overrides" of the bodies, bit i is entry i
+	JsonWriter->WriteArrayStart(TEXT("BodyOverrideFields"));
+	for (const ChaosScene::BodyOverrideField& Field : ChaosScene::BodyOverrideFields)
+	{
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("Name"), ANSI_TO_TCHAR(Field.Name));
+		JsonWriter->WriteValue(TEXT("Type"), static_cast<int32>(Field.Type));
+		JsonWriter->WriteObjectEnd();
+	}
+	JsonWriter->WriteArrayEnd();
+
+	FBodyFormatQueue BodyFormatQueue(Snapshot, Options, BinaryWriter != nullptr);
+	JsonWriter->WriteArrayStart(TEXT("BodySetups"));
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		if (Progress.IsCancelled())
+			break;
+
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("Package"), bs_data.Package);
+		JsonWriter->WriteValue(TEXT("Name"), bs_data.Name);
+		JsonWriter->WriteValue(TEXT("Path"), bs_data.Path);
+		JsonWriter->WriteValue(TEXT("Guid"), bs_data.Guid.ToString());
+		if (Options.bDirectBodySetups)
+		{
+			JsonWriter->WriteValue(TEXT("BodyFile"), TEXT("Physic/") + bs_data.Package + TEXT(".pbody"));
+		}
+
+		const uint32 BodySetupIndex = BinaryWriter ? BinaryWriter->BodySetups.Num() : 0;
+		if (BinaryWriter)
+		{
+			ChaosScene::BodySetupRecord& bs_record = BinaryWriter->BodySetups.AddDefaulted_GetRef();
+			bs_record.Package = BinaryWriter->AddString(bs_data.Package);
+			bs_record.Name = BinaryWriter->AddString(bs_data.Name);
+			bs_record.Path = BinaryWriter->AddString(bs_data.Path);
+			CopyGuid(bs_data.Guid, bs_record.Guid);
+			bs_record.FirstStaticMesh = BinaryWriter->StaticMeshBodies.Num();
+			bs_record.NumStaticMesh = 0;
+			bs_record.FirstInstanced = BinaryWriter->InstancedBodies.Num();
+			bs_record.NumInstanced = static_cast<uint32>(bs_data.instanced_static_mesh.size());
+		}
+
+		if (bs_data.CollisionLOD)
+		{
+			const SaveCollisionLODData& LOD = *bs_data.CollisionLOD;
+			JsonWriter->WriteObjectStart(TEXT("CollisionLOD"));
+			JsonWriter->WriteValue(TEXT("Type"), static_cast<int32>(LOD.Type));
+			JsonWriter->WriteValue(TEXT("Center"), LOD.Center.ToString());
+			JsonWriter->WriteValue(TEXT("Extent"), LOD.Extent.ToString());
+			if (LOD.Vertices.Num() > 0)
+			{
+				JsonWriter->WriteRawJSONValue(TEXT("Vertices"), TEXT("[") + FormatFloats(&LOD.Vertices[0].X, LOD.Vertices.Num() * 3) + TEXT("]"));
+			}
+			JsonWriter->WriteObjectEnd();
+
+			if (BinaryWriter)
+			{
+				ChaosScene::CollisionLODRecord& lod_record = BinaryWriter->CollisionLODs.AddZeroed_GetRef();
+				lod_record.BodySetup = BodySetupIndex;
+				lod_record.Type = static_cast<uint8>(LOD.Type);
+				lod_record.Center[0] = static_cast<float>(LOD.Center.X);
+				lod_record.Center[1] = static_cast<float>(LOD.Center.Y);
+				lod_record.Center[2] = static_cast<float>(LOD.Center.Z);
+				lod_record.Extent[0] = static_cast<float>(LOD.Extent.X);
+				lod_record.Extent[1] = static_cast<float>(LOD.Extent.Y);
+				lod_record.Extent[2] = static_cast<float>(LOD.Extent.Z);
+				lod_record.FirstVertex = BinaryWriter->CollisionLODVertices.Num();
+				lod_record.NumVertices = LOD.Vertices.Num();
+				for (const FVector3f& Vertex : LOD.Vertices)
+				{
+					BinaryWriter->CollisionLODVertices.Add({ { Vertex.X, Vertex.Y, Vertex.Z } });
+				}
+			}
+		}
+
+		//static mesh, the merged bodies are written with their aggregate
+		uint32 NumStaticMesh = 0;
+		for (const auto& data : bs_data.static_mesh)
+		{
+			const FFormattedBody& Formatted = BodyFormatQueue.Next();
+			if (Aggregates && Aggregates->Bodies.Contains(&data))
+				continue;
+
+			if (NumStaticMesh++ == 0)
+			{
+				JsonWriter->WriteArrayStart(TEXT("StaticMesh"));
+			}
+			JsonWriter->WriteObjectStart();
+			WriteBodyInstanceJson(JsonWriter, data, Formatted.Transform);
+			JsonWriter->WriteObjectEnd();
+
+			if (BinaryWriter)
+			{
+				BinaryWriter->StaticMeshBodies.Add(MakeBodyRecord(*BinaryWriter, BodySetupIndex, data));
+				BinaryWriter->BodySetups[BodySetupIndex].NumStaticMesh = NumStaticMesh;
+			}
+		}
+		if (NumStaticMesh > 0)
+		{
+			JsonWriter->WriteArrayEnd();
+		}
+
+		//static mesh instance
+		if (!bs_data.instanced_static_mesh.empty())
+		{
+			JsonWriter->WriteArrayStart(TEXT("StaticMeshInstance"));
+			for (const auto& data : bs_data.instanced_static_mesh)
+			{
+				const FFormattedBody& Formatted = BodyFormatQueue.Next();
+				JsonWriter->WriteObjectStart();
+				WriteBodyInstanceJson(JsonWriter, data, Formatted.Transform);
+
+				if (Options.InstanceEncoding == EInstanceEncoding::Objects)
+				{
+					JsonWriter->WriteArrayStart(TEXT("InstancesTM"));
+					for (const FString& inst_Transform : Formatted.Instances)
+					{
+						JsonWriter->WriteObjectStart();
+						JsonWriter->WriteValue(TEXT("Transform"), inst_Transform);
+						JsonWriter->WriteObjectEnd();
+					}
+					JsonWriter->WriteArrayEnd();
+				}
+				else
+				{
+					// contiguous per component, so a reader can copy the whole block at once
+					JsonWriter->WriteValue(TEXT("InstanceCount"), Formatted.PackedInstances.Num());
+					if (Options.InstanceEncoding == EInstanceEncoding::PackedFloats)
+					{
+						JsonWriter->WriteArrayStart(TEXT("InstancesPacked"));
+						for (const FString& inst_Floats : Formatted.Instances)
+						{
+							JsonWriter->WriteRawJSONValue(inst_Floats);
+						}
+						JsonWriter->WriteArrayEnd();
+					}
+					else if (Options.InstanceEncoding == EInstanceEncoding::Base64)
+					{
+						JsonWriter->WriteValue(TEXT("InstancesBase64"), Formatted.InstancesBase64);
+					}
+					else
+					{
+						JsonWriter->WriteArrayStart(TEXT("InstancesQuantized"));
+						for (int32 c = 0; c < Formatted.QuantizedChunks.Num(); ++c)
+						{
+							const ChaosScene::QuantizedInstanceChunk& Chunk = Formatted.QuantizedChunks[c];
+							JsonWriter->WriteObjectStart();
+							JsonWriter->WriteValue(TEXT("FirstInstance"), static_cast<int64>(Chunk.FirstInstance));
+							JsonWriter->WriteValue(TEXT("NumInstances"), static_cast<int64>(Chunk.NumInstances));
+							JsonWriter->WriteRawJSONValue(TEXT("Origin"), TEXT("[") + FormatFloats(Chunk.Origin, 3) + TEXT("]"));
+							JsonWriter->WriteRawJSONValue(TEXT("Step"), FormatFloats(&Chunk.Step, 1));
+							JsonWriter->WriteValue(TEXT("PositionBits"), static_cast<int32>(Chunk.PositionBits));
+							JsonWriter->WriteValue(TEXT("ScaleMode"), static_cast<int32>(Chunk.ScaleMode));
+							JsonWriter->WriteRawJSONValue(TEXT("ConstantScale"), TEXT("[") + FormatFloats(Chunk.ConstantScale, 3) + TEXT("]"));
+							JsonWriter->WriteValue(TEXT("Codec"), static_cast<int32>(Chunk.Codec));
+							JsonWriter->WriteValue(TEXT("RawSize"), static_cast<int64>(Chunk.RawSize));
+							JsonWriter->WriteValue(TEXT("Data"), Formatted.QuantizedBase64[c]);
+							JsonWriter->WriteObjectEnd();
+						}
+						JsonWriter->WriteArrayEnd();
+					}
+				}
+				JsonWriter->WriteObjectEnd();
+
+				if (BinaryWriter)
+				{
+					ChaosScene::InstancedBodyRecord& ism_record = BinaryWriter->InstancedBodies.AddDefaulted_GetRef();
+					ism_record.Body = MakeBodyRecord(*BinaryWriter, BodySetupIndex, data);
+					ism_record.FirstInstance = BinaryWriter->AddInstances(Formatted.PackedInstances, Formatted.QuantizedChunks, Formatted.QuantizedData);
+					ism_record.NumInstances = Formatted.PackedInstances.Num();
+				}
+			}
+			JsonWriter->WriteArrayEnd();
+		}
+
+		JsonWriter->WriteObjectEnd();
+
+
+	}
+	JsonWriter->WriteArrayEnd();
+
+	// one particle each, its shapes reference the BodySetups above by index
+	if (Aggregates)
+	{
+		JsonWriter->WriteArrayStart(TEXT("StaticAggregates"));
+		for (const FStaticAggregate& Aggregate : Aggregates->Aggregates)
+		{
+			JsonWriter->WriteObjectStart();
+			JsonWriter->WriteValue(TEXT("CellX"), Aggregate.Cell.X);
+			JsonWriter->WriteValue(TEXT("CellY"), Aggregate.Cell.Y);
+			JsonWriter->WriteValue(TEXT("CellZ"), Aggregate.Cell.Z);
+			JsonWriter->WriteValue(TEXT("Transform"), Aggregate.Transform.ToString());
+			if (BinaryWriter)
+			{
+				ChaosScene::StaticAggregateRecord& agg_record = BinaryWriter->StaticAggregates.AddDefaulted_GetRef();
+				agg_record.Cell[0] = Aggregate.Cell.X;
+				agg_record.Cell[1] = Aggregate.Cell.Y;
+				agg_record.Cell[2] = Aggregate.Cell.Z;
+				agg_record.Transform = ToPackedTransform(Aggregate.Transform);
+				agg_record.FirstShape = BinaryWriter->AggregateShapes.Num();
+				agg_record.NumShapes = Aggregate.Shapes.Num();
+			}
+
+			JsonWriter->WriteArrayStart(TEXT("Shapes"));
+			for (const auto& [BodySetupIndex, data] : Aggregate.Shapes)
+			{
+				const FTransform LocalTransform = GetAggregateShapeTransform(Aggregate, *data);
+				JsonWriter->WriteObjectStart();
+				JsonWriter->WriteValue(TEXT("BodySetup"), BodySetupIndex);
+				WriteBodyInstanceJson(JsonWriter, *data, LocalTransform.ToString());
+				JsonWriter->WriteObjectEnd();
+
+				if (BinaryWriter)
+				{
+					ChaosScene::BodyRecord& shape_record = BinaryWriter->AggregateShapes.Add_GetRef(MakeBodyRecord(*BinaryWriter, BodySetupIndex, *data));
+					shape_record.Transform = ToPackedTransform(LocalTransform);
+				}
+			}
+			JsonWriter->WriteArrayEnd();
+			JsonWriter->WriteObjectEnd();
+		}
+		JsonWriter->WriteArrayEnd();
+	}
+
+	// the profile reflection dominates, it is only done once per distinct profile, up front on every core
+	const int32 NumConstraints = static_cast<int32>(Snapshot.ConstraintDataSet.size());
+	TArray<int32> ConstraintProfileIndices;
+	TArray<const FConstraintProfileProperties*> UniqueProfiles;
+	InternConstraintProfiles(Snapshot, ConstraintProfileIndices, UniqueProfiles);
+	TArray<FString> ConstraintTransforms;
+	TArray<TSharedPtr<FJsonObject>> ConstraintProfiles;
+	ConstraintTransforms.SetNum(NumConstraints);
+	ConstraintProfiles.SetNum(UniqueProfiles.Num());
+	const EParallelForFlags ParallelForFlags = Options.bParallelSerialize ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread;
+	ParallelFor(NumConstraints, [&Snapshot, &ConstraintTransforms](int32 i)
+	{
+		ConstraintTransforms[i] = Snapshot.ConstraintDataSet[i].Transform.ToString();
+	}, ParallelForFlags);
+	ParallelFor(UniqueProfiles.Num(), [&UniqueProfiles, &ConstraintProfiles](int32 i)
+	{
+		TSharedRef<FJsonObject> JsonConstraintProfile = MakeShared<FJsonObject>();
+		if (FJsonObjectConverter::UStructToJsonObject(FConstraintProfileProperties::StaticStruct(), UniqueProfiles[i], JsonConstraintProfile, 0, 0))
+		{
+			ConstraintProfiles[i] = JsonConstraintProfile;
+		}
+	}, ParallelForFlags);
+
+	// the constraints reference these by index, a profile that could not be converted is null
+	JsonWriter->WriteArrayStart(TEXT("ConstraintProfiles"));
+	for (const TSharedPtr<FJsonObject>& JsonConstraintProfile : ConstraintProfiles)
+	{
+		if (JsonConstraintProfile.IsValid())
+		{
+			FJsonSerializer::Serialize(MakeShared<FJsonValueObject>(JsonConstraintProfile), FString(), JsonWriter, false);
+		}
+		else
+		{
+			JsonWriter->WriteNull();
+		}
+
+		if (BinaryWriter)
+		{
+			BinaryWriter->ConstraintProfiles.Add(JsonConstraintProfile.IsValid() ? BinaryWriter->AddString(JsonObjToCondensedJsonStr(JsonConstraintProfile)) : 0);
+		}
+	}
+	JsonWriter->WriteArrayEnd();
+
+	JsonWriter->WriteArrayStart(TEXT("Constraints"));
+	for (int32 i = 0; i < NumConstraints; ++i)
+	{
+		const auto& data = Snapshot.ConstraintDataSet[i];
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("OwnerID"), static_cast<int64>(data.OwnerID));
+		JsonWriter->WriteValue(TEXT("CompID"), static_cast<int64>(data.CompID));
+		JsonWriter->WriteValue(TEXT("ActorID1"), static_cast<int64>(data.ActorID1));
+		JsonWriter->WriteValue(TEXT("ActorID2"), static_cast<int64>(data.ActorID2));
+		JsonWriter->WriteValue(TEXT("Transform"), ConstraintTransforms[i]);
+
+		const int32 ProfileIndex = ConstraintProfileIndices[i];
+		const bool bProfileValid = ConstraintProfiles[ProfileIndex].IsValid();
+		if (bProfileValid)
+		{
+			JsonWriter->WriteValue(TEXT("Profile"), ProfileIndex);
+		}
+		JsonWriter->WriteObjectEnd();
+
+		if (BinaryWriter)
+		{
+			ChaosScene::ConstraintRecord& cs_record = BinaryWriter->Constraints.AddDefaulted_GetRef();
+			cs_record.OwnerID = data.OwnerID;
+			cs_record.CompID = data.CompID;
+			cs_record.ActorID1 = data.ActorID1;
+			cs_record.ActorID2 = data.ActorID2;
+			cs_record.Transform = ToPackedTransform(data.Transform);
+			cs_record.Profile = bProfileValid ? static_cast<uint32>(ProfileIndex) : ChaosScene::InvalidIndex;
+		}
+	}
+	JsonWriter->WriteArrayEnd();
+
+	if (Islands)
+	{
+		JsonWriter->WriteArrayStart(TEXT("ConstraintIslands"));
+		for (const FConstraintIsland& Island : *Islands)
+		{
+			JsonWriter->WriteObjectStart();
+			JsonWriter->WriteArrayStart(TEXT("Bodies"));
+			for (const uint32 ActorID : Island.Bodies)
+			{
+				JsonWriter->WriteValue(static_cast<int64>(ActorID));
+			}
+			JsonWriter->WriteArrayEnd();
+			JsonWriter->WriteArrayStart(TEXT("Constraints"));
+			for (const int32 c : Island.Constraints)
+			{
+				JsonWriter->WriteValue(c);
+			}
+			JsonWriter->WriteArrayEnd();
+			JsonWriter->WriteObjectEnd();
+
+			if (BinaryWriter)
+			{
+				ChaosScene::ConstraintIslandRecord& island_record = BinaryWriter->ConstraintIslands.AddDefaulted_GetRef();
+				island_record.FirstBody = BinaryWriter->IslandBodies.Num();
+				island_record.NumBodies = Island.Bodies.Num();
+				island_record.FirstConstraint = BinaryWriter->IslandConstraints.Num();
+				island_record.NumConstraints = Island.Constraints.Num();
+				BinaryWriter->IslandBodies.Append(Island.Bodies);
+				for (const int32 c : Island.Constraints)
+				{
+					BinaryWriter->IslandConstraints.Add(static_cast<uint32>(c));
+				}
+			}
+		}
+		JsonWriter->WriteArrayEnd();
+	}
+
+	JsonWriter->WriteArrayStart(TEXT("PhysicFields"));
+	for (const auto& data : Snapshot.PhysicFieldDataSet)
+	{
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("OwnerID"), static_cast<int64>(data.OwnerID));
+		JsonWriter->WriteValue(TEXT("CompID"), static_cast<int64>(data.CompID));
+		JsonWriter->WriteValue(TEXT("Enable"), data.bEnable);
+		JsonWriter->WriteValue(TEXT("PhysicFieldType"), static_cast<int32>(data.FieldType));
+
+		JsonWriter->WriteValue(TEXT("Transform"), data.Transform.ToString());
+		JsonWriter->WriteValue(TEXT("Direction"), data.Direction.ToString());
+		JsonWriter->WriteValue(TEXT("Magnitude"), static_cast<double>(data.Magnitude));
+		JsonWriter->WriteObjectEnd();
+
+		if (BinaryWriter)
+		{
+			ChaosScene::PhysicFieldRecord& pf_record = BinaryWriter->PhysicFields.AddZeroed_GetRef();
+			pf_record.OwnerID = data.OwnerID;
+			pf_record.CompID = data.CompID;
+			pf_record.Transform = ToPackedTransform(data.Transform);
+			pf_record.Direction[0] = static_cast<float>(data.Direction.X);
+			pf_record.Direction[1] = static_cast<float>(data.Direction.Y);
+			pf_record.Direction[2] = static_cast<float>(data.Direction.Z);
+			pf_record.Magnitude = data.Magnitude;
+			pf_record.Enable = data.bEnable ? 1 : 0;
+			pf_record.FieldType = data.FieldType;
+		}
+	}
+	JsonWriter->WriteArrayEnd();
+
+	JsonWriter->WriteArrayStart(TEXT("Landscapes"));
+	for (const auto& land_data : Snapshot.LandscapeDataSet)
+	{
+		JsonWriter->WriteObjectStart();
+		JsonWriter->WriteValue(TEXT("LandID"), static_cast<int64>(land_data.LandID));
+		JsonWriter->WriteValue(TEXT("LandGuid"), land_data.LandGuid.ToString());
+		JsonWriter->WriteValue(TEXT("LandscapeSectionOffsetX"), land_data.LandscapeSectionOffset.X);
+		JsonWriter->WriteValue(TEXT("LandscapeSectionOffsetY"), land_data.LandscapeSectionOffset.Y);
+		JsonWriter->WriteValue(TEXT("ActorToWorld"), land_data.ActorToWorld.ToString());
+		JsonWriter->WriteValue(TEXT("LandscapeActorToWorld"), land_data.LandscapeActorToWorld.ToString());
+		if (land_data.bArchive)
+		{
+			JsonWriter->WriteValue(TEXT("Archive"), GetLandscapeArchiveName(land_data.LandGuid));
+		}
+		if (land_data.bHeights)
+		{
+			JsonWriter->WriteValue(TEXT("Heights"), GetLandscapeHeightsName(land_data.LandGuid));
+		}
+
+		ChaosScene::LandscapeRecord* land_record = nullptr;
+		if (BinaryWriter)
+		{
+			land_record = &BinaryWriter->Landscapes.AddDefaulted_GetRef();
+			land_record->LandID = land_data.LandID;
+			CopyGuid(land_data.LandGuid, land_record->LandGuid);
+			land_record->LandscapeSectionOffsetX = land_data.LandscapeSectionOffset.X;
+			land_record->LandscapeSectionOffsetY = land_data.LandscapeSectionOffset.Y;
+			land_record->ActorToWorld = ToPackedTransform(land_data.ActorToWorld);
+			land_record->LandscapeActorToWorld = ToPackedTransform(land_data.LandscapeActorToWorld);
+			land_record->FirstCollision = BinaryWriter->LandscapeCollisions.Num();
+			land_record->NumCollisions = 0;
+		}
+
+		JsonWriter->WriteArrayStart(TEXT("collions"));
+		for (const auto& coll_data : land_data.collisions)
+		{
+			if (!coll_data.bExported)
+				continue;
+
+			JsonWriter->WriteObjectStart();
+			JsonWriter->WriteValue(TEXT("OwnerID"), static_cast<int64>(coll_data.OwnerID));
+			JsonWriter->WriteValue(TEXT("CompID"), static_cast<int64>(coll_data.CompID));
+			JsonWriter->WriteValue(TEXT("Package"), coll_data.Package);
+			JsonWriter->WriteValue(TEXT("SectionBaseX"), coll_data.SectionBaseX);
+			JsonWriter->WriteValue(TEXT("SectionBaseY"), coll_data.SectionBaseY);
+			JsonWriter->WriteValue(TEXT("SimpleCollisionSizeQuads"), coll_data.SimpleCollisionSizeQuads);
+			JsonWriter->WriteValue(TEXT("CollisionScale"), static_cast<double>(coll_data.CollisionScale));
+			JsonWriter->WriteValue(TEXT("CollisionSizeQuads"), coll_data.CollisionSizeQuads);
+			JsonWriter->WriteValue(TEXT("HeightfieldGuid"), coll_data.HeightfieldGuid.ToString());
+			JsonWriter->WriteValue(TEXT("Transform"), coll_data.Transform.ToString());
+			JsonWriter->WriteObjectEnd();
+
+			if (BinaryWriter)
+			{
+				ChaosScene::LandscapeCollisionRecord& coll_record = BinaryWriter->LandscapeCollisions.AddDefaulted_GetRef();
+				coll_record.OwnerID = coll_data.OwnerID;
+				coll_record.CompID = coll_data.CompID;
+				coll_record.Package = BinaryWriter->AddString(coll_data.Package);
+				coll_record.SectionBaseX = coll_data.SectionBaseX;
+				coll_record.SectionBaseY = coll_data.SectionBaseY;
+				coll_record.SimpleCollisionSizeQuads = coll_data.SimpleCollisionSizeQuads;
+				coll_record.CollisionSizeQuads = coll_data.CollisionSizeQuads;
+				coll_record.CollisionScale = coll_data.CollisionScale;
+				CopyGuid(coll_data.HeightfieldGuid, coll_record.HeightfieldGuid);
+				coll_record.Transform = ToPackedTransform(coll_data.Transform);
+				land_record->NumCollisions++;
+			}
+		}
+		JsonWriter->WriteArrayEnd();
+		JsonWriter->WriteObjectEnd();
+	}
+	JsonWriter->WriteArrayEnd();
+
+	JsonWriter->WriteValue(TEXT("MapName"), Snapshot.MapName);
+	if (Snapshot.State != 0)
+	{
+		JsonWriter->WriteValue(TEXT("State"), FString::Printf(TEXT("%016llx"), Snapshot.State));
+	}
+	if (Snapshot.Delta.IsValid())
+	{
+		JsonWriter->WriteValue(TEXT("BaseState"), FString::Printf(TEXT("%016llx"), Snapshot.Delta->BaseState));
+		JsonWriter->WriteObjectStart(TEXT("Removed"));
+		for (const auto& [SectionName, Keys] : Snapshot.Delta->Removed)
+		{
+			JsonWriter->WriteArrayStart(SectionName);
+			for (const FString& Key : Keys)
+			{
+				JsonWriter->WriteValue(Key);
+			}
+			JsonWriter->WriteArrayEnd();
+		}
+		JsonWriter->WriteObjectEnd();
+	}
+	JsonWriter->WriteObjectEnd();
+	JsonWriter->Close();
+
+	//保存json
+	const bool bJsonWritten = JsonFileAr->Close();
+	JsonFileAr.Reset();
+	if (Progress.IsCancelled() || !bJsonWritten || !IFileManager::Get().Move(*JsonFilePath, *JsonTempFilePath, true))
+	{
+		if (!Progress.IsCancelled())
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to save PhysicScene %s"), *JsonFilePath);
+		}
+		IFileManager::Get().Delete(*JsonTempFilePath);
+		return false;
+	}
+	return true;
+}
+
+struct FCookShard
+{
+	int32 Index = 0;
+	TArray<FString> Packages;
+	FProcHandle Handle;
+	void* PipeRead = nullptr;
+	void* PipeWrite = nullptr;
+	TArray<uint8> Output;
+	int32 ExitCode = -1;
+	int32 Attempts = 0;
+	bool bRunning = false;
+	double StartTime = 0.0;
+};
+
+bool LaunchCookShard(FCookShard& Shard)
+{
+	FString PackageAllName = FString::JoinBy(Shard.Packages, TEXT("+"), [](auto v) {return "/Game/Physic/" + v; });
+
+	const FString EditorBinary = FPlatformProcess::ExecutablePath();
+	const FString Project = FPaths::SetExtension(FPaths::Combine(FPaths::ProjectDir(), FApp::GetProjectName()), ".uproject");
+	const FString CmdParams = "\"" + Project + "\"" + " -run=Cook  -TargetPlatform=LinuxServer -iterate -ddc=DerivedDataBackendGraph -unversioned -fileopenlog -stdout -CrashForUAT -unattended -NoLogTimes  -UTF8Output -cooksinglepackagenorefs -NoGameAlwaysCook -PACKAGE=" + PackageAllName;
+	UE_LOG(LogTemp, Warning, TEXT("RUN CMD(shard %d attempt %d):%s %s"), Shard.Index, Shard.Attempts + 1, *EditorBinary, *CmdParams);
+
+	verify(FPlatformProcess::CreatePipe(Shard.PipeRead, Shard.PipeWrite));
+
+	Shard.Attempts++;
+	Shard.Output.Reset();
+	Shard.ExitCode = -1;
+	Shard.StartTime = FPlatformTime::Seconds();
+	Shard.Handle = FPlatformProcess::CreateProc(*EditorBinary, *CmdParams, false, false, false, nullptr, 0, nullptr, Shard.PipeWrite, nullptr);
+	Shard.bRunning = Shard.Handle.IsValid();
+	if (!Shard.bRunning)
+	{
+		UE_LOG(LogTemp, Error, TEXT("cook shard %d: failed to launch %s"), Shard.Index, *EditorBinary);
+		FPlatformProcess::ClosePipe(Shard.PipeRead, Shard.PipeWrite);
+		Shard.PipeRead = Shard.PipeWrite = nullptr;
+	}
+	return Shard.bRunning;
+}
+
+void ReadCookShardPipe(FCookShard& Shard)
+{
+	TArray<uint8> BinaryData;
+	FPlatformProcess::ReadPipeToArray(Shard.PipeRead, BinaryData);
+	if (BinaryData.Num() > 0)
+	{
+		Shard.Output.Append(MoveTemp(BinaryData));
+	}
+}
+
+void FinishCookShard(FCookShard& Shard)
+{
+	ReadCookShardPipe(Shard);
+	Shard.Output.Add(0);
+
+	int32 ExitCode = 0xffffffff;
+	FPlatformProcess::GetProcReturnCode(Shard.Handle, &ExitCode);
+	FPlatformProcess::CloseProc(Shard.Handle);
+	FPlatformProcess::ClosePipe(Shard.PipeRead, Shard.PipeWrite);
+	Shard.PipeRead = Shard.PipeWrite = nullptr;
+	Shard.ExitCode = ExitCode;
+	Shard.bRunning = false;
+
+	const double Seconds = FPlatformTime::Seconds() - Shard.StartTime;
+	if (ExitCode == 0)
+	{
+		UE_LOG(LogTemp, Log, TEXT("cook shard %d: %d packages in %.2fs\n%s"), Shard.Index, Shard.Packages.Num(), Seconds, ANSI_TO_TCHAR((char*)Shard.Output.GetData()));
+	}
+	else
+	{
+		UE_LOG(LogTemp, Error, TEXT("cook shard %d: exit code: %d after %.2fs\n%s"), Shard.Index, ExitCode, Seconds, ANSI_TO_TCHAR((char*)Shard.Output.GetData()));
+	}
+}
+
+// how long the cook loop sleeps between two polls of the shard pipes
+constexpr float COOK_POLL_INTERVAL = 0.1f;
+
+// Cooks /Game/Physic/<Package> for LinuxServer, split over several concurrent cook commandlets.
+// Failed shards are relaunched up to Options.CookRetries times, the .uasset of every cooked package is deleted afterwards.
+// Cancelling the export terminates the running shards, their packages are reported as failed.
+bool CookPhysicPackages(const TArray<FString>& PackageNameArray, const FExportChaosOptions& Options, FExportChaosProgress& Progress, TArray<FString>& OutFailedPackages)
+{
+	if (PackageNameArray.Num() == 0)
+		return true;
+
+	const double CookStartTime = FPlatformTime::Seconds();
+
+	int32 NumShards = Options.CookShards;
+	if (NumShards <= 0)
+	{
+		NumShards = FPlatformMisc::NumberOfCores();
+	}
+	NumShards = FMath::Clamp(NumShards, 1, PackageNameArray.Num());
+	const int32 MaxAttempts = 1 + FMath::Max(0, Options.CookRetries);
+
+	TArray<FCookShard> Shards;
+	Shards.SetNum(NumShards);
+	for (int32 i = 0; i < NumShards; ++i)
+	{
+		Shards[i].Index = i;
+	}
+	for (int32 i = 0; i < PackageNameArray.Num(); ++i)
+	{
+		Shards[i % NumShards].Packages.Add(PackageNameArray[i]);
+	}
+
+	for (FCookShard& Shard : Shards)
+	{
+		LaunchCookShard(Shard);
+	}
+
+	int32 NumFinishedShards = 0;
+	bool bAnyRunning = true;
+	while (bAnyRunning)
+	{
+		// the pipes are drained every poll so a chatty cook never blocks on a full pipe
+		Progress.Wait(COOK_POLL_INTERVAL);
+		const bool bCancelled = Progress.IsCancelled();
+
+		bAnyRunning = false;
+		for (FCookShard& Shard : Shards)
+		{
+			if (!Shard.bRunning)
+				continue;
+
+			ReadCookShardPipe(Shard);
+			if (bCancelled)
+			{
+				FPlatformProcess::TerminateProc(Shard.Handle, true);
+				FPlatformProcess::WaitForProc(Shard.Handle);
+			}
+			else if (FPlatformProcess::IsProcRunning(Shard.Handle))
+			{
+				bAnyRunning = true;
+				continue;
+			}
+
+			FinishCookShard(Shard);
+			if (bCancelled)
+			{
+				Shard.ExitCode = -1;
+			}
+			else if (Shard.ExitCode != 0 && Shard.Attempts < MaxAttempts)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("cook shard %d: retrying (%d/%d)"), Shard.Index, Shard.Attempts + 1, MaxAttempts);
+				if (LaunchCookShard(Shard))
+				{
+					bAnyRunning = true;
+					continue;
+				}
+			}
+
+			NumFinishedShards++;
+			Progress.Report(FText::Format(LOCTEXT("ExportChaosCooking", "Cooking {0} physics packages ({1}/{2} shards done)..."),
+				PackageNameArray.Num(), NumFinishedShards, NumShards));
+		}
+	}
+
+	int32 NumFailedShards = 0;
+	for (const FCookShard& Shard : Shards)
+	{
+		if (Shard.ExitCode != 0)
+		{
+			NumFailedShards++;
+			OutFailedPackages.Append(Shard.Packages);
+			continue;
+		}
+
+		for (const auto& PackageName : Shard.Packages)
+		{
+			FString PackageFileName = FPaths::ProjectContentDir() / "Physic" / PackageName + ".uasset";
+			if (IFileManager::Get().FileExists(*PackageFileName))
+			{
+				IFileManager::Get().Delete(*PackageFileName);
+			}
+		}
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("cook: %d packages in %d shards, %d failed, %.2fs"), PackageNameArray.Num(), NumShards, NumFailedShards, FPlatformTime::Seconds() - CookStartTime);
+	return NumFailedShards == 0;
+}
+
+// Json scene plus its binary and BVH when enabled, for the whole map or for one grid cell (without Islands).
+bool WriteSceneFiles(const FPhysicSceneSnapshot& Snapshot, const TArray<FConstraintIsland>* Islands, const FExportChaosOptions& Options, const FString& JsonFilePath, FExportChaosProgress& Progress)
+{
+	FExportChaosStats& Stats = Progress.GetStats();
+	TUniquePtr<FChaosSceneBinaryWriter> BinaryWriter;
+	if (Options.bBinaryScene || Options.bStaticBVH)
+	{
+		BinaryWriter = MakeUnique<FChaosSceneBinaryWriter>();
+	}
+	TUniquePtr<FStaticAggregates> Aggregates;
+	if (Options.StaticAggregateCellSize > 0.0f)
+	{
+		EXPORT_CHAOS_PHASE(Stats, "Write.StaticAggregates");
+		Aggregates = MakeUnique<FStaticAggregates>(BuildStaticAggregates(Snapshot, Options.StaticAggregateCellSize));
+		Stats.Add(TEXT("Write.StaticAggregates"), Aggregates->Bodies.Num());
+	}
+	{
+		EXPORT_CHAOS_PHASE(Stats, "Write.SceneJson");
+		if (!WritePhysicSceneJson(Snapshot, Options, JsonFilePath, BinaryWriter.Get(), Aggregates.Get(), Islands, Progress))
+			return false;
+		Stats.Add(TEXT("Write.SceneJson"), 1, IFileManager::Get().FileSize(*JsonFilePath));
+	}
+
+	if (BinaryWriter)
+	{
+		if (Options.bStaticBVH)
+		{
+			EXPORT_CHAOS_PHASE(Stats, "Write.StaticBVH");
+			BuildStaticBVH(Snapshot, Aggregates.Get(), *BinaryWriter);
+		}
+
+		EXPORT_CHAOS_PHASE(Stats, "Write.SceneBinary");
+		FString BinaryFilePath = FPaths::ChangeExtension(JsonFilePath, ".pscene");
+		if (!BinaryWriter->SaveToFile(BinaryFilePath))
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to save binary PhysicScene %s"), *BinaryFilePath);
+			return false;
+		}
+		Stats.Add(TEXT("Write.SceneBinary"), 1, IFileManager::Get().FileSize(*BinaryFilePath));
+	}
+	return true;
+}
+
+// One cell of a grid partitioned export, a snapshot that only holds what lies inside the cell.
+struct FGridCell
+{
+	FPhysicSceneSnapshot Snapshot;
+	int32 LastBodySetup = INDEX_NONE;		// source index of Snapshot.BodySetupDataSet.back()
+	const SaveBodyData* LastInstanced = nullptr;	// source of its instanced_static_mesh.back()
+	int32 LastLandscape = INDEX_NONE;		// source index of Snapshot.LandscapeDataSet.back()
+	int32 NumInstances = 0;
+};
+
+FIntPoint GetGridCell(const FVector& Location, float CellSize)
+{
+	return FIntPoint(FMath::FloorToInt32(Location.X / CellSize), FMath::FloorToInt32(Location.Y / CellSize));
+}
+
+// everything but the bodies
+SaveBodySetupData CopyBodySetupHeader(const SaveBodySetupData& bs_data)
+{
+	SaveBodySetupData Header;
+	Header.Package = bs_data.Package;
+	Header.Name = bs_data.Name;
+	Header.Path = bs_data.Path;
+	Header.Guid = bs_data.Guid;
+	Header.LocalBounds = bs_data.LocalBounds;
+	Header.Hash = bs_data.Hash;
+	Header.bCook = bs_data.bCook;
+	Header.bSaveFailed = bs_data.bSaveFailed;
+	Header.CollisionLOD = bs_data.CollisionLOD;
+	return Header;
+}
+
+// everything but the instances
+SaveBodyData CopyBodyHeader(const SaveBodyData& data)
+{
+	SaveBodyData Header;
+	Header.ActorID = data.ActorID;
+	Header.CompID = data.CompID;
+	Header.Name = data.Name;
+	Header.Transform = data.Transform;
+	Header.bSimulatePhysics = data.bSimulatePhysics;
+	Header.bEnableGravity = data.bEnableGravity;
+	Header.bStartAwake = data.bStartAwake;
+	Header.bMovable = data.bMovable;
+	Header.Overrides = data.Overrides;
+	return Header;
+}
+
+// everything but the collisions
+SaveLandscapeData CopyLandscapeHeader(const SaveLandscapeData& land_data)
+{
+	SaveLandscapeData Header;
+	Header.LandID = land_data.LandID;
+	Header.LandGuid = land_data.LandGuid;
+	Header.LandscapeSectionOffset = land_data.LandscapeSectionOffset;
+	Header.ActorToWorld = land_data.ActorToWorld;
+	Header.LandscapeActorToWorld = land_data.LandscapeActorToWorld;
+	Header.bArchive = land_data.bArchive;
+	Header.bHeights = land_data.bHeights;
+	Header.ArchiveHash = land_data.ArchiveHash;
+	Header.HeightsHash = land_data.HeightsHash;
+	return Header;
+}
+
+// Splits the snapshot over an XY grid, each record goes to the cell of its world location. The instances
+// of an ISM are split one by one, so the ISM shows up in every cell holding one of them, with that subset.
+// Landscape tiles go by their center; the .ldata/.lheight files stay per landscape and are shared by the cells.
+TMap<FIntPoint, FGridCell> PartitionSnapshot(const FPhysicSceneSnapshot& Snapshot, float CellSize)
+{
+	TMap<FIntPoint, FGridCell> Cells;
+	// the returned cell is only valid until the next call, adding a cell may move the others
+	auto GetCell = [&](const FVector& Location) -> FGridCell&
+	{
+		const FIntPoint Key = GetGridCell(Location, CellSize);
+		FGridCell* Cell = Cells.Find(Key);
+		if (Cell == nullptr)
+		{
+			Cell = &Cells.Add(Key);
+			Cell->Snapshot.MapName = Snapshot.MapName;
+			Cell->Snapshot.State = Snapshot.State;
+		}
+		return *Cell;
+	};
+	auto GetCellBodySetup = [&](FGridCell& Cell, int32 BodySetupIndex) -> SaveBodySetupData&
+	{
+		if (Cell.LastBodySetup != BodySetupIndex)
+		{
+			Cell.LastBodySetup = BodySetupIndex;
+			Cell.LastInstanced = nullptr;
+			Cell.Snapshot.BodySetupDataSet.push_back(CopyBodySetupHeader(Snapshot.BodySetupDataSet[BodySetupIndex]));
+		}
+		return Cell.Snapshot.BodySetupDataSet.back();
+	};
+
+	for (int32 i = 0; i < (int32)Snapshot.BodySetupDataSet.size(); ++i)
+	{
+		const auto& bs_data = Snapshot.BodySetupDataSet[i];
+		for (const auto& data : bs_data.static_mesh)
+		{
+			FGridCell& Cell = GetCell(data.Transform.GetLocation());
+			GetCellBodySetup(Cell, i).static_mesh.push_back(data);
+		}
+		for (const auto& data : bs_data.instanced_static_mesh)
+		{
+			if (data.Instances.Num() == 0)
+			{
+				FGridCell& Cell = GetCell(data.Transform.GetLocation());
+				GetCellBodySetup(Cell, i).instanced_static_mesh.push_back(CopyBodyHeader(data));
+				Cell.LastInstanced = &data;
+				continue;
+			}
+			for (const FTransform& InstanceTransform : data.Instances)
+			{
+				FGridCell& Cell = GetCell(InstanceTransform.GetLocation());
+				SaveBodySetupData& cell_bs = GetCellBodySetup(Cell, i);
+				if (Cell.LastInstanced != &data)
+				{
+					Cell.LastInstanced = &data;
+					cell_bs.instanced_static_mesh.push_back(CopyBodyHeader(data));
+				}
+				cell_bs.instanced_static_mesh.back().Instances.Add(InstanceTransform);
+				++Cell.NumInstances;
+			}
+		}
+	}
+
+	for (const auto& data : Snapshot.ConstraintDataSet)
+	{
+		GetCell(data.Location).Snapshot.ConstraintDataSet.push_back(data);
+	}
+
+	for (const auto& data : Snapshot.PhysicFieldDataSet)
+	{
+		GetCell(data.Transform.GetLocation()).Snapshot.PhysicFieldDataSet.push_back(data);
+	}
+
+	for (int32 i = 0; i < (int32)Snapshot.LandscapeDataSet.size(); ++i)
+	{
+		const auto& land_data = Snapshot.LandscapeDataSet[i];
+		for (const auto& coll_data : land_data.collisions)
+		{
+			const double HalfExtent = 0.5 * coll_data.CollisionSizeQuads * coll_data.CollisionScale;
+			FGridCell& Cell = GetCell(coll_data.Transform.TransformPosition(FVector(HalfExtent, HalfExtent, 0.0)));
+			if (Cell.LastLandscape != i)
+			{
+				Cell.LastLandscape = i;
+				Cell.Snapshot.LandscapeDataSet.push_back(CopyLandscapeHeader(land_data));
+			}
+			Cell.Snapshot.LandscapeDataSet.back().collisions.push_back(coll_data);
+		}
+	}
+	return Cells;
+}
+
+// Grid partitioned scene: one json (+ binary) per non empty cell under PhysicScene/<Map>/ and the
+// cell index PhysicScene/<Map>.cells.json, which the server reads to stream the cells in and out.
+// An island may span several cells, so the islands of the whole map go to the index instead of the cell files.
+bool WriteGridCells(const FPhysicSceneSnapshot& Snapshot, const TArray<FConstraintIsland>& Islands, const FExportChaosOptions& Options, FExportChaosProgress& Progress)
+{
+	const FString SceneDir = GetCookedContentDir() / "PhysicScene";
+	const FString CellDir = SceneDir / Snapshot.MapName;
+	// cells of the previous export may be empty by now, they must not be picked up by the server
+	IFileManager::Get().DeleteDirectory(*CellDir, false, true);
+	IFileManager::Get().MakeDirectory(*CellDir, true);
+
+	TMap<FIntPoint, FGridCell> Cells = PartitionSnapshot(Snapshot, Options.GridCellSize);
+	Cells.KeySort([](const FIntPoint& A, const FIntPoint& B) { return A.Y != B.Y ? A.Y < B.Y : A.X < B.X; });
+
+	FString IndexJson;
+	TSharedRef<TJsonWriter<>> IndexWriter = TJsonWriterFactory<>::Create(&IndexJson);
+	IndexWriter->WriteObjectStart();
+	IndexWriter->WriteValue(TEXT("MapName"), Snapshot.MapName);
+	IndexWriter->WriteValue(TEXT("CellSize"), Options.GridCellSize);
+	if (Snapshot.State != 0)
+	{
+		IndexWriter->WriteValue(TEXT("State"), FString::Printf(TEXT("%016llx"), Snapshot.State));
+	}
+	IndexWriter->WriteArrayStart(TEXT("Cells"));
+
+	int32 CellIndex = 0;
+	for (const auto& [Key, Cell] : Cells)
+	{
+		if (Progress.IsCancelled())
+			return false;
+		Progress.Report(FText::Format(LOCTEXT("ExportChaosWritingCell", "Writing the PhysicScene cell {0} / {1} of {2}..."),
+			++CellIndex, Cells.Num(), FText::FromString(Snapshot.MapName)));
+
+		const FString CellFile = FString::Printf(TEXT("cell_%d_%d.json"), Key.X, Key.Y);
+		if (!WriteSceneFiles(Cell.Snapshot, nullptr, Options, CellDir / CellFile, Progress))
+			return false;
+
+		int32 NumStaticMesh = 0;
+		int32 NumInstanced = 0;
+		for (const auto& bs_data : Cell.Snapshot.BodySetupDataSet)
+		{
+			NumStaticMesh += (int32)bs_data.static_mesh.size();
+			NumInstanced += (int32)bs_data.instanced_static_mesh.size();
+		}
+		int32 NumLandscapeTiles = 0;
+		for (const auto& land_data : Cell.Snapshot.LandscapeDataSet)
+		{
+			NumLandscapeTiles += (int32)land_data.collisions.size();
+		}
+
+		IndexWriter->WriteObjectStart();
+		IndexWriter->WriteValue(TEXT("X"), Key.X);
+		IndexWriter->WriteValue(TEXT("Y"), Key.Y);
+		IndexWriter->WriteValue(TEXT("File"), Snapshot.MapName / CellFile);
+		IndexWriter->WriteValue(TEXT("StaticMesh"), NumStaticMesh);
+		IndexWriter->WriteValue(TEXT("InstancedStaticMesh"), NumInstanced);
+		IndexWriter->WriteValue(TEXT("Instances"), Cell.NumInstances);
+		IndexWriter->WriteValue(TEXT("Constraints"), (int32)Cell.Snapshot.ConstraintDataSet.size());
+		IndexWriter->WriteValue(TEXT("PhysicFields"), (int32)Cell.Snapshot.PhysicFieldDataSet.size());
+		IndexWriter->WriteValue(TEXT("LandscapeTiles"), NumLandscapeTiles);
+		IndexWriter->WriteObjectEnd();
+	}
+	IndexWriter->WriteArrayEnd();
 
-			TSharedPtr<FJsonObject> bs_info = MakeShareable(new FJsonObject);
-			bs_info->SetStringField("Package", MeshName);
-			bs_info->SetStringField("Name", BodySetupName);
-			bs_info->SetStringField("Path", BodySetup->GetPathName());
-			bs_info->SetStringField("Guid", BodySetup->BodySetupGuid.ToString());
+	// cell and index in the cell file of each constraint, PartitionSnapshot keeps the constraints in order
+	TArray<TPair<FIntPoint, int32>> ConstraintCells;
+	TMap<FIntPoint, int32> NumCellConstraints;
+	for (const auto& data : Snapshot.ConstraintDataSet)
+	{
+		const FIntPoint Key = GetGridCell(data.Location, Options.GridCellSize);
+		ConstraintCells.Emplace(Key, NumCellConstraints.FindOrAdd(Key)++);
+	}
 
-			//static mesh
-			TArray<TSharedPtr<FJsonValue>> StaticMeshArray;
-			for (const auto& StaticMeshComponent : Data.static_mesh)
-			{
-				auto BodyInstance = StaticMeshComponent->GetBodyInstance();
+	IndexWriter->WriteArrayStart(TEXT("ConstraintIslands"));
+	for (const FConstraintIsland& Island : Islands)
+	{
+		IndexWriter->WriteObjectStart();
+		IndexWriter->WriteArrayStart(TEXT("Bodies"));
+		for (const uint32 ActorID : Island.Bodies)
+		{
+			IndexWriter->WriteValue(static_cast<int64>(ActorID));
+		}
+		IndexWriter->WriteArrayEnd();
+		IndexWriter->WriteArrayStart(TEXT("Constraints"));
+		for (const int32 c : Island.Constraints)
+		{
+			IndexWriter->WriteObjectStart();
+			IndexWriter->WriteValue(TEXT("X"), ConstraintCells[c].Key.X);
+			IndexWriter->WriteValue(TEXT("Y"), ConstraintCells[c].Key.Y);
+			IndexWriter->WriteValue(TEXT("Index"), ConstraintCells[c].Value);
+			IndexWriter->WriteObjectEnd();
+		}
+		IndexWriter->WriteArrayEnd();
+		IndexWriter->WriteObjectEnd();
+	}
+	IndexWriter->WriteArrayEnd();
+	IndexWriter->WriteObjectEnd();
+	IndexWriter->Close();
 
-				TSharedPtr<FJsonObject>  bi_info = MakeShareable(new FJsonObject);
-				bi_info->SetNumberField("ActorID", StaticMeshComponent->GetOwner()->GetUniqueID());
-				bi_info->SetNumberField("CompID", StaticMeshComponent->GetUniqueID());
-				bi_info->SetStringField("Name", StaticMeshComponent->GetOwner()->GetActorLabel(false));
-				auto Transform = BodyInstance->GetUnrealWorldTransform_AssumesLocked();
-				Transform.SetScale3D(BodyInstance->Scale3D);
-				bi_info->SetStringField("Transform", Transform.ToString());
-				bi_info->SetBoolField("SimulatePhysics", BodyInstance->bSimulatePhysics);
-				TSharedPtr<FJsonObject>  detail_info = MakeShareable(new FJsonObject);
-				SaveBodyInstanceDetail(detail_info, BodyInstance);
-				bi_info->SetObjectField("Detail", detail_info);
+	const FString IndexFilePath = SceneDir / Snapshot.MapName + ".cells.json";
+	if (!FFileHelper::SaveStringToFile(IndexJson, *IndexFilePath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("Failed to save PhysicScene cell index %s"), *IndexFilePath);
+		return false;
+	}
+	UE_LOG(LogTemp, Log, TEXT("PhysicScene %s: %d cells of %.0f"), *Snapshot.MapName, Cells.Num(), Options.GridCellSize);
+	return true;
+}
 
+// Key of a record in the delta state and in the "Removed" lists of a delta file: "<ActorID>_<CompID>"
+// (OwnerID for constraints, fields and landscape tiles), the LandID alone for landscapes.
+FString MakeRecordKey(uint32 ID, uint32 CompID)
+{
+	return FString::Printf(TEXT("%u_%u"), ID, CompID);
+}
 
-				bi_info->SetBoolField("EnableGravity", BodyInstance->bEnableGravity);
-				bi_info->SetBoolField("StartAwake", BodyInstance->bStartAwake);
+uint64 HashString(uint64 Hash, const FString& Str)
+{
+	return HashCombineBytes(Hash, *Str, Str.Len() * sizeof(TCHAR));
+}
 
-				bi_info->SetBoolField("Movable", Cast<UPrimitiveComponent>(StaticMeshComponent)->Mobility == EComponentMobility::Movable);
-				StaticMeshArray.Add(MakeShareable(new FJsonValueObject(bi_info)));
-			}
+// Everything of a body that ends up in the scene, the BodySetup it uses included.
+uint64 HashBodyData(const FString& Package, const SaveBodyData& data)
+{
+	uint64 Hash = HashString(0, Package);
+	Hash = HashString(Hash, data.Name);
+	Hash = HashTransform(Hash, data.Transform);
+	const bool Flags[] = { data.bSimulatePhysics, data.bEnableGravity, data.bStartAwake, data.bMovable };
+	Hash = HashCombineBytes(Hash, Flags, sizeof(Flags));
+	Hash = HashCombineBytes(Hash, data.Overrides.GetData(), data.Overrides.Num() * sizeof(uint32));
+	for (const FTransform& Instance : data.Instances)
+	{
+		Hash = HashTransform(Hash, Instance);
+	}
+	return Hash;
+}
 
+uint64 HashConstraintData(const SaveConstraintData& data)
+{
+	const uint32 ActorIDs[] = { data.ActorID1, data.ActorID2 };
+	uint64 Hash = HashCombineBytes(0, ActorIDs, sizeof(ActorIDs));
+	Hash = HashTransform(Hash, data.Transform);
+	return HashCombineBytes(Hash, &data.ProfileHash, sizeof(data.ProfileHash));
+}
 
-			//static mesh instance
-			TArray<TSharedPtr<FJsonValue>> InstancedStaticMeshArray;
-			for (const auto& InstancedStaticMeshComponent : Data.instanced_static_mesh)
-			{
-				auto BodyInstance = InstancedStaticMeshComponent->GetBodyInstance();
-
-				TSharedPtr<FJsonObject>  bi_info = MakeShareable(new FJsonObject);
-				bi_info->SetNumberField("ActorID", InstancedStaticMeshComponent->GetOwner()->GetUniqueID());
-				bi_info->SetNumberField("CompID", InstancedStaticMeshComponent->GetUniqueID());
-				bi_info->SetStringField("Name", InstancedStaticMeshComponent->GetOwner()->GetActorLabel(false));
-				auto Transform = BodyInstance->GetUnrealWorldTransform_AssumesLocked();
-				Transform.SetScale3D(BodyInstance->Scale3D);
-				bi_info->SetStringField("Transform", Transform.ToString());
-				bi_info->SetBoolField("SimulatePhysics", BodyInstance->bSimulatePhysics);
-				TSharedPtr<FJsonObject>  detail_info = MakeShareable(new FJsonObject);
-				SaveBodyInstanceDetail(detail_info, BodyInstance);
-				bi_info->SetObjectField("Detail", detail_info);
-
-				bi_info->SetBoolField("EnableGravity", BodyInstance->bEnableGravity);
-				bi_info->SetBoolField("StartAwake", BodyInstance->bStartAwake);
-
-				bi_info->SetBoolField("Movable", Cast<UPrimitiveComponent>(InstancedStaticMeshComponent)->Mobility == EComponentMobility::Movable);
-				TArray<TSharedPtr<FJsonValue>> InstancedTransformArray;
-				const auto& instanc_array = InstancedStaticMeshComponent->InstanceBodies;
-				for (const auto& inst : instanc_array)
-				{
-					TSharedPtr<FJsonObject>  inst_tm_json = MakeShareable(new FJsonObject);
-					//bi_info->SetStringField("Name", BodyInstance->GetName());
-					auto inst_Transform = inst->GetUnrealWorldTransform_AssumesLocked();
-					inst_Transform.SetScale3D(inst->Scale3D);
-					inst_tm_json->SetStringField("Transform", inst_Transform.ToString());
+uint64 HashPhysicFieldData(const SavePhysicFieldData& data)
+{
+	uint64 Hash = HashTransform(0, data.Transform);
+	const double Values[] = { data.Direction.X, data.Direction.Y, data.Direction.Z, data.Magnitude, data.bEnable ? 1.0 : 0.0, static_cast<double>(data.FieldType) };
+	return HashCombineBytes(Hash, Values, sizeof(Values));
+}
 
-					InstancedTransformArray.Add(MakeShareable(new FJsonValueObject(inst_tm_json)));
-				}
-				bi_info->SetArrayField("InstancesTM", InstancedTransformArray);
-				InstancedStaticMeshArray.Add(MakeShareable(new FJsonValueObject(bi_info)));
-			}
+uint64 HashLandscapeHeader(const SaveLandscapeData& land_data)
+{
+	uint64 Hash = HashCombineBytes(0, &land_data.LandGuid, sizeof(FGuid));
+	Hash = HashCombineBytes(Hash, &land_data.LandscapeSectionOffset, sizeof(FIntPoint));
+	Hash = HashTransform(Hash, land_data.ActorToWorld);
+	Hash = HashTransform(Hash, land_data.LandscapeActorToWorld);
+	const bool Flags[] = { land_data.bArchive, land_data.bHeights };
+	return HashCombineBytes(Hash, Flags, sizeof(Flags));
+}
 
-			if (StaticMeshArray.Num() > 0)
-			{
-				bs_info->SetArrayField("StaticMesh", StaticMeshArray);
-			}
-			if (InstancedStaticMeshArray.Num() > 0)
+uint64 HashLandscapeCollisionData(const SaveLandscapeCollisionData& coll_data)
+{
+	uint64 Hash = HashString(coll_data.Hash, coll_data.Package);
+	const int32 Sizes[] = { coll_data.SectionBaseX, coll_data.SectionBaseY, coll_data.SimpleCollisionSizeQuads, coll_data.CollisionSizeQuads };
+	Hash = HashCombineBytes(Hash, Sizes, sizeof(Sizes));
+	return HashCombineBytes(Hash, &coll_data.CollisionScale, sizeof(coll_data.CollisionScale));
+}
+
+// Records the hash of every record of the snapshot in SceneState and copies the records that are new or changed
+// since the previous export into OutDelta, with the keys of the records that are gone. A landscape is copied
+// (without its unchanged tiles) when its header or any of its tiles changed, so every tile comes with its landscape.
+void BuildSceneDelta(const FPhysicSceneSnapshot& Snapshot, FExportManifest& SceneState, FPhysicSceneSnapshot& OutDelta)
+{
+	auto IsChanged = [&SceneState](const TCHAR* SectionName, const FString& Key, uint64 Hash)
+	{
+		SceneState.Record(SectionName, Key, Hash);
+		return !SceneState.IsUnchanged(SectionName, Key, Hash);
+	};
+
+	OutDelta.MapName = Snapshot.MapName;
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		SaveBodySetupData* delta_bs = nullptr;
+		auto GetDeltaBodySetup = [&]() -> SaveBodySetupData&
+		{
+			if (delta_bs == nullptr)
 			{
-				bs_info->SetArrayField("StaticMeshInstance", InstancedStaticMeshArray);
+				OutDelta.BodySetupDataSet.push_back(CopyBodySetupHeader(bs_data));
+				delta_bs = &OutDelta.BodySetupDataSet.back();
 			}
+			return *delta_bs;
+		};
+		for (const auto& data : bs_data.static_mesh)
+		{
+			if (IsChanged(TEXT("Bodies"), MakeRecordKey(data.ActorID, data.CompID), HashBodyData(bs_data.Package, data)))
+				GetDeltaBodySetup().static_mesh.push_back(data);
+		}
+		for (const auto& data : bs_data.instanced_static_mesh)
+		{
+			if (IsChanged(TEXT("Bodies"), MakeRecordKey(data.ActorID, data.CompID), HashBodyData(bs_data.Package, data)))
+				GetDeltaBodySetup().instanced_static_mesh.push_back(data);
+		}
+	}
 
-			JsonBodySetupInfoArray.Add(MakeShareable(new FJsonValueObject(bs_info)));
+	for (const auto& data : Snapshot.ConstraintDataSet)
+	{
+		if (IsChanged(TEXT("Constraints"), MakeRecordKey(data.OwnerID, data.CompID), HashConstraintData(data)))
+			OutDelta.ConstraintDataSet.push_back(data);
+	}
 
+	for (const auto& data : Snapshot.PhysicFieldDataSet)
+	{
+		if (IsChanged(TEXT("PhysicFields"), MakeRecordKey(data.OwnerID, data.CompID), HashPhysicFieldData(data)))
+			OutDelta.PhysicFieldDataSet.push_back(data);
+	}
 
+	for (const auto& land_data : Snapshot.LandscapeDataSet)
+	{
+		SaveLandscapeData delta_land = CopyLandscapeHeader(land_data);
+		const bool bHeaderChanged = IsChanged(TEXT("Landscapes"), FString::Printf(TEXT("%u"), land_data.LandID), HashLandscapeHeader(land_data));
+		for (const auto& coll_data : land_data.collisions)
+		{
+			// tiles whose .data could not be written are not in the scene either
+			if (coll_data.bExported && IsChanged(TEXT("LandscapeCollisions"), MakeRecordKey(coll_data.OwnerID, coll_data.CompID), HashLandscapeCollisionData(coll_data)))
+				delta_land.collisions.push_back(coll_data);
 		}
+		if (bHeaderChanged || !delta_land.collisions.empty())
+			OutDelta.LandscapeDataSet.push_back(MoveTemp(delta_land));
+	}
+
+	TSharedRef<FSceneDeltaInfo> DeltaInfo = MakeShared<FSceneDeltaInfo>();
+	DeltaInfo->BaseState = SceneState.GetFingerprint(true);
+	for (const TCHAR* SectionName : { TEXT("Bodies"), TEXT("Constraints"), TEXT("PhysicFields"), TEXT("Landscapes"), TEXT("LandscapeCollisions") })
+	{
+		TArray<FString> Removed = SceneState.GetRemoved(SectionName);
+		if (Removed.Num() > 0)
+			DeltaInfo->Removed.Add(SectionName, MoveTemp(Removed));
+	}
+	OutDelta.State = SceneState.GetFingerprint(false);
+	OutDelta.Delta = DeltaInfo;
+}
+
+// Builds the delta against the state of the previous export (<Map>.state.json) before the scene files are written,
+// so they can be stamped with the State the delta leads to. A server applies a delta only on top of its BaseState.
+void PrepareSceneDelta(FPhysicSceneSnapshot& Snapshot, const FString& JsonFilePath, FExportManifest& OutSceneState, FPhysicSceneSnapshot& OutDelta)
+{
+	// a delta of an older export must not be applied on top of this one
+	IFileManager::Get().Delete(*FPaths::ChangeExtension(JsonFilePath, ".delta.json"), false, true, true);
+
+	OutSceneState.Load(FPaths::ChangeExtension(JsonFilePath, ".state.json"));
+	BuildSceneDelta(Snapshot, OutSceneState, OutDelta);
+	Snapshot.State = OutDelta.State;
+}
+
+// <Map>.delta.json, only once the full scene files are written; the first delta export has nothing to diff against.
+bool WriteSceneDelta(const FPhysicSceneSnapshot& DeltaSnapshot, const FExportManifest& SceneState, const FExportChaosOptions& Options, const FString& JsonFilePath, FExportChaosProgress& Progress)
+{
+	if (!SceneState.HasPrevious())
+	{
+		UE_LOG(LogTemp, Log, TEXT("PhysicScene %s: no state of a previous export, no delta written"), *DeltaSnapshot.MapName);
+		return true;
+	}
+
+	// bodies are listed one by one even when the scene merges them into static aggregates,
+	// the server replaces the aggregate shape with the same ActorID / CompID. A delta only holds the changed
+	// constraints, the islands of the full scene files stay the reference.
+	const FString DeltaFilePath = FPaths::ChangeExtension(JsonFilePath, ".delta.json");
+	if (!WritePhysicSceneJson(DeltaSnapshot, Options, DeltaFilePath, nullptr, nullptr, nullptr, Progress))
+		return false;
+	Progress.GetStats().Add(TEXT("Write.Delta"), 1, IFileManager::Get().FileSize(*DeltaFilePath));
+	return true;
+}
+
+// Background part of the export, touches no UObject: landscape .data files, the PhysicScene json and
+// binary, the cook of the saved packages and the manifest. The manifest is only saved by a complete export.
+bool WritePhysicExport(FPhysicSceneSnapshot& Snapshot, const FExportChaosOptions& Options, FExportManifest& Manifest, FExportChaosProgress& Progress)
+{
+	const FText MapNameText = FText::FromString(Snapshot.MapName);
+
+	Progress.Report(FText::Format(LOCTEXT("ExportChaosWritingLandscape", "Writing the landscape collision of {0}..."), MapNameText));
+	WriteLandscapeData(Snapshot, Manifest, Progress);
+	if (Progress.IsCancelled())
+		return false;
+
+	if (Options.bDirectBodySetups)
+	{
+		Progress.Report(FText::Format(LOCTEXT("ExportChaosWritingBodySetups", "Writing the cooked BodySetups of {0}..."), MapNameText));
+		WriteBodySetupFiles(Snapshot, Progress);
+		if (Progress.IsCancelled())
+			return false;
+	}
+
+	const FString JsonFilePath = GetPhysicSceneFilePath(Snapshot.MapName);
+	FExportManifest SceneState;
+	FPhysicSceneSnapshot DeltaSnapshot;
+	if (Options.bDelta)
+	{
+		EXPORT_CHAOS_PHASE(Progress.GetStats(), "Write.Delta");
+		PrepareSceneDelta(Snapshot, JsonFilePath, SceneState, DeltaSnapshot);
+	}
+
+	// on the whole map, the bodies of a grid cell alone would turn the ones of the next cells into anchors
+	TArray<FConstraintIsland> Islands;
+	{
+		EXPORT_CHAOS_PHASE(Progress.GetStats(), "Write.ConstraintIslands");
+		Islands = BuildConstraintIslands(Snapshot);
+		Progress.GetStats().Add(TEXT("Write.ConstraintIslands"), Islands.Num());
+	}
+
+	if (Options.GridCellSize > 0.0f)
+	{
+		if (!WriteGridCells(Snapshot, Islands, Options, Progress))
+			return false;
+	}
+	else
+	{
+		Progress.Report(FText::Format(LOCTEXT("ExportChaosWritingScene", "Writing the PhysicScene of {0}..."), MapNameText));
+		if (!WriteSceneFiles(Snapshot, &Islands, Options, JsonFilePath, Progress))
+			return false;
+	}
+
+	if (Options.bDelta)
+	{
+		EXPORT_CHAOS_PHASE(Progress.GetStats(), "Write.Delta");
+		if (!WriteSceneDelta(DeltaSnapshot, SceneState, Options, JsonFilePath, Progress))
+			return false;
+	}
 
-		if (PackageNameArray.Num())
+	TArray<FString> PackageNameArray;
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		if (bs_data.bCook)
+			PackageNameArray.Add(bs_data.Package);
+	}
+
+	const FString ManifestFilePath = FPaths::ChangeExtension(JsonFilePath, ".manifest.json");
+	TArray<FString> FailedPackages;
+	bool bCooked = false;
+	if (!Options.DeferredCookList.IsEmpty())
+	{
+		// the parent commandlet cooks the packages of all its workers at once, see CookDeferredPhysicPackages
+		FString CookList;
+		for (const FString& PackageName : PackageNameArray)
 		{
-			FString PackageAllName = FString::JoinBy(PackageNameArray, TEXT("+"), [](auto v) {return "/Game/Physic/" + v; });
+			CookList += PackageName + TEXT("\t") + ManifestFilePath + LINE_TERMINATOR;
+		}
+		bCooked = FFileHelper::SaveStringToFile(CookList, *Options.DeferredCookList, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM, &IFileManager::Get(), FILEWRITE_Append);
+		if (!bCooked)
+		{
+			UE_LOG(LogTemp, Error, TEXT("Failed to write the deferred cook list %s"), *Options.DeferredCookList);
+			FailedPackages = PackageNameArray;
+		}
+	}
+	else
+	{
+		Progress.Report(FText::Format(LOCTEXT("ExportChaosCookingStart", "Cooking {0} physics packages..."), PackageNameArray.Num()));
+		EXPORT_CHAOS_PHASE(Progress.GetStats(), "Cook");
+		bCooked = CookPhysicPackages(PackageNameArray, Options, Progress, FailedPackages);
+		Progress.GetStats().Add(TEXT("Cook"), PackageNameArray.Num() - FailedPackages.Num());
+		TRACE_COUNTER_SET(ExportChaosPackagesCooked, PackageNameArray.Num() - FailedPackages.Num());
+	}
+	if (Progress.IsCancelled())
+		return false;
 
-			const FString EditorBinary = FPlatformProcess::ExecutablePath();
-			const FString Project = FPaths::SetExtension(FPaths::Combine(FPaths::ProjectDir(), FApp::GetProjectName()), ".uproject");
-			const FString CmdParams = "\"" + Project + "\"" + " -run=Cook  -TargetPlatform=LinuxServer -iterate -ddc=DerivedDataBackendGraph -unversioned -fileopenlog -stdout -CrashForUAT -unattended -NoLogTimes  -UTF8Output -cooksinglepackagenorefs -NoGameAlwaysCook -PACKAGE=" + PackageAllName;
-			UE_LOG(LogTemp, Warning, TEXT("RUN CMD:%s %s"), *EditorBinary, *CmdParams);
+	for (const auto& bs_data : Snapshot.BodySetupDataSet)
+	{
+		// failed packages stay out of the manifest so the next export retries them
+		if (!bs_data.bSaveFailed && !FailedPackages.Contains(bs_data.Package))
+		{
+			Manifest.Record(TEXT("BodySetups"), bs_data.Package, bs_data.Hash);
+		}
+	}
 
-			void* PipeRead = nullptr;
-			void* PipeWrite = nullptr;
-			verify(FPlatformProcess::CreatePipe(PipeRead, PipeWrite));
+	if (!Manifest.Save(ManifestFilePath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to save export manifest %s"), *ManifestFilePath);
+	}
 
-			FProcHandle WorkerHandle = FPlatformProcess::CreateProc(*EditorBinary, *CmdParams, false, false, false, nullptr, 0, nullptr, PipeWrite, nullptr);
+	// the scene files carry this state now, the next delta is built against it
+	const FString StateFilePath = FPaths::ChangeExtension(JsonFilePath, ".state.json");
+	if (Options.bDelta && !SceneState.Save(StateFilePath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to save export state %s"), *StateFilePath);
+	}
 
-			TArray<uint8> BinaryFileContent;
-			while (FPlatformProcess::IsProcRunning(WorkerHandle))
-			{
-				FPlatformProcess::Sleep(0);
+	//FString PackageFileName = FPaths::ProjectContentDir() / "DumpBodySetup.uasset";
+	////FString PackageFileName = "/Game/DumpBodySetup";
+	//UPackage::SavePackage(SavePkg, nullptr, *PackageFileName, SaveArgs);
+	//UPackage::WaitForAsyncFileWrites();
+	//check(IFileManager::Get().FileExists(*PackageFileName));
 
-				TArray<uint8> BinaryData;
-				FPlatformProcess::ReadPipeToArray(PipeRead, BinaryData);
-				if (BinaryData.Num() > 0)
-				{
-					BinaryFileContent.Append(MoveTemp(BinaryData));
-				}
-			}
 
-			TArray<uint8> BinaryData;
-			FPlatformProcess::ReadPipeToArray(PipeRead, BinaryData);
-			if (BinaryData.Num() > 0)
-			{
-				BinaryFileContent.Append(MoveTemp(BinaryData));
-			}
-			BinaryFileContent.Add(0);
 
-			int32 ExitCode = 0xffffffff;
-			bool GotReturnCode = FPlatformProcess::GetProcReturnCode(WorkerHandle, &ExitCode);
-			FPlatformProcess::CloseProc(WorkerHandle);
+	//TArray<ITargetPlatform*> TargetPlatforms;
+	//TargetPlatforms.Add(TargetPlatform);
+	//TArray<FString> CookedMaps;
+	//TArray<FString> CookDirectories;
+	//TArray<FString> CookCultures;
+	//TArray<FString> IniMapSections;
+	//GEditor->StartCookByTheBookInEditor(TargetPlatforms, CookedMaps, CookDirectories, CookCultures, IniMapSections);
+	return bCooked;
+}
 
-			if(ExitCode == 0)
-			{
-				UE_LOG(LogTemp, Log, TEXT("%s"), ANSI_TO_TCHAR((char*)BinaryFileContent.GetData()));
-			}
-			else
+// Game thread half shared by the toolbar export and ExportChaosPhysicScene:
+// resolves the target platform, loads the manifest of the previous export and captures the world.
+bool CapturePhysicExport(UWorld* World, const FExportChaosOptions& Options, FExportManifest& Manifest, FPhysicSceneSnapshot& Snapshot, FExportChaosProgress& Progress)
+{
+	ITargetPlatform* TargetPlatform = GetTargetPlatformManager()->FindTargetPlatform(TEXT("LinuxServer"));
+	if (TargetPlatform == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Should Add TargetPlatfrom LinuxServer"));
+		return false;
+	}
+	/*{
+		auto loadPkg = LoadPackage(nullptr, ANSI_TO_TCHAR("/Game/Physic/SM_Cube"), LOAD_None);
+		if (loadPkg)
+		{
+			auto NewBodySetup = LoadObject<UBodySetup>(loadPkg, ANSI_TO_TCHAR("BodySetup_1"));
+			check(NewBodySetup);
+			if (NewBodySetup)
 			{
-				UE_LOG(LogTemp, Error, TEXT("exit code: %d\n%s"), ExitCode, ANSI_TO_TCHAR((char*)BinaryFileContent.GetData()));
+				check(NewBodySetup->IsAsset());
+				check(NewBodySetup->IsCachedCookedPlatformDataLoaded(TargetPlatform));
 			}
 
-			FPlatformProcess::ClosePipe(PipeRead, PipeWrite);
+		}
+	}*/
+
+	if (Options.bIncremental)
+	{
+		Manifest.Load(FPaths::ChangeExtension(GetPhysicSceneFilePath(World->GetMapName()), ".manifest.json"));
+	}
+	return CapturePhysicScene(World, TargetPlatform, Options, Manifest, Snapshot, Progress.GetStats());
+}
+
+// <Map>.report.json next to the scene, failed and cancelled exports write it too.
+void SaveExportReport(const FString& MapName, const FExportChaosOptions& Options, FExportChaosProgress& Progress, bool bSuccess)
+{
+	const TCHAR* Result = Progress.IsCancelled() ? TEXT("Cancelled") : (bSuccess ? TEXT("Succeeded") : TEXT("Failed"));
+	const FString ReportFilePath = FPaths::ChangeExtension(GetPhysicSceneFilePath(MapName), ".report.json");
+	if (!Progress.GetStats().SaveReport(ReportFilePath, MapName, Options, Result))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Failed to save export report %s"), *ReportFilePath);
+	}
+}
+
+bool ExportChaosPhysicScene(UWorld* World, const FString& DeferredCookList)
+{
+	check(IsInGameThread());
+	if (World == nullptr)
+		return false;
+	if (GActiveExport.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ExportChaos: an export is already running"));
+		return false;
+	}
+
+	FExportChaosOptions Options = FExportChaosOptions::FromConsoleVariables();
+	Options.DeferredCookList = DeferredCookList;
+	FExportManifest Manifest;
+	FPhysicSceneSnapshot Snapshot;
+	TSharedRef<FExportChaosProgress> Progress = MakeShared<FExportChaosProgress>();
+	if (!CapturePhysicExport(World, Options, Manifest, Snapshot, *Progress))
+		return false;
+
+	const bool bSuccess = WritePhysicExport(Snapshot, Options, Manifest, *Progress);
+	SaveExportReport(Snapshot.MapName, Options, *Progress, bSuccess);
+	return bSuccess;
+}
 
-			if (ExitCode == 0)
+bool CookDeferredPhysicPackages(const TArray<FString>& CookListFiles)
+{
+	// a package shared by several maps is cooked once, a failure goes to the manifest of each of them
+	TMap<FString, TArray<FString>> PackageManifests;
+	for (const FString& CookListFile : CookListFiles)
+	{
+		TArray<FString> Lines;
+		FFileHelper::LoadFileToStringArray(Lines, *CookListFile);
+		for (const FString& Line : Lines)
+		{
+			FString PackageName, ManifestFilePath;
+			if (Line.Split(TEXT("\t"), &PackageName, &ManifestFilePath))
 			{
-				for (const auto& PackageName : PackageNameArray)
-				{
-					FString PackageFileName = FPaths::ProjectContentDir() / "Physic" / PackageName + ".uasset";
-					if (IFileManager::Get().FileExists(*PackageFileName))
-					{
-						IFileManager::Get().Delete(*PackageFileName);
-					}
-				}
+				PackageManifests.FindOrAdd(PackageName).AddUnique(ManifestFilePath);
 			}
 		}
+	}
+	TArray<FString> PackageNameArray;
+	PackageManifests.GenerateKeyArray(PackageNameArray);
 
-		TArray<TSharedPtr<FJsonValue>> JsonConstraintsInfoArray;
-		for (const auto& data : ConstraintDataSet)
+	const FExportChaosOptions Options = FExportChaosOptions::FromConsoleVariables();
+	FExportChaosProgress Progress;
+	TArray<FString> FailedPackages;
+	const bool bCooked = CookPhysicPackages(PackageNameArray, Options, Progress, FailedPackages);
+
+	// the workers recorded every listed package, the failed ones must be retried by the next export
+	TMap<FString, TArray<FString>> ManifestFailures;
+	for (const FString& PackageName : FailedPackages)
+	{
+		for (const FString& ManifestFilePath : PackageManifests[PackageName])
 		{
-			TSharedPtr<FJsonObject> cs_info = MakeShareable(new FJsonObject);
-			cs_info->SetNumberField("OwnerID", data.OwnerID);
-			cs_info->SetNumberField("CompID", data.CompID);
-			cs_info->SetNumberField("ActorID1", data.ActorID1);
-			cs_info->SetNumberField("ActorID2", data.ActorID2);
-			cs_info->SetStringField("Transform", data.Transform.ToString());
-			
-			TSharedRef<FJsonObject> JsonConstraintProfile = MakeShareable(new FJsonObject);
-			if (FJsonObjectConverter::UStructToJsonObject(FConstraintProfileProperties::StaticStruct(), &data.profile, JsonConstraintProfile, 0, 0))
-			{
-				cs_info->SetObjectField("Profile", JsonConstraintProfile);
-			}
-			
-			JsonConstraintsInfoArray.Add(MakeShareable(new FJsonValueObject(cs_info)));
+			ManifestFailures.FindOrAdd(ManifestFilePath).Add(PackageName);
+		}
+	}
+	for (const auto& [ManifestFilePath, Packages] : ManifestFailures)
+	{
+		if (!FExportManifest::RemoveSaved(ManifestFilePath, TEXT("BodySetups"), Packages))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Failed to save export manifest %s"), *ManifestFilePath);
 		}
+	}
+	return bCooked;
+}
+
+// Captures the world on the game thread, then writes and cooks it on a background thread.
+// Returns once the export is started, the notification reports progress and offers Cancel.
+bool FExportChaosEditorModule::ExportPhysicData()
+{
+	if (GActiveExport.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ExportChaos: an export is already running"));
+		return false;
+	}
+
+	// UWorld* World = GEditor->GetEditorWorldContext(false).World();
+	UWorld* World = NULL;
 
-		TArray<TSharedPtr<FJsonValue>> JsonPhysicFieldInfoArray;
-		for (const auto& data : PhysicFieldDataSet)
+	auto WorldList = GEngine->GetWorldContexts();
+	for (int32 i = 0; i < WorldList.Num(); ++i)
+	{
+		UWorld* local_World = WorldList[i].World();
+		if (local_World && UKismetSystemLibrary::IsValid(local_World))
 		{
-			TSharedPtr<FJsonObject> cs_info = MakeShareable(new FJsonObject);
-			cs_info->SetNumberField("OwnerID", data.OwnerID);
-			cs_info->SetNumberField("CompID", data.CompID);
-			cs_info->SetBoolField("Enable", data.bEnable);
-			cs_info->SetNumberField("PhysicFieldType", data.FieldType);
-			
-			cs_info->SetStringField("Transform", data.Transform.ToString());
-			cs_info->SetStringField("Direction", data.Direction.ToString());
-			cs_info->SetNumberField("Magnitude", data.Magnitude);
-			JsonPhysicFieldInfoArray.Add(MakeShareable(new FJsonValueObject(cs_info)));
+			World = local_World;
+			break;
 		}
-		
-		//ZenStoreWriter->EndCook();
-		TSharedRef<FJsonObject> JsonRootObject = MakeShareable(new FJsonObject());
-		//JsonRootObject->SetStringField("PackageFile", PackageName);
-		JsonRootObject->SetArrayField("BodySetups", JsonBodySetupInfoArray);
-		JsonRootObject->SetArrayField("Constraints", JsonConstraintsInfoArray);
-		JsonRootObject->SetArrayField("PhysicFields", JsonPhysicFieldInfoArray);
-		JsonRootObject->SetArrayField("Landscapes", LandInfoArray);
-		
-		JsonRootObject->SetStringField("MapName", MapName);
-		auto JsonTxt = JsonObjToJsonStr(JsonRootObject);
+	}
+	if (!World) return false;
+
+	FString MapName = World->GetMapName();
+	//World->bDebugDrawAllTraceTags = true;
+	//FVector Start = FVector(1680, 1240, 60);
+	//FVector End = FVector(1680, 1740, 60);
+	//FQuat   Rot = FQuat(0, 0, 0, 1);
+
+	//for (TObjectIterator<ALandscape> It; It; ++It)
+	//{
+	//	if (It->GetWorld() == World)
+	//	{
+	//		auto Landscape = *It;
+	//		auto height_1 = Landscape->GetHeightAtLocation({ -5130.000000,-6500.000000,1360.000000 }, EHeightfieldSource::Complex);
+	//		auto height_2 = Landscape->GetHeightAtLocation({ 1600.000000,-6500.000000,0.000000 }, EHeightfieldSource::Complex);
+	//		UE_LOG(LogTemp, Warning, TEXT("ID:%d %f %f"), Landscape->GetUniqueID(), height_1.GetValue(), height_2.GetValue());
+	//	}
+	//}
 
-		FString JsonFilePath = FPaths::ProjectSavedDir() / "Cooked/LinuxServer" / FApp::GetProjectName() / "Content/PhysicScene/" + MapName +".json";
-		//保存json
-		FFileHelper::SaveStringToFile(JsonTxt, *JsonFilePath);
+	//if(true)
+	//{
+	//	static FCollisionShape CollisionShape = FCollisionShape::MakeCapsule(DEFAULT_CAPSULE_RADIUS, DEFAULT_CAPSULE_HALFHEIGHT);
 
-		FText ChaosSuccMsg = LOCTEXT("SaveChaosMeshMesh", "Successd to Export the ChaosMesh.");
-		CreateSaveFileNotify(ChaosSuccMsg, JsonFilePath);
+	//	ECollisionChannel                         TraceChannel = ECC_WorldStatic;
+	//	const struct FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam;
+	//	const struct FCollisionResponseParams& ResponseParams = FCollisionResponseParams::DefaultResponseParam;
+	//	const struct FCollisionObjectQueryParams& ObjectParams = FCollisionObjectQueryParams::DefaultObjectQueryParam;
+	//	struct FHitResult                         OutHit;
+	//	if (FPhysicsInterface::GeomSweepSingle(World,
+	//		CollisionShape,
+	//		Rot,
+	//		OutHit,
+	//		Start,
+	//		End,
+	//		TraceChannel,
+	//		Params,
+	//		ResponseParams,
+	//		ObjectParams) == true)
+	//	{
+	//		UE_LOG(LogTemp, Warning, TEXT("XXXXXXX"));
+	//	}
+	//	else
+	//	{
+	//		UE_LOG(LogTemp, Warning, TEXT("YYYYYYY"));
+	//	}
 
-		//FString PackageFileName = FPaths::ProjectContentDir() / "DumpBodySetup.uasset";
-		////FString PackageFileName = "/Game/DumpBodySetup";
-		//UPackage::SavePackage(SavePkg, nullptr, *PackageFileName, SaveArgs);
-		//UPackage::WaitForAsyncFileWrites();
-		//check(IFileManager::Get().FileExists(*PackageFileName));
+	//}
 
+	const FExportChaosOptions Options = FExportChaosOptions::FromConsoleVariables();
+	// a grid export has no single scene file, the notification links the cell index instead
+	const FString JsonFilePath = Options.GridCellSize > 0.0f
+		? FPaths::ChangeExtension(GetPhysicSceneFilePath(MapName), ".cells.json")
+		: GetPhysicSceneFilePath(MapName);
 
+	TSharedRef<FExportManifest> Manifest = MakeShared<FExportManifest>();
+	TSharedRef<FPhysicSceneSnapshot> Snapshot = MakeShared<FPhysicSceneSnapshot>();
+	TSharedRef<FExportChaosProgress> Progress = MakeShared<FExportChaosProgress>();
+	if (!CapturePhysicExport(World, Options, *Manifest, *Snapshot, *Progress))
+		return false;
 
-		//TArray<ITargetPlatform*> TargetPlatforms;
-		//TargetPlatforms.Add(TargetPlatform);
-		//TArray<FString> CookedMaps;
-		//TArray<FString> CookDirectories;
-		//TArray<FString> CookCultures;
-		//TArray<FString> IniMapSections;
-		//GEditor->StartCookByTheBookInEditor(TargetPlatforms, CookedMaps, CookDirectories, CookCultures, IniMapSections);
-	}
+	Progress->ShowNotification(FText::Format(LOCTEXT("ExportChaosStarted", "Exporting the physics of {0}..."), FText::FromString(MapName)));
+	GActiveExport = Progress;
 
+	GActiveExportTask = Async(EAsyncExecution::Thread, [Snapshot, Manifest, Progress, Options, JsonFilePath]()
+	{
+		const bool bSuccess = WritePhysicExport(*Snapshot, Options, *Manifest, *Progress);
+		SaveExportReport(Snapshot->MapName, Options, *Progress, bSuccess);
+		AsyncTask(ENamedThreads::GameThread, [Progress, bSuccess, JsonFilePath]()
+		{
+			// a completion arriving after ShutdownModule leaves everything alone
+			if (!FModuleManager::Get().IsModuleLoaded(TEXT("ExportChaosEditor")))
+				return;
+			GActiveExport.Reset();
+			GActiveExportTask.Reset();
+			if (Progress->IsCancelled())
+			{
+				Progress->Finish(LOCTEXT("ExportChaosCancelled", "Physics export cancelled."), false);
+			}
+			else if (!bSuccess)
+			{
+				Progress->Finish(LOCTEXT("ExportChaosFailed", "Physics export failed, see the output log."), false);
+			}
+			else
+			{
+				Progress->Finish(LOCTEXT("ExportChaosFinished", "Physics export finished."), true);
+				FText ChaosSuccMsg = LOCTEXT("SaveChaosMeshMesh", "Successd to Export the ChaosMesh.");
+				FModuleManager::GetModuleChecked<FExportChaosEditorModule>(TEXT("ExportChaosEditor")).CreateSaveFileNotify(ChaosSuccMsg, JsonFilePath);
+			}
+		});
+	});
 
 	return true;
 }
 
-
 void FExportChaosEditorModule::AddMenuExtension(FMenuBuilder& Builder)
 {
 	Builder.AddMenuEntry(FExportChaosCommands::Get().PluginAction);